@@ -1,243 +1,147 @@
-#include <iostream>
-#include <string>
-#include <vector>
-#include <iomanip>
+#include "inventory_core.h"
+#include <sys/ioctl.h>
+#include <termios.h>
 using namespace std;
 
-// class used to represent the items individually
-class Item {
-private:
-    string itemId;
-    string itemName;
-    int itemQuantity;
-    double itemPrice;
-    string itemCategory;
-    
+//abstract class used to clear the screen and wait for a key without spawning a shell
+class Terminal {
 public:
-    // Constructor using initialization list
-    Item(const string& id, const string& name, int quantity, double price, const string& category) 
-        : itemId(id), itemName(name), itemQuantity(quantity), itemPrice(price), itemCategory(category) {}
-
-    const string& getId() const { return itemId; }
-    const string& getName() const { return itemName; }
-    int getQuantity() const { return itemQuantity; }
-    double getPrice() const { return itemPrice; }
-    const string& getCategory() const { return itemCategory; }
-
-    void setQuantity(int quantity) { itemQuantity = quantity; }
-    void setPrice(double price) { itemPrice = price; }
-
-    void display() const {
-        cout << "Category: " << itemCategory << "\n"
-             << "ID: " << itemId << "\n"
-             << "Item Name: " << itemName << "\n"
-             << "Price: " << std::fixed << std::setprecision(2) << itemPrice << "\n"
-             << "Quantity: " << itemQuantity << "\n";
-    }
+    virtual ~Terminal() {}
+    virtual void clearScreen() = 0;
+    virtual void pause() = 0;  // Waits for any key, like the old system("pause")
+    virtual char waitForKey() = 0;  // Returns the key pressed, 0 if there is no one to ask
+    virtual size_t pageRows() const = 0;  // Rows that fit on one screen, 0 to never paginate
 };
 
-//class used to handle menu input
-class InputHandler {
-public:
-    // Helper function to convert string to lowercase
-    string toLowerCase(const string& str) const {
-        string lowerStr = str;
-        for (char& c : lowerStr) {
-            c = tolower(c);
-        }
-        return lowerStr;
-    }
-    
-     // Helper function to convert string to uppercase for displaying items
-    string toUpperCase(const string& str) const {
-        string upperStr = str;
-        for (char& c : upperStr) {
-            c = toupper(c);
-        }
-        return upperStr;
-    }
+// class used for interactive sessions: ANSI escapes to clear, termios to read a single key
+class AnsiTerminal : public Terminal {
+private:
+    bool inputIsTerminal;
+    bool outputIsTerminal;
 
-    // Helper function to check if a string is a valid integer
-    bool isValidInteger(const string& str) const {
-        if (str.empty()) return false;  // Empty input is invalid
-        for (char c : str) {
-            if (!isdigit(c)) return false;  // Non-digit character found
-        }
-        return true;
-    }
+public:
+    AnsiTerminal() : inputIsTerminal(isatty(STDIN_FILENO)), outputIsTerminal(isatty(STDOUT_FILENO)) {}
 
-    // Helper function to check if a string is a valid double
-    bool isValidDouble(const string& str) const {
-        if (str.empty()) return false;  // Empty input is invalid
-        bool decimalPointFound = false;
-        for (char c : str) {
-            if (c == '.') {
-                if (decimalPointFound) return false;  // More than one decimal point found
-                decimalPointFound = true;
-            } else if (!isdigit(c)) {
-                return false;  // Non-digit and non-decimal point character found
-            }
-        }
-        return true;
+    void clearScreen() override {
+        if (!outputIsTerminal) return;  // Keep redirected output free of escape codes
+        cout << "\033[2J\033[H" << flush;
     }
 
-    // Generic function to get string input with the ability to cancel (case-insensitive)
-    bool getInput(string prompt, string& input, const string& cancelKey = "C") const {
-        cout << prompt;
-        getline(cin, input);
-        if (toLowerCase(input) == toLowerCase(cancelKey)) {
-            cout << "\n> Action cancelled, going back to menu...\n";
-            cout << "Press any key to continue...\n";
-            cin.get();  // Wait for user input before returning
-            system("cls");
-            return false;  // Return false to indicate cancellation
-        }
-        return true;  // Return true if input is valid and not cancelled
+    void pause() override {
+        cout << "Press any key to continue . . ." << flush;
+        waitForKey();
+        cout << "\n";
     }
 
-    // Function to get integer input with validation and cancellation
-    bool getInput(string prompt, int& input, const string& cancelKey = "C") const {
-        string strInput;
-        cout << prompt;
-        getline(cin, strInput);
-        if (toLowerCase(strInput) == toLowerCase(cancelKey)) {
-            cout << "\n> Action cancelled, going back to menu...\n";
-            cout << "Press any key to continue...\n";
-            cin.get();
-            system("cls");
-            return false;
-        }
-        if (!isValidInteger(strInput)) {
-            cout << "\n> Invalid input, please enter a valid number.\n";
-            return getInput(prompt, input, cancelKey);  // Retry on invalid input
-        }
-        input = stoi(strInput);
-        return true;
+    char waitForKey() override {
+        if (!inputIsTerminal) return 0;
+
+        // Read one key straight from the terminal, bypassing anything left in cin's line buffer
+        termios original;
+        tcgetattr(STDIN_FILENO, &original);
+        termios raw = original;
+        raw.c_lflag &= ~(ICANON | ECHO);
+        raw.c_cc[VMIN] = 1;
+        raw.c_cc[VTIME] = 0;
+        tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+        char key = 0;
+        while (::read(STDIN_FILENO, &key, 1) < 0 && errno == EINTR) {}
+        tcsetattr(STDIN_FILENO, TCSANOW, &original);
+        return key;
     }
 
-    // Function to get double input with validation and cancellation
-    bool getInput(string prompt, double& input, const string& cancelKey = "C") const {
-        string strInput;
-        cout << prompt;
-        getline(cin, strInput);
-        if (toLowerCase(strInput) == toLowerCase(cancelKey)) {
-            cout << "\n> Action cancelled, going back to menu...\n";
-            cout << "Press any key to continue...\n";
-            cin.get();
-            return false;
-        }
-        if (!isValidDouble(strInput)) {
-            cout << "\n> Invalid price, please enter a positive value (only up to 10 digits).\n";
-            return getInput(prompt, input, cancelKey);  // Retry on invalid input
-        }
-        input = stod(strInput);
-        return true;
+    size_t pageRows() const override {
+        if (!inputIsTerminal || !outputIsTerminal) return 0;
+        winsize size;
+        if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) != 0 || size.ws_row < 10) return 20;
+        return size.ws_row - 8;  // Leave room for the title, column header and prompt
     }
 };
-    
-//abstract class used for validation of values
-class AbstractValidation {
-public:
-    virtual bool validateId(const string& id) const = 0;
-    virtual bool validateQuantity(int quantity) const = 0;
-    virtual bool validatePrice(double price) const = 0;
-};
 
-//implementation of a concrete validation class
-class ItemValidation : public AbstractValidation {
+// class used for scripted and benchmark runs where clearing and pausing are no-ops
+class HeadlessTerminal : public Terminal {
 public:
-    bool validateId(const string& id) const override {
-        // Validation for ID (e.g., checking length, format)
-        return !id.empty() && isValidIdOrCategory(id);
-    }
-
-    bool validateQuantity(int quantity) const override {
-        return quantity > 0;
-    }
-
-    bool validatePrice(double price) const override {
-        if (price <= 0.0) return false;
-
-        // Convert the price to a string and check if the whole part has 10 or fewer digits
-        stringstream priceStream;
-        priceStream << fixed << setprecision(2) << price;
-        string priceStr = priceStream.str();
+    void clearScreen() override {}
+    void pause() override {}
+    char waitForKey() override { return 0; }
+    size_t pageRows() const override { return 0; }
+};
 
-        // Find the position of the decimal point
-        size_t decimalPos = priceStr.find('.');
-        string wholePart = (decimalPos != string::npos) ? priceStr.substr(0, decimalPos) : priceStr;
+// Terminal used by every screen, main() installs the implementation for the session
+static HeadlessTerminal headlessTerminal;
+static Terminal* activeTerminal = &headlessTerminal;
 
-        return wholePart.length() <= 10;  // Ensure that the whole part has 10 or fewer digits
-    }
+Terminal& terminal() { return *activeTerminal; }
+void useTerminal(Terminal& term) { activeTerminal = &term; }
 
-	bool validateCategory(const string& category) const {
-        string lowerCategory = toLowerCase(category);
-        return lowerCategory == "clothing" || lowerCategory == "entertainment" || lowerCategory == "electronics";
-    }
-
-    bool isValidIdOrCategory(const string& str) const {
-        for (char c : str) {
-            if (!isalnum(c)) {  // Check for non-alphanumeric characters
-                return false;
-            }
-        }
+//class used to handle menu input
+class InputHandler {
+private:
+    // Checks for the cancel key (case-insensitive) and, if found, tells the user and waits
+    bool cancelled(const string& input, const string& cancelKey) const {
+        if (!equalsIgnoreCase(input, cancelKey)) return false;
+        cout << "\n> Action cancelled, going back to menu...\n";
+        cout << "Press any key to continue...\n";
+        cin.get();  // Wait for user input before returning
+        terminal().clearScreen();
         return true;
     }
 
-    bool isValidNumericInput(const string& input, double& output) const {
-        for (char c : input) {
-            if (!isdigit(c) && c != '.') {
-                return false;  // Invalid character found
-            }
-        }
-        output = stod(input);  // Convert valid string to double
-        return true;
+public:
+    // Generic function to get string input with the ability to cancel (case-insensitive)
+    bool getInput(string prompt, string& input, const string& cancelKey = "C") const {
+        cout << prompt;
+        if (!getline(cin, input)) return false;  // End of input counts as cancelling
+        return !cancelled(input, cancelKey);  // Return true if input is valid and not cancelled
     }
 
-    bool isValidNumericInput(const string& input, int& output) const {
-        for (char c : input) {
-            if (!isdigit(c)) {
-                return false;  // Invalid character found
+    // Function to get integer input with validation and cancellation, asking again until it is valid
+    bool getInput(string prompt, int& input, const string& cancelKey = "C") const {
+        string strInput;
+        while (true) {
+            cout << prompt;
+            if (!getline(cin, strInput) || cancelled(strInput, cancelKey)) return false;
+            NumberStatus status = parseCount(strInput, input);
+            if (status == NUMBER_OK) return true;
+            if (status == NUMBER_OUT_OF_RANGE) {
+                cout << "\n> Number too large, please enter a smaller value.\n";
+            } else {
+                cout << "\n> Invalid input, please enter a valid number.\n";
             }
         }
-        output = stoi(input);  // Convert valid string to int
-        return true;
     }
-    
-    // Helper function to convert a string to lowercase
-    string toLowerCase(const string& str) const {
-        string lowerStr = str;
-        for (char& c : lowerStr) {
-            c = tolower(c);
+
+    // Function to get a price with validation and cancellation, asking again until it is valid
+    bool getInput(string prompt, Money& input, const string& cancelKey = "C") const {
+        string strInput;
+        while (true) {
+            cout << prompt;
+            if (!getline(cin, strInput) || cancelled(strInput, cancelKey)) return false;
+            if (parseMoney(strInput, input) == NUMBER_OK) return true;
+            cout << "\n> Invalid price, please enter a positive value (only up to 10 digits).\n";
         }
-        return lowerStr;
     }
 };
-
+    
 // class used to handle adding items in the inventory
 class AddItem {
 private:
-    vector<Item>& inventory;
+    InventoryCore core;
     ItemValidation& validation;
-    InputHandler inputHandler; 
+    InputHandler inputHandler;
 
 public:
-    AddItem(vector<Item>& inv, ItemValidation& val) : inventory(inv), validation(val) {}
+    AddItem(InventoryStore& inv, ItemValidation& val) : core(inv), validation(val) {}
 
     // Helper function to check for duplicate IDs in the inventory
     bool isDuplicateId(const string& id) const {
-        for (const auto& item : inventory) {
-            if (item.getId() == id) {
-                return true;  // Duplicate ID found
-            }
-        }
-        return false;  // No duplicate found
+        return core.isDuplicateId(id);
     }
 
 	void addNewItem() {
 	    string id, name, category;
 	    int quantity;
-	    double price;
+	    Money price;
 	
 	    cout << "===========================================\n";
 	    cout << "\t\tADDING ITEM\n";
@@ -250,8 +154,9 @@ public:
 	        if (!inputHandler.getInput("[Category]: ", category)) return;
 	        
 	        // Validate that category is one of the three allowed options
-	        if (validation.validateCategory(category)) {
-	            category = inputHandler.toLowerCase(category);  // Standardize the category as lowercase
+	        Category parsed;
+	        if (parseCategory(category, parsed)) {
+	            category = CATEGORY_NAMES[parsed];  // Standardize the category as lowercase
 	            break;
 	        }
 	        cout << "\n> Invalid category, please enter one of the following: clothing, entertainment, electronics.\n" << endl;
@@ -262,7 +167,7 @@ public:
 	        if (!inputHandler.getInput("[ID]: ", id)) return;
 	
 	        // Convert ID to uppercase
-	        id = inputHandler.toUpperCase(id);
+	        toUpperInPlace(id);
 	
 	        // Validate ID
 	        if (!validation.validateId(id)) {
@@ -296,24 +201,27 @@ public:
 	    }
 	
 	    // If all validations pass, add the item to the inventory
-	    Item newItem(id, name, quantity, price, category);
-	    inventory.push_back(newItem);  // Add to inventory if no duplicates
-	    cout << "\n> Item added successfully!\n";
-	    newItem.display();
+	    ItemStatus status = core.addItem(id, name, quantity, price, category);
+	    if (status == ITEM_OK) {
+	        cout << "\n> Item added successfully!\n";
+	        core.findItem(id).display();
+	    } else {
+	        cout << "\n> Could not add the item: " << describeItem(status) << ".\n";
+	    }
 	    cout << " " << endl;
 	
-	    system("pause");
-	    system("cls");
+	    terminal().pause();
+	    terminal().clearScreen();
 	}
 };
 
 //derived class for searching ID for managing items
 class AbstractSearchByID {
 protected:
-    vector<Item>& inventory;
+    InventoryStore& inventory;
 
 public:
-    AbstractSearchByID(vector<Item>& inv) : inventory(inv) {}
+    AbstractSearchByID(InventoryStore& inv) : inventory(inv) {}
     
     virtual void searchById(const string& id) = 0; 
 };
@@ -321,21 +229,22 @@ public:
 //class for updating item derived from search by ID
 class UpdateItem : public AbstractSearchByID {
 private:
+    InventoryCore core;
     AbstractValidation& validation;  // Validation object
     InputHandler inputHandler;
-    Item* foundItem;  // Pointer to store the found item
+    ItemRef foundItem;  // Handle to the found item; tests false once that item is removed
 
 public:
-    UpdateItem(vector<Item>& inv, AbstractValidation& val)
-        : AbstractSearchByID(inv), validation(val), foundItem(nullptr) {}
+    UpdateItem(InventoryStore& inv, AbstractValidation& val)
+        : AbstractSearchByID(inv), core(inv), validation(val) {}
 
     // Function to search for the item by ID and store it internally
     void searchById(const string& id) override {
         // Check if the inventory is empty
         if (inventory.empty()) {
             cout << "> No items to update in inventory! Please add some items first.\n";
-            system("pause");
-            system("cls");
+            terminal().pause();
+            terminal().clearScreen();
             return;
         }
 
@@ -345,17 +254,14 @@ public:
             return;
         }
 
-        // Search for the item in the inventory by ID
-        for (auto& item : inventory) {
-            if (item.getId() == id) {
-                cout << "\n> Item found, updating the following item...\n\n";
-                item.display();  // Display item details
-                foundItem = &item;  // Store the reference to the found item
-                return;  // Exit after finding the item
-            }
+        // Look up the item through the ID index
+        foundItem = inventory.find(id);  // empty if not found
+        if (foundItem) {
+            cout << "\n> Item found, updating the following item...\n\n";
+            foundItem.display();  // Display item details
+            return;
         }
         cout << "> Item with ID " << id << " not found.\n";
-        foundItem = nullptr;  // Set to nullptr if not found
     }
 
     // Header for update item display
@@ -374,8 +280,8 @@ public:
 	    if (inventory.empty()) {
 	        updateItemHeader();
 	        cout << "> No items to update in inventory! Please add some items first.\n";
-	        system("pause");
-	        system("cls");
+	        terminal().pause();
+	        terminal().clearScreen();
 	        return;
 	    }
 	
@@ -386,7 +292,7 @@ public:
 	
 	        // Loop for ID input and validation
 	        while (true) {
-	            system("cls");
+	            terminal().clearScreen();
 	            updateItemHeader();
 	            cout << "> Enter ID to update\n" << endl;
 	            cout << "> Input 'C' to cancel anytime." << endl;
@@ -399,7 +305,7 @@ public:
 	            }
 	
 	            // Convert ID to uppercase before searching
-	            id = inputHandler.toUpperCase(id);
+	            toUpperInPlace(id);
 	
 	            // Call the search function with the converted uppercase ID
 	            searchById(id);  // Search for the item
@@ -409,7 +315,7 @@ public:
 	                // Item found, break out of the ID input loop to proceed with update
 	                break;
 	            } else {                
-	                system("pause");
+	                terminal().pause();
 	            }
 	        }
 	
@@ -420,10 +326,11 @@ public:
 	        while (true) {
 	            string input;
 	            int newQuantity;
-	            double newPrice;
+	            Money newPrice;
 	
 	            cout << "\n1 - Update Quantity\n";
 	            cout << "2 - Update Price\n";
+	            cout << "3 - Add or Remove Stock (+/-)\n";
 	            cout << "> Input 'C' to cancel anytime.\n";
 	
 	            // Get the user's choice with cancellation option
@@ -440,9 +347,11 @@ public:
 	                    break;  // Exit the loop if cancelled
 	                }
 	
-	                if (validation.validateQuantity(newQuantity)) {
-	                    foundItem->setQuantity(newQuantity);
+	                ItemStatus status = core.setQuantity(foundItem.getId(), newQuantity);
+	                if (status == ITEM_OK) {
 	                    cout << "\n> Quantity updated successfully.\n";
+	                } else if (status == ITEM_NOT_FOUND) {
+	                    cout << "> Item no longer exists.\n";
 	                } else {
 	                    cout << "> Quantity update failed due to invalid input.\n";
 	                }
@@ -452,31 +361,58 @@ public:
 	                cout << "\n> Enter new price." << endl;
 	                if (!inputHandler.getInput("\n[Price]: ", newPrice)) {
 	                    cancelled = true;  // Set cancelled flag if user cancels
-	                    system("cls");      // Clear the screen
+	                    terminal().clearScreen();      // Clear the screen
 	                    break;              // Exit the loop if cancelled
 	                }
 	
-	                if (validation.validatePrice(newPrice)) {
-	                    foundItem->setPrice(newPrice);
+	                ItemStatus status = core.setPrice(foundItem.getId(), newPrice);
+	                if (status == ITEM_OK) {
 	                    cout << "\n> Price updated successfully.\n";
+	                } else if (status == ITEM_NOT_FOUND) {
+	                    cout << "> Item no longer exists.\n";
 	                } else {
 	                    cout << "> Price update failed due to invalid input.\n";
 	                }
 	                break;  // Exit the loop after a successful update
+	            } else if (input == "3") {
+	                // Relative change, e.g. +10 for a delivery or -2 for a sale
+	                string change;
+	                cout << "\n> Enter the change in stock, e.g. +10 or -2." << endl;
+	                if (!inputHandler.getInput("\n[Change]: ", change)) {
+	                    cancelled = true;  // Set cancelled flag if user cancels
+	                    break;  // Exit the loop if cancelled
+	                }
+
+	                int delta;
+	                if (parseSignedCount(change, delta) != NUMBER_OK) {
+	                    cout << "> Stock change failed due to invalid input.\n";
+	                    break;
+	                }
+	                ItemStatus status = core.adjustQuantity(foundItem.getId(), delta);
+	                if (status == ITEM_OK) {
+	                    cout << "\n> Stock updated successfully.\n";
+	                } else if (status == ITEM_INSUFFICIENT_STOCK) {
+	                    cout << "> Not enough stock to remove " << -delta << ".\n";
+	                } else if (status == ITEM_QUANTITY_OUT_OF_RANGE) {
+	                    cout << "> Stock change failed, the quantity would be out of range.\n";
+	                } else {
+	                    cout << "> Item no longer exists.\n";
+	                }
+	                break;  // Exit the loop after the adjustment
 	            } else {
-	                cout << "> Invalid choice. Please select 1 or 2.\n";  // Stay in the loop for invalid input
+	                cout << "> Invalid choice. Please select 1, 2 or 3.\n";  // Stay in the loop for invalid input
 	            }
 	        }
 	
 	        // Only display the updated item if the operation was not cancelled
 	        if (!cancelled) {
-	            foundItem->display();  // Display updated item only once after the changes
+	            foundItem.display();  // Display updated item only once after the changes
 	        }
 	
 	        // Ask user if they want to try updating another item
 	        while (true) {
 	            if (!inputHandler.getInput("\n> Update another item? [Y/N]: ", tryAgain)) return;
-	            tryAgain = inputHandler.toUpperCase(tryAgain);
+	            toUpperInPlace(tryAgain);
 	            if (tryAgain == "Y" || tryAgain == "N") break;
 	            cout << "> Invalid input. Please enter 'Y' or 'N'.\n";
 	        }
@@ -484,56 +420,60 @@ public:
 	    } while (tryAgain == "Y");
 	
 	    cout << "> Exiting update item process.\n";
-	    system("pause");
-	    system("cls");
+	    terminal().pause();
+	    terminal().clearScreen();
 	}
 };
 
 // Class used to handle removing items from the inventory
 class RemoveItem : public AbstractSearchByID {
 private:
+    InventoryCore core;
     InputHandler inputHandler;
 
 public:
     // Constructor for RemoveItem, passing inventory to the base class constructor
-    RemoveItem(vector<Item>& inv) : AbstractSearchByID(inv) {}
+    RemoveItem(InventoryStore& inv) : AbstractSearchByID(inv), core(inv) {}
 
     void searchById(const string& id) override {
-        // Convert the input ID to lowercase for a case-insensitive search
-        string lowerId = inputHandler.toLowerCase(id);
         char confirm;  // Variable to hold the user's confirmation input
 
-        for (size_t i = 0; i < inventory.size(); ++i) {
-            if (inputHandler.toLowerCase(inventory[i].getId()) == lowerId) {
-                cout << "\n> Item found:\n";
-                inventory[i].display();  // Display the found item
-
-                // Ask for confirmation before removing the item
-                while (true) {
-                    cout << "\n> Confirm to delete item?" << endl;
-                    cout << "[Y/N]: ";
-                    cin >> confirm;
-                    confirm = tolower(confirm);  // Convert to lowercase for easy comparison
-
-                    if (confirm == 'y') {
-                        // User confirmed, remove the item
-                        cout << "\n> Removing item...\n";
-                        inventory.erase(inventory.begin() + i);
-                        cout << "\n> Item removed successfully.\n";
-                        return;  // Exit after removing the item
-                    } else if (confirm == 'n') {
-                        // User cancelled, do not remove the item, return to the menu
-                        cout << "\n> Item removal cancelled.\n";
-                        return;
-                    } else {
-                        // Invalid input, prompt again
-                        cout << "\n> Invalid input, please enter 'Y' or 'N'.\n";
-                    }
+        // The ID index is case-insensitive, so no lowercased copies are needed
+        ItemRef item = inventory.find(id);
+        if (!item) {
+            // If no item is found, display a message
+            cout << "> Item with ID " << id << " not found.\n";
+            return;
+        }
+
+        cout << "\n> Item found:\n";
+        item.display();  // Display the found item
+
+        // Ask for confirmation before removing the item
+        while (true) {
+            cout << "\n> Confirm to delete item?" << endl;
+            cout << "[Y/N]: ";
+            cin >> confirm;
+            confirm = tolower(confirm);  // Convert to lowercase for easy comparison
+
+            if (confirm == 'y') {
+                // User confirmed, remove the item
+                cout << "\n> Removing item...\n";
+                if (core.removeItem(id) == ITEM_OK) {
+                    cout << "\n> Item removed successfully.\n";
+                } else {
+                    cout << "\n> Item no longer exists.\n";
                 }
+                return;  // Exit after removing the item
+            } else if (confirm == 'n') {
+                // User cancelled, do not remove the item, return to the menu
+                cout << "\n> Item removal cancelled.\n";
+                return;
+            } else {
+                // Invalid input, prompt again
+                cout << "\n> Invalid input, please enter 'Y' or 'N'.\n";
             }
         }
-        // If no item is found, display a message
-        cout << "> Item with ID " << id << " not found.\n";
     }
 
 	void removeItemHeader(){
@@ -549,13 +489,13 @@ public:
 	    if (inventory.empty()) {
 	    	removeItemHeader();
 	        cout << "> No items to remove in inventory! Please add some items first.\n";
-	        system("pause");
-	        system("cls");
+	        terminal().pause();
+	        terminal().clearScreen();
 	        return;
 	    }
 	
 	    do {
-	    	system("cls");
+	    	terminal().clearScreen();
 	    	removeItemHeader();
 	        cout << "> Enter ID to remove: ";
 	        getline(cin, id);
@@ -584,7 +524,7 @@ public:
 	
 	    } while (retry == 'y');  // Continue if user chooses to try again ('Y')
 	
-	    system("cls");  // Clear screen before returning to the main menu
+	    terminal().clearScreen();  // Clear screen before returning to the main menu
 	}
 };
 
@@ -592,21 +532,37 @@ public:
 class SearchItem : public AbstractSearchByID {
 private:
     InputHandler inputHandler;
+    static constexpr size_t MAX_RESULTS = 20;  // Text searches list at most this many items
 
 public:
-    SearchItem(vector<Item>& inv) : AbstractSearchByID(inv) {}
+    SearchItem(InventoryStore& inv) : AbstractSearchByID(inv) {}
 
     void searchById(const string& id) override {
-        for (const auto& item : inventory) {
-            if (item.getId() == id) {
-                cout << "> Item found!\n" << endl;
-                item.display();
-                return;  // Exit after displaying the item
-            }
+        ItemRef item = inventory.find(id);
+        if (item) {
+            cout << "> Item found!\n" << endl;
+            item.display();
+            return;  // Exit after displaying the item
         }
         cout << "> Item with ID " << id << " not found.\n";
     }
 
+    // Lists the best matches of a text search over IDs and names, one line per item
+    void searchByText(const string& text, InventoryStore::TextMatch match) {
+        vector<uint32_t> rows = inventory.searchText(text, match, MAX_RESULTS);
+        if (rows.empty()) {
+            cout << "> No items match \"" << text << "\".\n";
+            return;
+        }
+        cout << "> " << rows.size() << (rows.size() == MAX_RESULTS ? " best" : "") << " match(es), best first:\n\n";
+        for (uint32_t row : rows) {
+            ItemRef item = inventory.at(row);
+            cout << left << setw(12) << item.getId() << setw(26) << item.getName() << setw(15) << item.getCategory()
+                 << right << setw(6) << item.getQuantity() << setw(12) << item.getPrice() << "\n";
+        }
+        cout << left;
+    }
+
 	void searchItemHeader(){
         cout << "===========================================\n";
         cout << "\t\tSEARCH ITEM\n";
@@ -620,23 +576,39 @@ public:
         if (inventory.empty()) {
         	searchItemHeader();
             cout << "> No items to search in inventory! Please add some items first.\n";
-            system("pause");
-            system("cls");
+            terminal().pause();
+            terminal().clearScreen();
             return;
         }
 
         // Loop for searching items
         do {
-        	system("cls");
+        	terminal().clearScreen();
         	searchItemHeader();
-        	
-            cout << "> Enter ID to search: ";
-            cin >> id;
-
-            // Convert ID to uppercase before searching
-            id = inputHandler.toUpperCase(id);
 
-            searchById(id);
+            string mode;
+            cout << "> Search by:\n1 - ID\n2 - Name or ID containing text\n3 - Name or ID starting with text\n"
+                    "4 - Closest names or IDs (typos allowed)\n\n[CHOICE]: ";
+            cin >> mode;
+            cin.ignore(numeric_limits<streamsize>::max(), '\n');
+
+            if (mode == "2" || mode == "3" || mode == "4") {
+                string text;
+                cout << "> Enter text to search: ";
+                getline(cin, text);
+                searchByText(text, mode == "2" ? InventoryStore::SUBSTRING_MATCH
+                                 : mode == "3" ? InventoryStore::PREFIX_MATCH : InventoryStore::FUZZY_MATCH);
+            } else if (mode == "1") {
+                cout << "> Enter ID to search: ";
+                cin >> id;
+
+                // Convert ID to uppercase before searching
+                toUpperInPlace(id);
+
+                searchById(id);
+            } else {
+                cout << "> Invalid choice! Please enter a number between 1 and 4.\n";
+            }
 
             // Ask user if they want to search another item
             while (true) {
@@ -653,44 +625,140 @@ public:
 
         } while (retry == 'y');  // Continue if user chooses to search again ('Y')
 
-        system("cls");  // Clear the screen before returning to the main menu
+        terminal().clearScreen();  // Clear the screen before returning to the main menu
+    }
+};
+
+// class used to format inventory tables into one reusable buffer that is written out in large chunks
+class TableRenderer {
+private:
+    static constexpr size_t LINE_WIDTH = 65;      // Width of the separator lines
+    static constexpr size_t FLUSH_THRESHOLD = 64 * 1024;
+
+    string buffer;
+    size_t pageSize;     // Rows per page, 0 to print everything at once
+    size_t rowsOnPage;
+    size_t pageNumber;
+    bool stopped;        // The user chose to stop paging
+
+    void pad(size_t count) { buffer.append(count, ' '); }
+
+    // Same layout as setw: text longer than the column is never truncated
+    void appendLeft(string_view text, size_t width) {
+        buffer.append(text);
+        if (text.size() < width) pad(width - text.size());
+    }
+
+    void appendRight(const char* text, size_t length, size_t width) {
+        if (length < width) pad(width - length);
+        buffer.append(text, length);
+    }
+
+    void appendQuantity(int quantity, size_t width) {
+        char digits[24];
+        char* end = digits + sizeof(digits);
+        char* start = formatInteger(quantity, end);
+        appendRight(start, static_cast<size_t>(end - start), width);
+    }
+
+    void appendPrice(Money price, size_t width) {
+        char digits[32];
+        char* end = digits + sizeof(digits);
+        char* start = price.format(end);
+        appendRight(start, static_cast<size_t>(end - start), width);
+    }
+
+public:
+    TableRenderer(size_t rowsPerPage = 0)
+        : pageSize(rowsPerPage), rowsOnPage(0), pageNumber(1), stopped(false) {
+        buffer.reserve(FLUSH_THRESHOLD + 256);
+    }
+
+    // Turns pagination on (rows per page) or off (0) and starts a fresh table
+    void setPageSize(size_t rowsPerPage) {
+        pageSize = rowsPerPage;
+        rowsOnPage = 0;
+        pageNumber = 1;
+        stopped = false;
+    }
+
+    // Separator lines with the title centered between them
+    void title(const string& text) {
+        buffer.append(LINE_WIDTH, '=').append("\n");
+        size_t centered = (LINE_WIDTH + text.size()) / 2;
+        if (centered > text.size()) pad(centered - text.size());
+        buffer.append(text).append("\n");
+        buffer.append(LINE_WIDTH, '=').append("\n");
+    }
+
+    void columnHeader() {
+        appendLeft("CATEGORY", 15);
+        appendLeft("ID", 10);
+        appendLeft("NAME", 20);
+        appendRight("QUANTITY", 8, 10);
+        appendRight("PRICE\n", 6, 10);
+        buffer.append(LINE_WIDTH, '-').append("\n");
+    }
+
+    // Adds one item row; returns false once the user has stopped paging so callers can end their loop
+    bool row(const ItemRef& item) {
+        if (stopped) return false;
+        if (pageSize > 0 && rowsOnPage == pageSize) {
+            flush();
+            cout << "-- Page " << pageNumber << ": press any key for more, Q to stop --" << std::flush;
+            char key = terminal().waitForKey();
+            cout << "\r" << string(LINE_WIDTH, ' ') << "\r" << std::flush;
+            if (key == 'q' || key == 'Q') {
+                stopped = true;
+                return false;
+            }
+            rowsOnPage = 0;
+            ++pageNumber;
+        }
+
+        appendLeft(item.getCategory(), 15);
+        appendLeft(item.getId(), 10);
+        appendLeft(item.getName(), 20);
+        appendQuantity(item.getQuantity(), 10);
+        appendPrice(item.getPrice(), 10);
+        buffer.push_back('\n');
+        ++rowsOnPage;
+
+        if (buffer.size() >= FLUSH_THRESHOLD) flush();
+        return true;
+    }
+
+    void text(const string& str) { buffer.append(str); }
+
+    // Writes the buffered chunk with one call; stdout is shared with cout, so output stays in order
+    void flush() {
+        if (buffer.empty()) return;
+        cout.flush();
+        fwrite(buffer.data(), 1, buffer.size(), stdout);
+        fflush(stdout);
+        buffer.clear();
     }
 };
 
 //Abstract class used to display the whole inventory
 class DisplayAllItems {
+
 protected:
-    vector<Item>& inventory;  // Reference to the inventory
+    InventoryStore& inventory;  // Reference to the inventory
+    mutable TableRenderer table;  // Shared by every table this view prints, so the row buffer is reused
 
     virtual void displayTableHeader() const {
-        int lineWidth = 65;  // Width of the separator line (the length of "===========================================")
-        string title = "INVENTORY";
-
-        cout << string(lineWidth, '=') << "\n";  // Print top separator line
-        cout << setw((lineWidth + title.length()) / 2) << title << "\n";  // Center the title
-        cout << string(lineWidth, '=') << "\n";  // Print bottom separator line
-
-        // Set column headers with specific widths for clean alignment
-        cout << left << setw(15) << "CATEGORY"
-             << left << setw(10) << "ID"
-             << left << setw(20) << "NAME"
-             << right << setw(10) << "QUANTITY"
-             << right << setw(10) << "PRICE\n";
-        cout << "-----------------------------------------------------------------\n";
+        table.title("INVENTORY");
+        table.columnHeader();
     }
 
-    // Helper function to display a single item in the table
-    void displayItem(const Item& item) const {
-        // Display each item with proper alignment
-        cout << left << setw(15) << item.getCategory()
-             << left << setw(10) << item.getId()
-             << left << setw(20) << item.getName()
-             << right << setw(10) << item.getQuantity()
-             << right << setw(10) << item.getPrice() << "\n";
+    // Helper function to display a single item in the table, false once the user stops paging
+    bool displayItem(const ItemRef& item) const {
+        return table.row(item);
     }
 
 public:
-    DisplayAllItems(vector<Item>& inv) : inventory(inv) {}
+    DisplayAllItems(InventoryStore& inv) : inventory(inv), table(terminal().pageRows()) {}
 
     // Pure virtual function to be implemented by derived classes
     virtual void displayItems() const = 0;
@@ -699,56 +767,50 @@ public:
 // class used to display the whole inventory
 class DisplayInventory : public DisplayAllItems {
 public:
-    DisplayInventory(vector<Item>& inv) : DisplayAllItems(inv) {}
+    DisplayInventory(InventoryStore& inv) : DisplayAllItems(inv) {}
 	
     void displayItems() const override {
         if (inventory.empty()) {
-			int lineWidth = 65;  // Width of the separator line (the length of "===========================================")
-		        string title = "INVENTORY";
-		
-		    cout << string(lineWidth, '=') << "\n";  // Print top separator line
-		    cout << setw((lineWidth + title.length()) / 2) << title << "\n";  // Center the title
-		    cout << string(lineWidth, '=') << "\n";  // Print bottom separator line
-            cout << "> No items to display in inventory! Please add some items first.\n";
-            system("pause");
-            system("cls");
+            table.title("INVENTORY");
+            table.text("> No items to display in inventory! Please add some items first.\n");
+            table.flush();
+            terminal().pause();
+            terminal().clearScreen();
             return;
         }
 
-        // Display header and items
+        // Display header and items from a point-in-time view, so paging never sees a half-made change
+        InventoryView view = inventory.snapshot();
         displayTableHeader();
-        for (const auto& item : inventory) {
-            displayItem(item);
+        bool complete = true;
+        for (const auto& item : view) {
+            if (!displayItem(item)) {
+                complete = false;
+                break;
+            }
         }
-        
-        system("pause");
-        system("cls");
+        if (complete) {
+            char digits[48];
+            char* end = digits + sizeof(digits);
+            char* start = formatCents(ValuationEngine().totalValue(view), end);
+            table.text("\n> Total stock value: " + string(start, end) + "\n");
+        }
+        table.flush();
+
+        terminal().pause();
+        terminal().clearScreen();
     }
 };
 
 // Class used to display the items by category
 class DisplayCategoryItems : public DisplayAllItems {
 public:
-    DisplayCategoryItems(vector<Item>& inv) : DisplayAllItems(inv) {}
+    DisplayCategoryItems(InventoryStore& inv) : DisplayAllItems(inv) {}
 
     // Override to provide a custom header for category items
     void displayTableHeader() const override {
-        int lineWidth = 65;  // Width of the separator line (the length of "===========================================")
-        string title = "ITEMS BY CATEGORY";
-
-        cout << string(lineWidth, '=') << "\n";  // Print top separator line
-        cout << setw((lineWidth + title.length()) / 2) << title << "\n";  // Center the title
-        cout << string(lineWidth, '=') << "\n";  // Print bottom separator line
-
-    }
-
-    // Convert string to lowercase (helper function)
-    string toLower(const string& str) const {
-        string lowerStr;
-        for (char c : str) {
-            lowerStr += (c >= 'A' && c <= 'Z') ? c + 32 : c;  // Convert to lowercase
-        }
-        return lowerStr;
+        table.title("ITEMS BY CATEGORY");
+        table.flush();
     }
 
     // Override displayItems to display items by category
@@ -758,8 +820,8 @@ public:
         if (inventory.empty()) {
             displayTableHeader();
             cout << "> No items to display in inventory! Please add some items first.\n";
-            system("pause");
-            system("cls");
+            terminal().pause();
+            terminal().clearScreen();
             return;  // Exit the function early if there are no items
         }
 
@@ -768,8 +830,8 @@ public:
         // Loop for displaying items by category
         do {
             int choice;
-            string selectedCategory;
-			system("cls");
+            Category selectedCategory;
+			terminal().clearScreen();
             // Display category options
         	displayTableHeader();
             cout << "> Select category:\n";
@@ -781,45 +843,39 @@ public:
 
             // Determine selected category based on user input
             switch (choice) {
-                case 1: selectedCategory = "Clothing"; break;
-                case 2: selectedCategory = "Electronics"; break;
-                case 3: selectedCategory = "Entertainment"; break;
+                case 1: selectedCategory = CLOTHING; break;
+                case 2: selectedCategory = ELECTRONICS; break;
+                case 3: selectedCategory = ENTERTAINMENT; break;
                 default:
                     cout << "> Invalid choice!\n";
-                    system("pause");
-                    system("cls");
+                    terminal().pause();
+                    terminal().clearScreen();
                     continue;  // Continue the loop if the choice is invalid
             }
 
-            string lowerSelectedCategory = toLower(selectedCategory);
-			system("cls");
-            displayTableHeader();
-            // Set column headers with specific widths for clean alignment
-       		 cout << left << setw(15) << "CATEGORY"
-             << left << setw(10) << "ID"
-             << left << setw(20) << "NAME"
-             << right << setw(10) << "QUANTITY"
-             << right << setw(10) << "PRICE\n";
-       		 cout << "-----------------------------------------------------------------\n";
+			terminal().clearScreen();
+            table.setPageSize(terminal().pageRows());
+            table.title("ITEMS BY CATEGORY");
+            table.columnHeader();
             bool found = false;
 
-            // Search and display items in the selected category
-            for (const auto& item : inventory) {
-                if (toLower(item.getCategory()) == lowerSelectedCategory) {
-                    displayItem(item);  // inherited helper function to display the item
-                    found = true;
-                }
-            }
+            // Walk the category's posting lists in a point-in-time view, touching only its items
+            InventoryView view = inventory.snapshot();
+            view.forEachInCategory(selectedCategory, [&](uint32_t row) {
+                found = true;
+                return displayItem(view.at(row));  // inherited helper function to display the item
+            });
+            table.flush();
 
             if (!found) {
-                cout << "> No items found in the " << selectedCategory << " category.\n";
+                cout << "> No items found in the " << CATEGORY_NAMES[selectedCategory] << " category.\n";
             }
 
             // Prompt the user to view another category
             while (true) {
                 cout << "\n> View another category? [Y/N]: ";
                 cin >> tryAgain;
-                tryAgain = toLower(tryAgain);  // Convert user input to lowercase for comparison
+                toLowerInPlace(tryAgain);  // Convert user input to lowercase for comparison
                 if (tryAgain == "y" || tryAgain == "n") break;
                 cout << "> Invalid input. Please enter 'Y' or 'N'.\n";
             }  
@@ -827,23 +883,19 @@ public:
         } while (tryAgain == "y");
 
         cout << "> Exiting category view.\n";
-        system("cls");
+        terminal().clearScreen();
     }
 };
 
 // class used to handle sorting and display sorted inventory
 class SortItems : public DisplayAllItems {
 public:
-    SortItems(vector<Item>& inv) : DisplayAllItems(inv) {}
+    SortItems(InventoryStore& inv) : DisplayAllItems(inv) {}
 
     // Override to provide a custom header for sorted items
     void displayTableHeader() const override {
-        int lineWidth = 65;  // Width of the separator line (the length of "===========================================")
-        string title = "SORTED ITEMS";
-
-        cout << string(lineWidth, '=') << "\n";  // Print top separator line
-        cout << setw((lineWidth + title.length()) / 2) << title << "\n";  // Center the title
-        cout << string(lineWidth, '=') << "\n";  // Print bottom separator line
+        table.title("SORTED ITEMS");
+        table.flush();
     }
 
     // Override displayItems to display sorted items based on user choice
@@ -860,16 +912,16 @@ public:
             // Check if there are 1 or fewer items in inventory
             if (inventory.size() <= 1) {
                 cout << "> Not enough items to sort! Please ensure you have more than 1 item.\n";
-                system("pause");
-                system("cls");
+                terminal().pause();
+                terminal().clearScreen();
                 return;
             }
 
             // Validate choice for sorting by price or quantity, with cancel option
             while (true) {
-                if (!inputHandler.getInput("> How would you like to sort the items?\n1 - Price\n2 - Quantity\n\n[CHOICE]: ", input)) return;
-                if (validator.isValidNumericInput(input, sortBy) && (sortBy == 1 || sortBy == 2)) break;
-                cout << "\n> Invalid choice! Please enter 1 or 2.\n";
+                if (!inputHandler.getInput("> How would you like to sort the items?\n1 - Price\n2 - Quantity\n3 - Category, then Price\n4 - Category, then Quantity\n\n[CHOICE]: ", input)) return;
+                if (validator.isValidNumericInput(input, sortBy) && sortBy >= 1 && sortBy <= 4) break;
+                cout << "\n> Invalid choice! Please enter a number between 1 and 4.\n";
             }
 
             // Validate choice for sorting order (ascending or descending), with cancel option
@@ -879,23 +931,19 @@ public:
                 cout << "\n> Invalid choice! Please enter 1 or 2.\n";
             }
 
-            // Sorting logic using Insertion Sort
-            vector<Item> sortedInventory = inventory;
-            insertionSort(sortedInventory, sortBy, sortOrder);
+            // Read the order off the price and quantity indexes, then page through a point-in-time view
+            vector<uint32_t> order = sortEngine.indexedOrder(inventory, buildSortKeys(sortBy, sortOrder == 1));
+            InventoryView view = inventory.snapshot();
 
             // Call the inherited display method to display the sorted items
-            system("cls");
-            displayTableHeader();
-	        // column headers with specific widths for clean alignment
-	        cout << left << setw(15) << "CATEGORY"
-	             << left << setw(10) << "ID"
-	             << left << setw(20) << "NAME"
-	             << right << setw(10) << "QUANTITY"
-	             << right << setw(10) << "PRICE\n";
-       		 cout << "-----------------------------------------------------------------\n";	
-            for (const auto& item : sortedInventory) {
-                displayItem(item);  // Use the inherited helper function to display the item
+            terminal().clearScreen();
+            table.setPageSize(terminal().pageRows());
+            table.title("SORTED ITEMS");
+            table.columnHeader();
+            for (uint32_t row : order) {
+                if (!displayItem(view.at(row))) break;  // Use the inherited helper function to display the item
             }
+            table.flush();
 
 			// Ask the user if they want to sort again
 			while (true) {  // Loop until valid input is given
@@ -913,55 +961,40 @@ public:
 			    }
 			}
 
-        system("cls");
+        terminal().clearScreen();
         } while (retry == 'y');  // Loop as long as the user wants to sort again
     }
 
 private:
-    // Insertion Sort algorithm for sorting the inventory based on user choices
-    void insertionSort(vector<Item>& items, int sortBy, int sortOrder) const {
-        int n = items.size();
-        for (int i = 1; i < n; i++) {
-            Item key = items[i];
-            int j = i - 1;
-
-            // Sort by price
-            if (sortBy == 1) {
-                while (j >= 0 && (sortOrder == 1 ? items[j].getPrice() > key.getPrice() : items[j].getPrice() < key.getPrice())) {
-                    items[j + 1] = items[j];
-                    j--;
-                }
-            }
-            // Sort by quantity
-            else if (sortBy == 2) {
-                while (j >= 0 && (sortOrder == 1 ? items[j].getQuantity() > key.getQuantity() : items[j].getQuantity() < key.getQuantity())) {
-                    items[j + 1] = items[j];
-                    j--;
-                }
-            }
-
-            items[j + 1] = key; // Place the key in its correct position
-        }
+    SortEngine sortEngine;
+
+    // Translates the menu choices into sort keys, category is always grouped alphabetically
+    static vector<SortEngine::SortKey> buildSortKeys(int sortBy, bool ascending) {
+        vector<SortEngine::SortKey> keys;
+        if (sortBy == 3 || sortBy == 4) keys.push_back({SortEngine::BY_CATEGORY, true});
+        keys.push_back({(sortBy == 1 || sortBy == 3) ? SortEngine::BY_PRICE : SortEngine::BY_QUANTITY, ascending});
+        return keys;
     }
 };
 
 // Class used to display items that are low in stock
 class DisplayLowStock {
 private:
-    vector<Item>& inventory; // Reference to the inventory
+    InventoryStore& inventory; // Reference to the inventory
+    TableRenderer table;
+    FilterEngine filter;
+    int threshold;  // Items with this quantity or less are low in stock
 
 public:
+    static constexpr int DEFAULT_THRESHOLD = InventoryCore::DEFAULT_LOW_STOCK;
+
     // Constructor
-    DisplayLowStock(vector<Item>& inv) : inventory(inv) {}
+    DisplayLowStock(InventoryStore& inv, int lowStockThreshold = DEFAULT_THRESHOLD)
+        : inventory(inv), table(terminal().pageRows()), threshold(lowStockThreshold) {}
 
     // Function to display the header
     void displayHeader() {
-        int lineWidth = 65;  // Width of the separator line (the length of "===========================================")
-        string title = "MONITORING LOW STOCK";
-
-        cout << string(lineWidth, '=') << "\n";  // Print top separator line
-        cout << setw((lineWidth + title.length()) / 2) << title << "\n";  // Center the title
-        cout << string(lineWidth, '=') << "\n";  // Print bottom separator line
+        table.title("MONITORING LOW STOCK");
     }
 
     // Function to display items that are low in stock
@@ -971,64 +1004,699 @@ public:
 
         // Check if the inventory is empty
         if (inventory.empty()) {
-            cout << "> No items to display in inventory! Please add some items first.\n";
-            system("pause");
-            system("cls");
+            table.text("> No items to display in inventory! Please add some items first.\n");
+            table.flush();
+            terminal().pause();
+            terminal().clearScreen();
             return;
         }
 
         bool foundLowStock = false; 
 
         // Column headers with specific widths for clean alignment
-        cout << left << setw(15) << "CATEGORY"
-             << left << setw(10) << "ID"
-             << left << setw(20) << "NAME"
-             << right << setw(10) << "QUANTITY"
-             << right << setw(10) << "PRICE\n";
-        cout << "-----------------------------------------------------------------\n";
-
-        // Iterate through the inventory to find low stock items
-        for (const auto& item : inventory) {
-            if (item.getQuantity() <= 5) {
-                // Display items that have quantity <= 5 using aligned columns
-                cout << left << setw(15) << item.getCategory()
-                     << left << setw(10) << item.getId()
-                     << left << setw(20) << item.getName()
-                     << right << setw(10) << item.getQuantity()
-                     << right << setw(10) << fixed << setprecision(2) << item.getPrice() << "\n";
-                foundLowStock = true;
-            }
-        }
+        table.text("> Items with a quantity of " + to_string(threshold) + " or less\n");
+        table.columnHeader();
+
+        // Filter the quantity column of a point-in-time view in one vectorized pass, then display the selected rows
+        InventoryView view = inventory.snapshot();
+        SelectionBitmap lowStock = filter.quantityAtMost(view, threshold);
+        lowStock.forEach([&](size_t row) {
+            foundLowStock = true;
+            return table.row(view.at(row));
+        });
+        table.flush();
 
         // If no low-stock items were found, display a message
         if (!foundLowStock) {
             cout << "\n> No items are currently low in stock.\n";
         }
 
-        system("pause");
-        system("cls");
+        terminal().pause();
+        terminal().clearScreen();
+    }
+};
+
+// Class used to show the stock valuation and category report
+class DisplayReport {
+private:
+    InventoryStore& inventory;
+
+public:
+    DisplayReport(InventoryStore& inv) : inventory(inv) {}
+
+    void displayReport() {
+        cout << "===========================================\n";
+        cout << "\t\tINVENTORY REPORT\n";
+        cout << "===========================================\n";
+
+        if (inventory.empty()) {
+            cout << "> No items to display in inventory! Please add some items first.\n";
+        } else {
+            // Aggregated over a point-in-time view, so the numbers all describe the same moment
+            InventoryView view = inventory.snapshot();
+            ReportEngine::Report report = ReportEngine().build(view);
+            ReportEngine::write(cout, report, false);
+            cout << "\n> Computed over " << report.overall.items << " items in " << fixed << setprecision(3)
+                 << report.milliseconds << " ms (" << report.threads << (report.threads == 1 ? " thread" : " threads") << ").\n";
+        }
+
+        terminal().pause();
+        terminal().clearScreen();
+    }
+};
+
+// Class used to show how often each operation ran and how long it took
+class DisplayStatistics {
+private:
+    InputHandler inputHandler;
+
+public:
+    // Writes the statistics tab-separated, for comparing runs or loading into a spreadsheet
+    static bool saveStatistics(const string& path, ostream& log) {
+        ofstream file(path);
+#ifdef INVENTORY_STATS
+        if (file) operationStats.report(file, true);
+#else
+        log << "> Statistics are not compiled into this build, " << path << " will list no operations\n";
+        if (file) OperationStats::reportHeader(file, true);
+#endif
+        if (!file) {
+            log << "> Cannot write statistics to " << path << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    void displayStatistics() {
+        cout << "===========================================\n";
+        cout << "\t\tSTATISTICS\n";
+        cout << "===========================================\n";
+
+#ifdef INVENTORY_STATS
+        operationStats.report(cout, false);
+
+        string input;
+        cout << "\n> Enter a file name to save the statistics, 'R' to reset them or 'C' to go back.\n";
+        if (!inputHandler.getInput("[File]: ", input)) return;
+        if (equalsIgnoreCase(input, "R")) {
+            operationStats.reset();
+            cout << "\n> Statistics reset.\n";
+        } else if (!input.empty() && saveStatistics(input, cout)) {
+            cout << "\n> Statistics saved to " << input << ".\n";
+        }
+#else
+        cout << "> Statistics are not compiled into this build (configure with -DINVENTORY_STATS=ON).\n";
+#endif
+
+        terminal().pause();
+        terminal().clearScreen();
     }
 };
 
+// class used to run scripted operations without any prompts, screen clearing or pauses
+//
+// One command per line, fields separated by whitespace, blank lines and '#' comments ignored:
+//   ADD <category> <id> <price> <quantity> <name...>
+//   UPDATE <id> QUANTITY|PRICE <value>
+//   REMOVE <id>
+//   SEARCH <id>
+//   ADJUST [FLOOR|REJECT|ALLOW] <id> <+/-n> [<id> <+/-n> ...]
+//   SORT PRICE|QUANTITY|CATEGORY-PRICE|CATEGORY-QUANTITY [ASC|DESC]
+//   TOP PRICE|QUANTITY <count> [HIGH|LOW]
+//   FIND CONTAINS|PREFIX|FUZZY <text...>   (IDs and names, best match first)
+//   IMPORT <csv or tsv file>   (rejected rows are reported with their line numbers)
+//   EXPORT CSV|JSONL|BINARY <file> [QUANTITY <max>] [PRICE <min> <max>] [CATEGORY <name>] [SORT <key> [ASC|DESC]]
+//   RANGE PRICE <min> <max> | RANGE QUANTITY <min> <max>
+//   LOWSTOCK [max quantity]
+//   FILTER [QUANTITY <max>] [PRICE <min> <max>] [CATEGORY <name>]   (all given predicates must hold)
+//   REPORT [<file>]   (stock value and prices per category plus the quantity histogram)
+// Results are written as tab-separated rows (category, id, name, quantity, price); REPORT writes
+// its own tab-separated tables, with a header line each.
+class BatchProcessor {
+private:
+    // class used to split one command line into whitespace-separated fields, handed out as
+    // views into the line so reading a command copies nothing
+    class FieldReader {
+    private:
+        static constexpr const char* SPACES = " \t\r\n\v\f";
+        string_view rest;
+
+    public:
+        explicit FieldReader(string_view line) : rest(line) {}
+
+        // Returns false, leaving field alone, once the line is used up
+        bool next(string_view& field) {
+            size_t start = rest.find_first_not_of(SPACES);
+            if (start == string_view::npos) {
+                rest = string_view();
+                return false;
+            }
+            rest.remove_prefix(start);
+            field = rest.substr(0, rest.find_first_of(SPACES));
+            rest.remove_prefix(field.size());
+            return true;
+        }
+
+        // Everything left after the leading whitespace, e.g. an item name with spaces in it
+        string_view remainder() {
+            size_t start = rest.find_first_not_of(SPACES);
+            string_view text = (start == string_view::npos) ? string_view() : rest.substr(start);
+            rest = string_view();
+            return text;
+        }
+    };
+
+    InventoryStore& inventory;
+    InventoryCore core;
+    ItemValidation& validation;
+    SortEngine sortEngine;
+    FilterEngine filter;
+    int lowStockThreshold;
+
+    // Kept between ADJUST commands so their capacity is reused instead of reallocated
+    vector<string_view> operands;
+    vector<InventoryStore::QuantityDelta> deltas;
+    vector<InventoryStore::AdjustResult> results;
+
+    size_t lineNumber;
+    size_t commandCount;
+    size_t failureCount;
+
+    bool fail(ostream& log, const string& message) {
+        log << "line " << lineNumber << ": " << message << "\n";
+        ++failureCount;
+        return false;
+    }
+
+    static void writeRow(ostream& out, const ItemRef& item) {
+        out << item.getCategory() << '\t' << item.getId() << '\t' << item.getName() << '\t'
+            << item.getQuantity() << '\t' << item.getPrice() << '\n';
+    }
+
+    // Keywords are echoed in uppercase in messages; only failures pay for the copy
+    static string upperCopy(string_view text) {
+        string upper(text);
+        toUpperInPlace(upper);
+        return upper;
+    }
+
+    // Failure for a field the numeric parsers turned down, with their reason
+    bool failField(ostream& log, const char* what, string_view field, NumberStatus status) {
+        return fail(log, string("invalid ") + what + " '" + string(field) + "' (" + describeNumber(status) + ")");
+    }
+
+    bool runAdd(FieldReader& fields, ostream& log) {
+        string_view category, id, priceField, quantityField;
+        int quantity;
+        Money price;
+        if (!(fields.next(category) && fields.next(id) && fields.next(priceField) && fields.next(quantityField))) {
+            return fail(log, "ADD needs <category> <id> <price> <quantity> <name>");
+        }
+        string_view name = fields.remainder();
+
+        Category parsed;
+        if (!parseCategory(category, parsed)) return fail(log, "invalid category '" + string(category) + "'");
+        if (!validation.validateId(id)) return fail(log, "invalid ID '" + upperCopy(id) + "'");
+        NumberStatus status = parsePrice(priceField, price);
+        if (status != NUMBER_OK) return failField(log, "price", priceField, status);
+        status = parseQuantity(quantityField, quantity);
+        if (status != NUMBER_OK) return failField(log, "quantity", quantityField, status);
+
+        ItemStatus added = core.addItem(id, name, quantity, price, CATEGORY_NAMES[parsed]);
+        if (added == ITEM_DUPLICATE_ID) return fail(log, "an item with ID '" + upperCopy(id) + "' already exists");
+        if (added != ITEM_OK) return fail(log, describeItem(added));
+        return true;
+    }
+
+    bool runUpdate(FieldReader& fields, ostream& log) {
+        string_view id, field, value;
+        if (!(fields.next(id) && fields.next(field) && fields.next(value))) return fail(log, "UPDATE needs <id> QUANTITY|PRICE <value>");
+
+        if (equalsIgnoreCase(field, "QUANTITY")) {
+            int quantity;
+            NumberStatus status = parseQuantity(value, quantity);
+            if (status != NUMBER_OK) return failField(log, "quantity", value, status);
+            if (core.setQuantity(id, quantity) != ITEM_OK) return fail(log, "item with ID '" + string(id) + "' not found");
+        } else if (equalsIgnoreCase(field, "PRICE")) {
+            Money price;
+            NumberStatus status = parsePrice(value, price);
+            if (status != NUMBER_OK) return failField(log, "price", value, status);
+            if (core.setPrice(id, price) != ITEM_OK) return fail(log, "item with ID '" + string(id) + "' not found");
+        } else {
+            return fail(log, "UPDATE field must be QUANTITY or PRICE");
+        }
+        return true;
+    }
+
+    // ADJUST [FLOOR|REJECT|ALLOW] <id> <+/-n> [<id> <+/-n> ...], applied as one batch of deltas;
+    // REJECT (the default) refuses to take out more than is in stock, FLOOR stops at zero
+    bool runAdjust(FieldReader& fields, ostream& log) {
+        InventoryStore::AdjustMode mode = InventoryStore::REJECT_IF_INSUFFICIENT;
+        operands.clear();
+        string_view field;
+        while (fields.next(field)) operands.push_back(field);
+
+        size_t first = 0;
+        if (!operands.empty()) {
+            if (equalsIgnoreCase(operands[0], "FLOOR")) mode = InventoryStore::FLOOR_AT_ZERO;
+            else if (equalsIgnoreCase(operands[0], "ALLOW")) mode = InventoryStore::ALLOW_NEGATIVE;
+            if (mode != InventoryStore::REJECT_IF_INSUFFICIENT || equalsIgnoreCase(operands[0], "REJECT")) first = 1;
+        }
+        if (operands.size() == first || (operands.size() - first) % 2 != 0) {
+            return fail(log, "ADJUST needs <id> <+/-n> pairs");
+        }
+
+        deltas.clear();
+        for (size_t i = first; i < operands.size(); i += 2) {
+            int delta;
+            NumberStatus status = parseSignedCount(operands[i + 1], delta);
+            if (status != NUMBER_OK) return failField(log, "quantity change", operands[i + 1], status);
+            deltas.push_back({operands[i], delta});
+        }
+
+        // The other deltas still apply; the command fails once, naming every item that didn't
+        if (inventory.adjustQuantities(deltas, mode, &results) == deltas.size()) return true;
+        string message;
+        for (size_t i = 0; i < deltas.size(); ++i) {
+            if (results[i] == InventoryStore::ADJUSTED) continue;
+            if (!message.empty()) message += "; ";
+            string id(deltas[i].id);
+            if (results[i] == InventoryStore::NOT_FOUND) message += "item with ID '" + id + "' not found";
+            else if (results[i] == InventoryStore::OUT_OF_RANGE) message += "quantity of '" + id + "' would be out of range";
+            else message += "not enough stock of '" + id + "'";
+        }
+        return fail(log, message);
+    }
+
+    // Reads the key and optional order of SORT (also used by EXPORT)
+    bool parseSortKeys(FieldReader& fields, vector<SortEngine::SortKey>& keys, ostream& log) {
+        string_view by, order = "ASC";
+        if (!fields.next(by)) return fail(log, "SORT needs PRICE|QUANTITY|CATEGORY-PRICE|CATEGORY-QUANTITY");
+        fields.next(order);
+        bool ascending = equalsIgnoreCase(order, "ASC");
+        if (!ascending && !equalsIgnoreCase(order, "DESC")) return fail(log, "SORT order must be ASC or DESC");
+
+        if (equalsIgnoreCase(by, "CATEGORY-PRICE") || equalsIgnoreCase(by, "CATEGORY-QUANTITY")) {
+            keys.push_back({SortEngine::BY_CATEGORY, true});
+            by.remove_prefix(strlen("CATEGORY-"));
+        }
+        if (equalsIgnoreCase(by, "PRICE")) {
+            keys.push_back({SortEngine::BY_PRICE, ascending});
+        } else if (equalsIgnoreCase(by, "QUANTITY")) {
+            keys.push_back({SortEngine::BY_QUANTITY, ascending});
+        } else {
+            return fail(log, "unknown sort key '" + upperCopy(by) + "'");
+        }
+        return true;
+    }
+
+    bool runSort(FieldReader& fields, ostream& out, ostream& log) {
+        vector<SortEngine::SortKey> keys;
+        if (!parseSortKeys(fields, keys, log)) return false;
+
+        for (uint32_t row : sortEngine.indexedOrder(inventory, keys)) {
+            writeRow(out, inventory.at(row));
+        }
+        return true;
+    }
+
+    // Reads PRICE or QUANTITY, the field TOP and RANGE walk
+    static bool parseOrderedField(FieldReader& fields, InventoryStore::OrderedField& field) {
+        string_view name;
+        if (!fields.next(name)) return false;
+        if (equalsIgnoreCase(name, "PRICE")) field = InventoryStore::PRICE_ORDER;
+        else if (equalsIgnoreCase(name, "QUANTITY")) field = InventoryStore::QUANTITY_ORDER;
+        else return false;
+        return true;
+    }
+
+    bool runTop(FieldReader& fields, ostream& out, ostream& log) {
+        InventoryStore::OrderedField field;
+        string_view value, end = "HIGH";
+        int count;
+        if (!parseOrderedField(fields, field) || !fields.next(value) || !parseLimit(value, count)) {
+            return fail(log, "TOP needs PRICE|QUANTITY <count>");
+        }
+        fields.next(end);
+        bool high = equalsIgnoreCase(end, "HIGH");
+        if (!high && !equalsIgnoreCase(end, "LOW")) return fail(log, "TOP end must be HIGH or LOW");
+
+        for (uint32_t row : inventory.topRows(field, static_cast<size_t>(count), high)) {
+            writeRow(out, inventory.at(row));
+        }
+        return true;
+    }
+
+    bool runFind(FieldReader& fields, ostream& out, ostream& log) {
+        string_view mode;
+        fields.next(mode);
+        string_view text = fields.remainder();
+        if (text.empty()) return fail(log, "FIND needs CONTAINS|PREFIX|FUZZY <text>");
+
+        InventoryStore::TextMatch match;
+        if (equalsIgnoreCase(mode, "CONTAINS")) match = InventoryStore::SUBSTRING_MATCH;
+        else if (equalsIgnoreCase(mode, "PREFIX")) match = InventoryStore::PREFIX_MATCH;
+        else if (equalsIgnoreCase(mode, "FUZZY")) match = InventoryStore::FUZZY_MATCH;
+        else return fail(log, "unknown FIND mode '" + upperCopy(mode) + "'");
+
+        for (uint32_t row : inventory.searchText(text, match)) {
+            writeRow(out, inventory.at(row));
+        }
+        return true;
+    }
+
+    bool runRange(FieldReader& fields, ostream& out, ostream& log) {
+        InventoryStore::OrderedField field;
+        string_view lowField, highField;
+        if (!parseOrderedField(fields, field) || !fields.next(lowField) || !fields.next(highField)) {
+            return fail(log, "RANGE needs PRICE|QUANTITY <min> <max>");
+        }
+
+        vector<uint32_t> rows;
+        if (field == InventoryStore::PRICE_ORDER) {
+            Money low, high;
+            if (!parseBound(lowField, low) || !parseBound(highField, high)) return fail(log, "RANGE PRICE needs <min> <max>");
+            rows = inventory.rowsWithPriceBetween(low, high);
+        } else {
+            int low, high;
+            if (!parseLimit(lowField, low) || !parseLimit(highField, high)) return fail(log, "RANGE QUANTITY needs <min> <max>");
+            rows = inventory.rowsWithQuantityBetween(low, high);
+        }
+        for (uint32_t row : rows) {
+            writeRow(out, inventory.at(row));
+        }
+        return true;
+    }
+
+    // Numeric operands of TOP, RANGE, LOWSTOCK and FILTER; unlike item fields zero is allowed
+    static bool parseLimit(string_view field, int& limit) {
+        return parseCount(field, limit) == NUMBER_OK;
+    }
+
+    static bool parseBound(string_view field, Money& bound) {
+        return parseMoney(field, bound) == NUMBER_OK;
+    }
+
+    void writeSelection(ostream& out, const SelectionBitmap& selection) const {
+        selection.forEach([&](size_t row) {
+            writeRow(out, inventory.at(row));
+            return true;
+        });
+    }
+
+    // Evaluates one FILTER predicate (QUANTITY <max>, PRICE <min> <max> or CATEGORY <name>)
+    bool evaluatePredicate(string_view predicate, FieldReader& fields, SelectionBitmap& matches, ostream& log) {
+        if (equalsIgnoreCase(predicate, "QUANTITY")) {
+            string_view value;
+            int maximum;
+            if (!fields.next(value) || !parseLimit(value, maximum)) return fail(log, "QUANTITY needs a maximum quantity");
+            matches = filter.quantityAtMost(inventory, maximum);
+        } else if (equalsIgnoreCase(predicate, "PRICE")) {
+            string_view lowField, highField;
+            Money low, high;
+            if (!fields.next(lowField) || !fields.next(highField) || !parseBound(lowField, low) || !parseBound(highField, high)) {
+                return fail(log, "PRICE needs <min> <max>");
+            }
+            matches = filter.priceBetween(inventory, low, high);
+        } else if (equalsIgnoreCase(predicate, "CATEGORY")) {
+            string_view category;
+            if (!fields.next(category)) return fail(log, "CATEGORY needs a category name");
+            int code = inventory.findCategoryCode(category);
+            matches = SelectionBitmap(inventory.rowCount());  // Unknown category selects nothing
+            if (code >= 0) matches = inventory.categoryRows(static_cast<uint8_t>(code));
+        } else {
+            return fail(log, "unknown FILTER predicate '" + upperCopy(predicate) + "'");
+        }
+        return true;
+    }
+
+    // EXPORT CSV|JSONL|BINARY <file> [predicates...] [SORT <key> [ASC|DESC]]: the predicates
+    // narrow the rows with the filter kernels and SORT orders them off the ordered indexes
+    // before the exporter streams them out
+    bool runExport(FieldReader& fields, ostream& log) {
+        string_view formatName, path, word;
+        InventoryExporter::Format format;
+        if (!fields.next(formatName) || !fields.next(path)) return fail(log, "EXPORT needs CSV|JSONL|BINARY <file>");
+        if (!InventoryExporter::parseFormat(formatName, format)) return fail(log, "unknown export format '" + string(formatName) + "'");
+
+        auto start = chrono::steady_clock::now();
+        SelectionBitmap selection;
+        bool filtered = false;
+        vector<SortEngine::SortKey> keys;
+        while (fields.next(word)) {
+            if (equalsIgnoreCase(word, "SORT")) {
+                if (!parseSortKeys(fields, keys, log)) return false;
+                continue;
+            }
+            SelectionBitmap matches;
+            if (!evaluatePredicate(word, fields, matches, log)) return false;
+            if (filtered) {
+                selection.intersect(matches);
+            } else {
+                selection = matches;
+                filtered = true;
+            }
+        }
+
+        // A narrow selection is cheaper to sort on its own than to pick out of the full index order
+        vector<uint32_t> rows;
+        size_t selected = filtered ? selection.count() : inventory.size();
+        if (!keys.empty() && (!filtered || selected * 8 >= inventory.size())) {
+            for (uint32_t row : sortEngine.indexedOrder(inventory, keys)) {
+                if (!filtered || selection.test(row)) rows.push_back(row);
+            }
+        } else if (filtered) {
+            rows.reserve(selected);
+            selection.forEach([&](size_t row) {
+                rows.push_back(static_cast<uint32_t>(row));
+                return true;
+            });
+            if (!keys.empty()) rows = sortEngine.sortedOrder(inventory, rows, keys);
+        } else {
+            rows.reserve(inventory.size());
+            inventory.forEachLiveRow([&](size_t row) { rows.push_back(static_cast<uint32_t>(row)); });
+        }
+
+        InventoryExporter exporter;
+        if (!exporter.write(string(path), format, inventory, rows)) return fail(log, exporter.getError());
+        log << "> Exported " << rows.size() << " items to " << path << " in " << fixed << setprecision(3)
+            << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() << " ms\n";
+        return true;
+    }
+
+    bool runFilter(FieldReader& fields, ostream& out, ostream& log) {
+        SelectionBitmap selection(inventory.rowCount());
+        bool first = true;
+        string_view predicate;
+
+        while (fields.next(predicate)) {
+            SelectionBitmap matches;
+            if (!evaluatePredicate(predicate, fields, matches, log)) return false;
+
+            if (first) {
+                selection = matches;
+                first = false;
+            } else {
+                selection.intersect(matches);
+            }
+        }
+        if (first) return fail(log, "FILTER needs at least one predicate");
+
+        writeSelection(out, selection);
+        return true;
+    }
+
+    // REPORT [<file>]: the tables go to the file when one is given, to the results otherwise
+    bool runReport(FieldReader& fields, ostream& out, ostream& log) {
+        string_view path = fields.remainder();
+        ReportEngine::Report report = core.stockReport();
+        if (path.empty()) {
+            ReportEngine::write(out, report, true);
+        } else {
+            ofstream file{string(path)};
+            if (file) ReportEngine::write(file, report, true);
+            if (!file) return fail(log, "cannot write report to " + string(path));
+        }
+        log << "> Report over " << report.overall.items << " items in " << fixed << setprecision(3) << report.milliseconds
+            << " ms (" << report.threads << (report.threads == 1 ? " thread" : " threads") << ")\n";
+        return true;
+    }
+
+    bool runCommand(string_view line, ostream& out, ostream& log) {
+        FieldReader fields(line);
+        string_view command, id;
+        fields.next(command);
+
+        STAT_SCOPE(STAT_BATCH_COMMAND);
+        if (equalsIgnoreCase(command, "ADD")) return runAdd(fields, log);
+        if (equalsIgnoreCase(command, "UPDATE")) return runUpdate(fields, log);
+        if (equalsIgnoreCase(command, "ADJUST")) return runAdjust(fields, log);
+        if (equalsIgnoreCase(command, "REMOVE")) {
+            if (!fields.next(id)) return fail(log, "REMOVE needs <id>");
+            if (core.removeItem(id) != ITEM_OK) return fail(log, "item with ID '" + string(id) + "' not found");
+            return true;
+        }
+        if (equalsIgnoreCase(command, "SEARCH")) {
+            if (!fields.next(id)) return fail(log, "SEARCH needs <id>");
+            ItemRef item = inventory.find(id);
+            if (!item) return fail(log, "item with ID '" + string(id) + "' not found");
+            writeRow(out, item);
+            return true;
+        }
+        if (equalsIgnoreCase(command, "SORT")) return runSort(fields, out, log);
+        if (equalsIgnoreCase(command, "TOP")) return runTop(fields, out, log);
+        if (equalsIgnoreCase(command, "FIND")) return runFind(fields, out, log);
+        if (equalsIgnoreCase(command, "EXPORT")) return runExport(fields, log);
+        if (equalsIgnoreCase(command, "IMPORT")) {
+            string_view path = fields.remainder();
+            if (path.empty()) return fail(log, "IMPORT needs <file>");
+            CsvImporter importer(inventory);
+            CsvImporter::Report report;
+            if (!importer.import(string(path), report, log)) return fail(log, importer.getError());
+            if (report.rejected > 0) return fail(log, to_string(report.rejected) + " of " + to_string(report.rows) + " rows rejected");
+            return true;
+        }
+        if (equalsIgnoreCase(command, "RANGE")) return runRange(fields, out, log);
+        if (equalsIgnoreCase(command, "LOWSTOCK")) {
+            string_view value;
+            int maximum = lowStockThreshold;
+            if (fields.next(value) && !parseLimit(value, maximum)) return fail(log, "invalid low stock threshold '" + string(value) + "'");
+            writeSelection(out, filter.quantityAtMost(inventory, maximum));
+            return true;
+        }
+        if (equalsIgnoreCase(command, "FILTER")) return runFilter(fields, out, log);
+        if (equalsIgnoreCase(command, "REPORT")) return runReport(fields, out, log);
+        return fail(log, "unknown command '" + upperCopy(command) + "'");
+    }
+
+public:
+    BatchProcessor(InventoryStore& inv, ItemValidation& val, int lowStock = DisplayLowStock::DEFAULT_THRESHOLD)
+        : inventory(inv), core(inv), validation(val), lowStockThreshold(lowStock), lineNumber(0), commandCount(0),
+          failureCount(0) {}
+
+    // Streams commands from in until end of input, then reports throughput to log
+    void run(istream& in, ostream& out, ostream& log) {
+        string line;
+        auto start = chrono::steady_clock::now();
+
+        while (getline(in, line)) {
+            ++lineNumber;
+            size_t first = line.find_first_not_of(" \t\r");
+            if (first == string::npos || line[first] == '#') continue;
+            ++commandCount;
+            runCommand(line, out, log);
+            if (inventory.needsCompaction()) inventory.compact();  // No handles are held between commands
+        }
+        out.flush();
+
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        log << "> Processed " << commandCount << " commands (" << failureCount << " failed) in "
+            << fixed << setprecision(3) << seconds * 1000.0 << " ms";
+        if (seconds > 0) log << " (" << setprecision(0) << commandCount / seconds << " commands/s)";
+        log << "\n";
+    }
+
+    size_t getCommandCount() const { return commandCount; }
+    size_t getFailureCount() const { return failureCount; }
+};
+
 // class used for handling menus and user interaction
 class DisplayMenu {
 private:
-    vector<Item> inventory;
+    InventoryStore inventory;
     AddItem addItem;
     ItemValidation validation;
+    InventorySnapshot snapshot;
+    WriteAheadLog journal;
+    int lowStockThreshold;
 
 public:
-    DisplayMenu() : addItem(inventory, validation) {}  // Pass validation to AddItem
+    // Pass validation to AddItem
+    DisplayMenu(const string& snapshotPath = "inventory.snap", const string& journalPath = "inventory.wal",
+                chrono::microseconds commitWindow = chrono::milliseconds(2))
+        : addItem(inventory, validation), snapshot(snapshotPath), journal(journalPath, commitWindow),
+          lowStockThreshold(DisplayLowStock::DEFAULT_THRESHOLD) {}
+
+    void setLowStockThreshold(int threshold) { lowStockThreshold = threshold; }
+
+    // Restores the inventory saved by the previous run: the last snapshot first,
+    // then every change journaled after it, and journals every change from here on
+    void restoreInventory(ostream& out) {
+        if (!snapshot.load(inventory)) {
+            out << "> Could not load saved inventory: " << snapshot.getError() << "\n";
+        } else if (!inventory.empty()) {
+            out << "> Loaded " << inventory.size() << " items from " << snapshot.getPath() << ".\n";
+        }
+
+        size_t replayed = 0;
+        string error;
+        if (!journal.replay(inventory, replayed, error, snapshot.getCheckpointLsn())) {
+            out << "> Could not replay change log: " << error << "\n";
+        } else if (replayed > 0) {
+            out << "> Recovered " << replayed << " changes from " << journal.getPath() << ".\n";
+        }
+
+        if (journal.open(error)) {
+            inventory.addListener(&journal);
+        } else {
+            out << "> Changes will not be saved: " << error << "\n";
+        }
+    }
+
+    // Saves the inventory so the next run starts where this one ended
+    // and empties the change log it now contains
+    void saveInventory(ostream& out) {
+        snapshot.setCheckpointLsn(journal.getLastLsn());  // Every journaled change is in the inventory
+        if (!snapshot.save(inventory)) {
+            out << "> Could not save inventory: " << snapshot.getError() << "\n";
+        } else if (!journal.checkpoint(snapshot.getCheckpointLsn())) {
+            out << "> Could not reset change log " << journal.getPath() << "\n";
+        }
+    }
+
+    // Imports a CSV or TSV catalog; rejected rows and the summary go to log. Rows are not
+    // journaled one by one, the import is confirmed as a whole by saving a snapshot after it.
+    void importCatalog(const string& path, ostream& log) {
+        bool journaling = inventory.removeListener(&journal);
+        CsvImporter importer(inventory);
+        CsvImporter::Report report;
+        if (!importer.import(path, report, log)) {
+            log << "> " << importer.getError() << "\n";
+        } else {
+            log << "> Imported " << report.imported << " of " << report.rows << " rows from " << path << " ("
+                << report.rejected << " rejected) in " << fixed << setprecision(3) << report.milliseconds << " ms ("
+                << setprecision(0) << (report.milliseconds > 0 ? report.rows / (report.milliseconds / 1000.0) : 0.0)
+                << " rows/s)\n";
+        }
+        saveInventory(log);
+        if (journaling) inventory.addListener(&journal);
+    }
+
+    // Runs a command script without any prompts; results go to out, the summary to log
+    void runBatch(istream& in, ostream& out, ostream& log) {
+        // A batch is confirmed as a whole, so changes only wait for the final sync
+        journal.setWaitForDurability(false);
+        BatchProcessor batch(inventory, validation, lowStockThreshold);
+        batch.run(in, out, log);
+        if (!journal.sync()) {
+            log << "> Could not write change log " << journal.getPath() << "\n";
+        }
+        journal.setWaitForDurability(true);
+    }
 
     void showMenu() {
         int choice;
         string input;
+        const int lowestChoice = STATS_ENABLED ? 0 : 1;  // 0 opens the statistics
+        const int exitChoice = 10;  // Exit stays the last entry
+        const int highestChoice = exitChoice;
 
         do {
             // Display the menu
             cout << "===========================================\n";
             cout << "\t\tMENU\n";
             cout << "===========================================\n";
+            if (STATS_ENABLED) cout << "0 - Statistics\n";
             cout << "1 - Add Item\n";
             cout << "2 - Update Item\n";
             cout << "3 - Remove Item\n";
@@ -1037,7 +1705,8 @@ public:
             cout << "6 - Search Item\n";
             cout << "7 - Sort Items\n";
             cout << "8 - Display Low Stock Items\n";
-            cout << "9 - Exit\n";
+            cout << "9 - Inventory Report\n";
+            cout << "10 - Exit\n";
             
             // Loop to get valid input from the user
             do {
@@ -1049,78 +1718,163 @@ public:
             cin.ignore();  // Discards the newline character left in the input buffer
 
                 // Validate if the input is numeric and within the valid range
-                if (input.length() == 1 && isdigit(input[0])) {
-                    choice = stoi(input);  // Convert to integer if valid
+                if (!cin) {
+                    choice = exitChoice;  // End of input, nothing more can be chosen
+                } else if (input.length() <= 2 && parseCount(input, choice) == NUMBER_OK) {
+                    // Valid number, the range is checked below
                 } else {
-                    choice = 0;  // Set to invalid choice if input is not valid
+                    choice = -1;  // Set to invalid choice if input is not valid
                 }
 
-                if (choice < 1 || choice > 9) {
-                    cout << "\n> Invalid choice! Please enter a number between 1 and 9.\n";
+                if (choice < lowestChoice || choice > highestChoice) {
+                    cout << "\n> Invalid choice! Please enter a number between " << lowestChoice << " and "
+                         << highestChoice << ".\n";
                 }
 
-            } while (choice < 1 || choice > 9);  // Keep asking until valid input is given
+            } while (choice < lowestChoice || choice > highestChoice);  // Keep asking until valid input is given
 
             // Process the valid choice
             switch (choice) {
-                case 1:
-                    system("cls");
+                case 0: {
+                    terminal().clearScreen();
+                    DisplayStatistics statistics;
+                    statistics.displayStatistics();
+                    break;
+                }
+                case 1: {
+                    STAT_SCOPE(STAT_MENU_ADD);
+                    terminal().clearScreen();
                     addItem.addNewItem();
                     break;
+                }
                 case 2: {
-                    system("cls");
+                    STAT_SCOPE(STAT_MENU_UPDATE);
+                    terminal().clearScreen();
                     UpdateItem update(inventory, validation);
                     update.updateItem();
                     break;
                 }
                 case 3: {
-                    system("cls");
+                    STAT_SCOPE(STAT_MENU_REMOVE);
+                    terminal().clearScreen();
                     RemoveItem remove(inventory);
                     remove.removeItem();
                     break;
                 }
                 case 4: {  // Display items by category
-                    system("cls");
+                    STAT_SCOPE(STAT_MENU_CATEGORY);
+                    terminal().clearScreen();
                     DisplayCategoryItems displayCategory(inventory); // Pass the shared inventory
                     displayCategory.displayItems(); // Call displayItems to show category items
                     break;
                 }
                 case 5: { // Display all items
-                    system("cls");
+                    STAT_SCOPE(STAT_MENU_DISPLAY_ALL);
+                    terminal().clearScreen();
                     DisplayInventory displayInventory(inventory);  // Use the derived class
                     displayInventory.displayItems(); // Call displayItems
                     break;
                 }
                 case 6: {
-                    system("cls");
+                    STAT_SCOPE(STAT_MENU_SEARCH);
+                    terminal().clearScreen();
                     SearchItem search(inventory);
                     search.searchItem();
                     break;
                 }
                 case 7: { // Sort items
-                    system("cls");
+                    STAT_SCOPE(STAT_MENU_SORT);
+                    terminal().clearScreen();
                     SortItems sortItems(inventory); // Pass the shared inventory
                     sortItems.displayItems(); // Call displayItems to sort and display
                     break;
                 }
                 case 8: {
-                    system("cls");
-                    DisplayLowStock displayLowStock(inventory);  // Pass the shared inventory
+                    STAT_SCOPE(STAT_MENU_LOW_STOCK);
+                    terminal().clearScreen();
+                    DisplayLowStock displayLowStock(inventory, lowStockThreshold);  // Pass the shared inventory
                     displayLowStock.displayLowStockItems();
                     break;
                 }
-                case 9:
+                case 9: {
+                    STAT_SCOPE(STAT_MENU_REPORT);
+                    terminal().clearScreen();
+                    DisplayReport displayReport(inventory);
+                    displayReport.displayReport();
+                    break;
+                }
+                case exitChoice:
+                    saveInventory(cout);
                     cout << "Exiting...\n";
                     break;
             }
 
-        } while (choice != 9);
+            // Between menu actions no handle is held, so squeeze out tombstones left by removals
+            if (inventory.needsCompaction()) inventory.compact();
+
+        } while (choice != exitChoice);
     }
 };
 
 // main function
-int main() {
+// Usage: MIDTERM-PROJECT [--headless] [--low-stock <quantity>] [--batch <file>|-] [--import <csv>] [--stats <file>]
+int main(int argc, char* argv[]) {
     DisplayMenu menu;
+    AnsiTerminal ansiTerminal;
+    bool headless = false;
+    string batchSource;
+    string importPath;
+    string statsPath;
+    int lowStock;
+
+    for (int i = 1; i < argc; ++i) {
+        string option = argv[i];
+        if (option == "--headless") {
+            headless = true;
+        } else if (option == "--batch") {
+            batchSource = (i + 1 < argc) ? argv[++i] : "-";
+        } else if (option == "--import" && i + 1 < argc) {
+            importPath = argv[++i];
+        } else if (option == "--stats" && i + 1 < argc) {
+            statsPath = argv[++i];  // Written when the run ends
+        } else if (option == "--low-stock" && i + 1 < argc && parseCount(argv[i + 1], lowStock) == NUMBER_OK) {
+            menu.setLowStockThreshold(lowStock);
+            ++i;
+        } else {
+            cerr << "Usage: " << argv[0] << " [--headless] [--low-stock <quantity>] [--batch <file>|-] [--import <csv>] [--stats <file>]\n";
+            return 1;
+        }
+    }
+
+    if (!importPath.empty() && batchSource.empty()) {
+        menu.restoreInventory(cerr);
+        menu.importCatalog(importPath, cerr);  // Saves the inventory when done
+        if (!statsPath.empty()) DisplayStatistics::saveStatistics(statsPath, cerr);
+        return 0;
+    }
+
+    if (!batchSource.empty()) {
+        // Batch runs keep the no-op terminal
+        menu.restoreInventory(cerr);
+        if (!importPath.empty()) menu.importCatalog(importPath, cerr);
+        if (batchSource == "-") {
+            menu.runBatch(cin, cout, cerr);
+        } else {
+            ifstream file(batchSource);
+            if (!file) {
+                cerr << "> Cannot open batch file " << batchSource << "\n";
+                return 1;
+            }
+            menu.runBatch(file, cout, cerr);
+        }
+        menu.saveInventory(cerr);
+        if (!statsPath.empty()) DisplayStatistics::saveStatistics(statsPath, cerr);
+        return 0;
+    }
+
+    if (!headless) useTerminal(ansiTerminal);
+    menu.restoreInventory(cout);
     menu.showMenu();
+    if (!statsPath.empty()) DisplayStatistics::saveStatistics(statsPath, cerr);
     return 0;
 }
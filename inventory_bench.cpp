@@ -0,0 +1,456 @@
+#include "inventory_core.h"
+#include <numeric>
+#include <new>
+#include <cstdlib>
+using namespace std;
+
+// class used to show how lookups scale with reader threads while a writer keeps changing stock
+class StressBenchmark {
+private:
+    static constexpr uint32_t ITEM_COUNT = 100000;
+    chrono::milliseconds runTime;
+
+    static void formatId(char* buffer, uint32_t number) {
+        snprintf(buffer, 16, "S%u", number % ITEM_COUNT);
+    }
+
+    // Runs the readers and one writer side by side for runTime and prints one result row
+    void measure(ConcurrentInventory& inventory, unsigned readers, ostream& out) const {
+        atomic<bool> stop(false);
+        vector<size_t> reads(readers, 0);
+        size_t writes = 0;
+        vector<thread> threads;
+
+        for (unsigned r = 0; r < readers; ++r) {
+            threads.emplace_back([&, r] {
+                uint32_t seed = r * 2654435761u + 1;
+                char id[16];
+                size_t done = 0;  // Counted locally so readers don't share a cache line
+                while (!stop.load(memory_order_relaxed)) {
+                    seed = seed * 1664525u + 1013904223u;
+                    formatId(id, seed >> 8);
+                    inventory.read([&](const InventoryStore& store) {
+                        ItemRef item = store.find(id);
+                        return item ? item.getQuantity() : 0;
+                    });
+                    ++done;
+                }
+                reads[r] = done;
+            });
+        }
+        // The writer mostly sets quantities and now and then removes and re-adds an item
+        threads.emplace_back([&] {
+            uint32_t seed = 7;
+            char id[16];
+            size_t done = 0;
+            while (!stop.load(memory_order_relaxed)) {
+                seed = seed * 1664525u + 1013904223u;
+                formatId(id, seed >> 8);
+                if (done % 64 == 63) {
+                    inventory.remove(id);
+                    inventory.add(Item(id, "stress item", 1, Money::fromCents(100), CATEGORY_NAMES[seed % CATEGORY_COUNT]));
+                } else {
+                    inventory.setQuantity(id, static_cast<int>(seed % 100));
+                }
+                ++done;
+            }
+            writes = done;
+        });
+
+        auto start = chrono::steady_clock::now();
+        this_thread::sleep_for(runTime);
+        stop = true;
+        for (auto& worker : threads) worker.join();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        size_t totalReads = 0;
+        for (size_t done : reads) totalReads += done;
+        out << readers << "\t" << fixed << setprecision(0) << totalReads / seconds << "\t"
+            << totalReads / seconds / readers << "\t" << writes / seconds << "\n";
+    }
+
+public:
+    StressBenchmark(chrono::milliseconds duration = chrono::milliseconds(500)) : runTime(duration) {}
+
+    // Doubles the reader count up to the number of cores; output is tab-separated
+    void run(ostream& out) const {
+        ConcurrentInventory inventory;
+        char id[16];
+        for (uint32_t i = 0; i < ITEM_COUNT; ++i) {
+            formatId(id, i);
+            inventory.add(Item(id, "stress item", static_cast<int>(i % 100), Money::fromCents((i % 1000) * 25),
+                               CATEGORY_NAMES[i % CATEGORY_COUNT]));
+        }
+
+        unsigned cores = max(1u, thread::hardware_concurrency());
+        out << "readers\treads/s\treads/s per reader\twrites/s\n";
+        for (unsigned readers = 1; readers < cores; readers *= 2) measure(inventory, readers, out);
+        measure(inventory, cores, out);
+        out.flush();
+    }
+};
+
+// Heap allocations made by the calling thread, counted by the global operator new below so the
+// benchmark can report allocations per operation
+thread_local uint64_t threadAllocations = 0;
+thread_local uint64_t threadAllocatedBytes = 0;
+
+void* operator new(size_t size) {
+    ++threadAllocations;
+    threadAllocatedBytes += size;
+    if (void* memory = malloc(size ? size : 1)) return memory;
+    throw bad_alloc();
+}
+
+void* operator new(size_t size, align_val_t alignment) {
+    ++threadAllocations;
+    threadAllocatedBytes += size;
+    size_t align = static_cast<size_t>(alignment);
+    if (void* memory = aligned_alloc(align, (size + align - 1) / align * align)) return memory;
+    throw bad_alloc();
+}
+
+// Kept out of line: inlined into a caller, GCC would pair the free with the new expression and warn
+__attribute__((noinline)) void operator delete(void* memory) noexcept { free(memory); }
+__attribute__((noinline)) void operator delete(void* memory, size_t) noexcept { free(memory); }
+__attribute__((noinline)) void operator delete(void* memory, align_val_t) noexcept { free(memory); }
+__attribute__((noinline)) void operator delete(void* memory, size_t, align_val_t) noexcept { free(memory); }
+
+// class used to time the core operations on generated inventories of growing size
+//
+// The generated inventories are skewed like a real store: 70% of the items are clothing, 20%
+// electronics and 10% entertainment, one item in ten is low on stock while the rest have long-tailed
+// quantities, and prices spread from 0.50 to 5000.00. The same seed always gives the same inventory,
+// so two builds can be compared row by row. Every operation prints one tab-separated row with its
+// time per operation, operations per second and heap allocations per operation.
+class OperationBenchmark {
+private:
+    static constexpr size_t LOOKUPS = 200000;          // IDs looked up per lookup operation
+    static constexpr size_t TEXT_QUERIES = 2000;       // Most prefix and substring searches; fuzzy runs a tenth
+    static constexpr size_t SEARCH_LIMIT = 20;         // As many matches as the search menu lists
+    static constexpr size_t SCANNED_ROWS = 20000000;   // Scans repeat until about this many rows are read
+    static constexpr size_t SORTED_ROWS = 2000000;     // Sorts repeat until about this many rows are sorted
+    static constexpr size_t BATCH_ROWS = 4096;         // Rows generated between timed runs of adds and removes
+
+    static constexpr const char* ADJECTIVES[] = {"red", "blue", "black", "steel", "cotton", "wireless",
+                                                 "vintage", "compact", "deluxe", "classic", "large", "small"};
+    static constexpr const char* NOUNS[CATEGORY_COUNT][6] = {
+        {"shirt", "jacket", "socks", "denim jeans", "hoodie", "scarf"},
+        {"charger", "monitor", "usb cable", "headphones", "keyboard", "camera"},
+        {"novel", "puzzle", "board game", "vinyl record", "comic", "movie"}};
+
+    // xorshift64*, fast and good enough for generating data
+    struct Random {
+        uint64_t state;
+
+        uint64_t next() {
+            state ^= state >> 12;
+            state ^= state << 25;
+            state ^= state >> 27;
+            return state * 2685821657736338717ull;
+        }
+
+        double unit() { return (next() >> 11) * 0x1.0p-53; }
+    };
+
+    // Generated item, the strings point into the buffers
+    struct Row {
+        char id[16];
+        char name[48];
+        int quantity;
+        Money price;
+        uint8_t category;
+    };
+
+    // Wall time and heap allocations spent inside start/stop pairs
+    struct Timer {
+        chrono::steady_clock::time_point started;
+        double nanoseconds = 0;
+        uint64_t allocationsAtStart = 0, allocations = 0;
+        uint64_t bytesAtStart = 0, bytes = 0;
+
+        void start() {
+            allocationsAtStart = threadAllocations;
+            bytesAtStart = threadAllocatedBytes;
+            started = chrono::steady_clock::now();
+        }
+
+        void stop() {
+            nanoseconds += chrono::duration<double, nano>(chrono::steady_clock::now() - started).count();
+            allocations += threadAllocations - allocationsAtStart;
+            bytes += threadAllocatedBytes - bytesAtStart;
+        }
+    };
+
+    vector<size_t> sizes;
+    uint64_t seed;
+    volatile size_t sink = 0;  // Results are written here so the timed work cannot be optimized away
+
+    // Distinct for every index below 2^32: both steps of the mix are invertible
+    static void formatId(uint32_t index, char* buffer) {
+        uint32_t mixed = index * 0x9E3779B1u;
+        mixed ^= mixed >> 15;
+        mixed *= 0x85EBCA77u;
+        mixed ^= mixed >> 13;
+        snprintf(buffer, 16, "SKU%08X", mixed);
+    }
+
+    void generate(uint32_t index, Random& random, Row& row) const {
+        formatId(index, row.id);
+
+        uint64_t pick = random.next() % 100;
+        row.category = pick < 70 ? CLOTHING : pick < 90 ? ELECTRONICS : ENTERTAINMENT;
+        snprintf(row.name, sizeof(row.name), "%s %s %u", ADJECTIVES[random.next() % 12],
+                 NOUNS[row.category][random.next() % 6], static_cast<unsigned>(100 + random.next() % 9900));
+
+        // One item in ten at or below the default low-stock threshold, the rest log-uniform up to 5000
+        if (random.next() % 10 == 0) {
+            row.quantity = static_cast<int>(random.next() % (InventoryCore::DEFAULT_LOW_STOCK + 1));
+        } else {
+            row.quantity = InventoryCore::DEFAULT_LOW_STOCK + 1 + static_cast<int>(exp(random.unit() * log(5000.0)));
+        }
+        row.price = Money::fromCents(static_cast<int64_t>(50 * exp(random.unit() * log(10000.0))));
+    }
+
+    template <typename Body>
+    void measure(ostream& out, size_t items, const char* operation, size_t operations, Body body) {
+        Timer timer;
+        timer.start();
+        body();
+        timer.stop();
+        report(out, items, operation, operations, timer);
+    }
+
+    static void report(ostream& out, size_t items, const char* operation, size_t operations, const Timer& timer) {
+        double perOperation = timer.nanoseconds / operations;
+        out << items << "\t" << operation << "\t" << operations << "\t" << fixed << setprecision(1) << perOperation
+            << "\t" << 1e9 / perOperation << "\t" << setprecision(3)
+            << static_cast<double>(timer.allocations) / operations << "\t" << setprecision(1)
+            << static_cast<double>(timer.bytes) / operations << "\n";
+        out.flush();
+    }
+
+    // IDs of count random items; missing ones are IDs of indexes past the inventory
+    static vector<string> lookupIds(size_t items, size_t count, bool present, Random& random) {
+        vector<string> ids(count);
+        char id[16];
+        for (auto& lookup : ids) {
+            uint64_t index = random.next() % items;
+            formatId(static_cast<uint32_t>(present ? index : items + index), id);
+            lookup = id;
+        }
+        return ids;
+    }
+
+    void runSize(size_t items, ostream& out) {
+        Random random{seed ^ items};
+        InventoryStore store;
+        vector<Row> batch(BATCH_ROWS);
+
+        Timer adds;
+        for (size_t first = 0; first < items; first += BATCH_ROWS) {
+            size_t count = min(BATCH_ROWS, items - first);
+            for (size_t i = 0; i < count; ++i) generate(static_cast<uint32_t>(first + i), random, batch[i]);
+            adds.start();
+            for (size_t i = 0; i < count; ++i) {
+                const Row& row = batch[i];
+                store.add(row.id, row.name, row.quantity, row.price, CATEGORY_NAMES[row.category]);
+            }
+            adds.stop();
+        }
+        report(out, items, "add", items, adds);
+
+        // Lookups by ID, the way the add and search menus do them
+        InventoryCore core(store);
+        vector<string> present = lookupIds(items, LOOKUPS, true, random);
+        vector<string> missing = lookupIds(items, LOOKUPS, false, random);
+        measure(out, items, "duplicate_id_hit", LOOKUPS, [&] {
+            size_t found = 0;
+            for (const auto& id : present) found += core.isDuplicateId(id);
+            sink = found;
+        });
+        measure(out, items, "duplicate_id_miss", LOOKUPS, [&] {
+            size_t found = 0;
+            for (const auto& id : missing) found += core.isDuplicateId(id);
+            sink = found;
+        });
+        measure(out, items, "find_hit", LOOKUPS, [&] {
+            size_t total = 0;
+            for (const auto& id : present) total += store.find(id).getQuantity();
+            sink = total;
+        });
+        for (auto& id : present) transform(id.begin(), id.end(), id.begin(), ::tolower);
+        measure(out, items, "find_hit_lowercase", LOOKUPS, [&] {
+            size_t total = 0;
+            for (const auto& id : present) total += store.find(id).getQuantity();
+            sink = total;
+        });
+        measure(out, items, "find_miss", LOOKUPS, [&] {
+            size_t found = 0;
+            for (const auto& id : missing) found += static_cast<bool>(store.find(id));
+            sink = found;
+        });
+
+        // Whole-inventory sorts and scans, repeated so small inventories are timed over many runs
+        SortEngine sortEngine;
+        FilterEngine filter;
+        size_t sorts = max<size_t>(1, SORTED_ROWS / items);
+        size_t scans = max<size_t>(1, SCANNED_ROWS / items);
+        measure(out, items, "sort_price", sorts, [&] {
+            for (size_t i = 0; i < sorts; ++i) {
+                sink = sortEngine.sortedOrder(store, {{SortEngine::BY_PRICE, true}}).size();
+            }
+        });
+        measure(out, items, "sort_category_quantity", sorts, [&] {
+            for (size_t i = 0; i < sorts; ++i) {
+                sink = sortEngine.sortedOrder(store, {{SortEngine::BY_CATEGORY, true}, {SortEngine::BY_QUANTITY, false}}).size();
+            }
+        });
+        measure(out, items, "sort_price_indexed", sorts, [&] {
+            for (size_t i = 0; i < sorts; ++i) {
+                sink = sortEngine.indexedOrder(store, {{SortEngine::BY_PRICE, true}}).size();
+            }
+        });
+        measure(out, items, "category_filter", scans, [&] {
+            for (size_t i = 0; i < scans; ++i) {
+                sink = filter.categoryEquals(store, static_cast<uint8_t>(i % CATEGORY_COUNT)).count();
+            }
+        });
+        measure(out, items, "category_postings", scans, [&] {
+            for (size_t i = 0; i < scans; ++i) {
+                size_t found = 0;
+                store.forEachInCategory(static_cast<uint8_t>(i % CATEGORY_COUNT), [&](uint32_t) { return ++found > 0; });
+                sink = found;
+            }
+        });
+        measure(out, items, "low_stock_scan", scans, [&] {
+            for (size_t i = 0; i < scans; ++i) {
+                sink = filter.quantityAtMost(store, InventoryCore::DEFAULT_LOW_STOCK).count();
+            }
+        });
+        measure(out, items, "stock_value", scans, [&] {
+            for (size_t i = 0; i < scans; ++i) {
+                sink = static_cast<size_t>(ValuationEngine().totalValue(store));
+            }
+        });
+        measure(out, items, "stock_report", scans, [&] {
+            for (size_t i = 0; i < scans; ++i) {
+                sink = ReportEngine().build(store).overall.items;
+            }
+        });
+
+        // Text searches, fewer on large inventories where a common substring matches many rows;
+        // the index is built by the first one
+        size_t queries = min(TEXT_QUERIES, max<size_t>(20, SCANNED_ROWS / items));
+        vector<string> prefixes, substrings, misspelled;
+        char id[16];
+        for (size_t i = 0; i < queries; ++i) {
+            formatId(static_cast<uint32_t>(random.next() % items), id);
+            prefixes.push_back(string(id, 6));
+            string name(store.find(id).getName());
+            substrings.push_back(name.substr(name.size() / 3, 6));
+            if (i % 10 == 0) {
+                name[name.size() / 2] = name[name.size() / 2] == 'x' ? 'y' : 'x';
+                misspelled.push_back(name);
+            }
+        }
+        measure(out, items, "text_index_build", 1, [&] {
+            sink = store.searchText(prefixes[0], InventoryStore::PREFIX_MATCH, SEARCH_LIMIT).size();
+        });
+        measure(out, items, "search_prefix", prefixes.size(), [&] {
+            size_t found = 0;
+            for (const auto& text : prefixes) found += store.searchText(text, InventoryStore::PREFIX_MATCH, SEARCH_LIMIT).size();
+            sink = found;
+        });
+        measure(out, items, "search_substring", substrings.size(), [&] {
+            size_t found = 0;
+            for (const auto& text : substrings) found += store.searchText(text, InventoryStore::SUBSTRING_MATCH, SEARCH_LIMIT).size();
+            sink = found;
+        });
+        measure(out, items, "search_fuzzy", misspelled.size(), [&] {
+            size_t found = 0;
+            for (const auto& text : misspelled) found += store.searchText(text, InventoryStore::FUZZY_MATCH, SEARCH_LIMIT).size();
+            sink = found;
+        });
+
+        // Removes half of the items in scattered order; a stride coprime to items visits distinct rows
+        size_t stride = 1000003;
+        while (gcd(stride, items) != 1) stride += 2;
+        size_t removals = items / 2;
+        Timer removes;
+        for (size_t first = 0; first < removals; first += BATCH_ROWS) {
+            size_t count = min(BATCH_ROWS, removals - first);
+            for (size_t i = 0; i < count; ++i) {
+                formatId(static_cast<uint32_t>((first + i) * stride % items), batch[i].id);
+            }
+            removes.start();
+            size_t removed = 0;
+            for (size_t i = 0; i < count; ++i) removed += store.remove(batch[i].id);
+            removes.stop();
+            sink = removed;
+        }
+        report(out, items, "erase", max<size_t>(1, removals), removes);
+        measure(out, items, "compact", 1, [&] { sink = store.compact(); });
+    }
+
+public:
+    static constexpr size_t DEFAULT_SIZES[] = {1000, 10000, 100000, 1000000};
+
+    OperationBenchmark(vector<size_t> itemCounts = vector<size_t>(begin(DEFAULT_SIZES), end(DEFAULT_SIZES)),
+                       uint64_t randomSeed = 0x5EED)
+        : sizes(move(itemCounts)), seed(randomSeed) {}
+
+    // Reads a comma-separated list of inventory sizes such as "1k,100k,10M"
+    static bool parseSizes(string_view list, vector<size_t>& parsed) {
+        vector<size_t> found;
+        while (!list.empty()) {
+            size_t comma = list.find(',');
+            string_view field = list.substr(0, comma);
+            list = (comma == string_view::npos) ? string_view() : list.substr(comma + 1);
+
+            int scale = 1;
+            if (!field.empty() && (field.back() == 'k' || field.back() == 'K')) scale = 1000;
+            if (!field.empty() && (field.back() == 'm' || field.back() == 'M')) scale = 1000000;
+            if (scale != 1) field.remove_suffix(1);
+
+            int count;
+            if (parseCount(field, count) != NUMBER_OK || count <= 0 || count > INT_MAX / scale) return false;
+            found.push_back(static_cast<size_t>(count) * scale);
+        }
+        if (found.empty()) return false;
+        parsed = move(found);
+        return true;
+    }
+
+    // One row per operation and inventory size; output is tab-separated
+    void run(ostream& out) {
+        out << "items\toperation\toperations\tns/op\tops/s\tallocs/op\tbytes/op\n";
+        for (size_t items : sizes) runSize(items, out);
+        out.flush();
+    }
+};
+
+// main function
+// Usage: inventory_bench [sizes] [--stress]
+// sizes is a comma-separated list such as 1k,100k,10M; --stress runs the reader scaling benchmark instead
+int main(int argc, char* argv[]) {
+    vector<size_t> sizes(begin(OperationBenchmark::DEFAULT_SIZES), end(OperationBenchmark::DEFAULT_SIZES));
+    bool stress = false;
+
+    for (int i = 1; i < argc; ++i) {
+        string option = argv[i];
+        if (option == "--stress") {
+            stress = true;
+        } else if (!OperationBenchmark::parseSizes(option, sizes)) {
+            cerr << "Usage: " << argv[0] << " [sizes] [--stress]\n";
+            return 1;
+        }
+    }
+
+    if (stress) {
+        StressBenchmark().run(cout);
+    } else {
+        OperationBenchmark(sizes).run(cout);
+    }
+    return 0;
+}
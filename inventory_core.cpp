@@ -0,0 +1,230 @@
+// Out-of-line parts of the inventory core: number parsing and validation, money formatting and
+// the InventoryCore API
+#include "inventory_core.h"
+
+char* formatCents(MoneySum cents, char* end) {
+    if (cents >= INT64_MIN && cents <= INT64_MAX) return formatCents(static_cast<int64_t>(cents), end);
+    unsigned __int128 magnitude = cents < 0 ? 0 - static_cast<unsigned __int128>(cents) : static_cast<unsigned __int128>(cents);
+    char* start = end;
+    for (int digit = 0; digit < 2 || magnitude != 0; ++digit) {
+        if (digit == 2) *--start = '.';
+        *--start = static_cast<char>('0' + static_cast<int>(magnitude % 10));
+        magnitude /= 10;
+    }
+    if (cents < 0) *--start = '-';
+    return start;
+}
+
+std::ostream& operator<<(std::ostream& out, Money money) {
+    char text[24];
+    char* end = text + sizeof(text);
+    char* start = money.format(end);
+    return out << std::string_view(start, static_cast<size_t>(end - start));
+}
+
+const char* describeNumber(NumberStatus status) {
+    switch (status) {
+        case NUMBER_OK: return "ok";
+        case NUMBER_EMPTY: return "empty";
+        case NUMBER_MALFORMED: return "not a number";
+        case NUMBER_OUT_OF_RANGE: return "out of range";
+        case NUMBER_NOT_POSITIVE: return "not positive";
+        case NUMBER_TOO_MANY_DIGITS: return "more than 10 digits";
+    }
+    return "";
+}
+
+NumberStatus parseCount(std::string_view text, int& value) {
+    if (text.empty()) return NUMBER_EMPTY;
+    if (text[0] < '0' || text[0] > '9') return NUMBER_MALFORMED;
+    const char* end = text.data() + text.size();
+    int parsed;
+    std::from_chars_result result = std::from_chars(text.data(), end, parsed);
+    if (result.ec == std::errc::result_out_of_range) return NUMBER_OUT_OF_RANGE;
+    if (result.ec != std::errc() || result.ptr != end) return NUMBER_MALFORMED;
+    value = parsed;
+    return NUMBER_OK;
+}
+
+NumberStatus parseSignedCount(std::string_view text, int& value) {
+    if (text.empty()) return NUMBER_EMPTY;
+    if (text[0] != '+' && text[0] != '-') return parseCount(text, value);
+    if (text.size() == 1 || text[1] < '0' || text[1] > '9') return NUMBER_MALFORMED;
+    if (text[0] == '+') text.remove_prefix(1);  // from_chars takes a minus but not a plus
+    const char* end = text.data() + text.size();
+    int parsed;
+    std::from_chars_result result = std::from_chars(text.data(), end, parsed);
+    if (result.ec == std::errc::result_out_of_range) return NUMBER_OUT_OF_RANGE;
+    if (result.ec != std::errc() || result.ptr != end) return NUMBER_MALFORMED;
+    value = parsed;
+    return NUMBER_OK;
+}
+
+NumberStatus parseDecimal(std::string_view text, double& value) {
+    if (text.empty()) return NUMBER_EMPTY;
+    if (text[0] != '.' && (text[0] < '0' || text[0] > '9')) return NUMBER_MALFORMED;
+    const char* end = text.data() + text.size();
+    double parsed;
+    std::from_chars_result result = std::from_chars(text.data(), end, parsed, std::chars_format::fixed);
+    if (result.ec == std::errc::result_out_of_range) return NUMBER_OUT_OF_RANGE;
+    if (result.ec != std::errc() || result.ptr != end) return NUMBER_MALFORMED;
+    value = parsed;
+    return NUMBER_OK;
+}
+
+NumberStatus parseMoney(std::string_view text, Money& amount) {
+    if (text.empty()) return NUMBER_EMPTY;
+    size_t point = text.find('.');
+    std::string_view whole = text.substr(0, point);
+    std::string_view fraction = (point == std::string_view::npos) ? std::string_view() : text.substr(point + 1);
+    if (whole.empty() && fraction.empty()) return NUMBER_MALFORMED;
+
+    int64_t units = 0;
+    size_t significant = 0;  // Whole digits after any leading zeros
+    for (char c : whole) {
+        if (c < '0' || c > '9') return NUMBER_MALFORMED;
+        if (significant == 0 && c == '0') continue;
+        if (++significant <= 16) units = units * 10 + (c - '0');
+    }
+    int64_t cents = 0;
+    for (size_t i = 0; i < fraction.size(); ++i) {
+        char c = fraction[i];
+        if (c < '0' || c > '9') return NUMBER_MALFORMED;
+        if (i < 2) cents = cents * 10 + (c - '0');
+        else if (i == 2 && c >= '5') ++cents;  // Rounds up from ...5, carrying into the units if need be
+    }
+    if (fraction.size() == 1) cents *= 10;
+    if (significant > 16) return NUMBER_OUT_OF_RANGE;
+    amount = Money::fromCents(units * 100 + cents);
+    return NUMBER_OK;
+}
+
+NumberStatus checkQuantity(int quantity) {
+    return quantity > 0 ? NUMBER_OK : NUMBER_NOT_POSITIVE;
+}
+
+NumberStatus checkPrice(Money price) {
+    if (price.getCents() <= 0) return NUMBER_NOT_POSITIVE;
+    return price <= MAX_PRICE ? NUMBER_OK : NUMBER_TOO_MANY_DIGITS;
+}
+
+NumberStatus parseQuantity(std::string_view text, int& quantity) {
+    int value;
+    NumberStatus status = parseCount(text, value);
+    if (status == NUMBER_OK) status = checkQuantity(value);
+    if (status == NUMBER_OK) quantity = value;
+    return status;
+}
+
+NumberStatus parsePrice(std::string_view text, Money& price) {
+    Money value;
+    NumberStatus status = parseMoney(text, value);
+    if (status == NUMBER_OK) status = checkPrice(value);
+    if (status == NUMBER_OK) price = value;
+    return status;
+}
+
+bool parseCategory(std::string_view name, Category& category) {
+    for (int code = 0; code < CATEGORY_COUNT; ++code) {
+        if (equalsIgnoreCase(name, CATEGORY_NAMES[code])) {
+            category = static_cast<Category>(code);
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* describeItem(ItemStatus status) {
+    switch (status) {
+        case ITEM_OK: return "ok";
+        case ITEM_INVALID_ID: return "invalid ID";
+        case ITEM_INVALID_CATEGORY: return "invalid category";
+        case ITEM_INVALID_QUANTITY: return "invalid quantity";
+        case ITEM_INVALID_PRICE: return "invalid price";
+        case ITEM_DUPLICATE_ID: return "an item with this ID already exists";
+        case ITEM_NOT_FOUND: return "item not found";
+        case ITEM_INSUFFICIENT_STOCK: return "not enough stock";
+        case ITEM_QUANTITY_OUT_OF_RANGE: return "the quantity would be out of range";
+    }
+    return "";
+}
+
+std::vector<ItemRef> InventoryCore::itemsAt(const std::vector<uint32_t>& rows) const {
+    std::vector<ItemRef> items;
+    items.reserve(rows.size());
+    for (uint32_t row : rows) items.push_back(inventory.at(row));
+    return items;
+}
+
+std::vector<ItemRef> InventoryCore::itemsIn(const SelectionBitmap& selection) const {
+    std::vector<ItemRef> items;
+    items.reserve(selection.count());
+    selection.forEach([&](size_t row) {
+        items.push_back(inventory.at(row));
+        return true;
+    });
+    return items;
+}
+
+std::string_view InventoryCore::normalizeId(std::string_view id) {
+    idBuffer.assign(id.data(), id.size());
+    toUpperInPlace(idBuffer);
+    return idBuffer;
+}
+
+ItemStatus InventoryCore::addItem(std::string_view id, std::string_view name, int quantity, Money price,
+                                  std::string_view category) {
+    Category parsed;
+    if (!parseCategory(category, parsed)) return ITEM_INVALID_CATEGORY;
+    std::string_view upperId = normalizeId(id);
+    if (!validation.validateId(upperId)) return ITEM_INVALID_ID;
+    if (!validation.validatePrice(price)) return ITEM_INVALID_PRICE;
+    if (!validation.validateQuantity(quantity)) return ITEM_INVALID_QUANTITY;
+    if (!inventory.add(upperId, name, quantity, price, CATEGORY_NAMES[parsed])) return ITEM_DUPLICATE_ID;
+    return ITEM_OK;
+}
+
+ItemStatus InventoryCore::setQuantity(std::string_view id, int quantity) {
+    if (!validation.validateQuantity(quantity)) return ITEM_INVALID_QUANTITY;
+    return inventory.setQuantity(id, quantity) ? ITEM_OK : ITEM_NOT_FOUND;
+}
+
+ItemStatus InventoryCore::setPrice(std::string_view id, Money price) {
+    if (!validation.validatePrice(price)) return ITEM_INVALID_PRICE;
+    return inventory.setPrice(id, price) ? ITEM_OK : ITEM_NOT_FOUND;
+}
+
+ItemStatus InventoryCore::adjustQuantity(std::string_view id, int delta, InventoryStore::AdjustMode mode) {
+    switch (inventory.adjustQuantity(id, delta, mode)) {
+        case InventoryStore::ADJUSTED: return ITEM_OK;
+        case InventoryStore::REJECTED: return ITEM_INSUFFICIENT_STOCK;
+        case InventoryStore::OUT_OF_RANGE: return ITEM_QUANTITY_OUT_OF_RANGE;
+        case InventoryStore::NOT_FOUND: break;
+    }
+    return ITEM_NOT_FOUND;
+}
+
+ItemStatus InventoryCore::removeItem(std::string_view id) {
+    return inventory.remove(id) ? ITEM_OK : ITEM_NOT_FOUND;
+}
+
+std::vector<ItemRef> InventoryCore::itemsInCategory(Category category) const {
+    std::vector<ItemRef> items;
+    inventory.forEachInCategory(category, [&](uint32_t row) {
+        items.push_back(inventory.at(row));
+        return true;
+    });
+    return items;
+}
+
+std::vector<ItemRef> InventoryCore::lowStockItems(int threshold) const {
+    return itemsIn(filter.quantityAtMost(inventory, threshold));
+}
+
+std::vector<ItemRef> InventoryCore::sortedItems(const std::vector<SortEngine::SortKey>& keys) const {
+    return itemsAt(sortEngine.indexedOrder(inventory, keys));
+}
+
+std::vector<ItemRef> InventoryCore::searchItems(std::string_view text, InventoryStore::TextMatch match, size_t limit) const {
+    return itemsAt(inventory.searchText(text, match, limit));
+}
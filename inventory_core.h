@@ -0,0 +1,1829 @@
+// Inventory core: the item store and its indexes, validation, sorting, filtering, valuation,
+// snapshots, the change log, imports and exports, and InventoryCore, the non-interactive API
+// over them. Nothing in here reads the console; results come back as values and status codes.
+#ifndef INVENTORY_CORE_H
+#define INVENTORY_CORE_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstdint>
+#include <climits>
+#include <cmath>
+#include <limits>
+#include <cstring>
+#include <cstdio>
+#include <memory>
+#include <string_view>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Categories an item can belong to; the value doubles as the category's dictionary code in the store
+enum Category : uint8_t { CLOTHING, ELECTRONICS, ENTERTAINMENT, CATEGORY_COUNT };
+
+const char* const CATEGORY_NAMES[CATEGORY_COUNT] = {"clothing", "electronics", "entertainment"};
+
+// Case-insensitive comparison without building lowercase copies
+inline bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (tolower(static_cast<unsigned char>(a[i])) != tolower(static_cast<unsigned char>(b[i]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Case conversion in place, so normalizing an ID or a keyword never builds a copy
+inline void toUpperInPlace(std::string& text) {
+    for (char& c : text) c = static_cast<char>(toupper(static_cast<unsigned char>(c)));
+}
+
+inline void toLowerInPlace(std::string& text) {
+    for (char& c : text) c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+}
+
+// Position of the first case-insensitive occurrence of needle in haystack, or string_view::npos
+inline size_t findIgnoreCase(std::string_view haystack, std::string_view needle) {
+    if (needle.size() > haystack.size()) return std::string_view::npos;
+    for (size_t start = 0; start + needle.size() <= haystack.size(); ++start) {
+        if (equalsIgnoreCase(haystack.substr(start, needle.size()), needle)) return start;
+    }
+    return std::string_view::npos;
+}
+
+// Formats digits right-to-left ending just before end, returns the first character
+inline char* formatUnsigned(uint64_t value, char* end) {
+    do {
+        *--end = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    return end;
+}
+
+inline char* formatInteger(int64_t value, char* end) {
+    uint64_t magnitude = value < 0 ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+    char* start = formatUnsigned(magnitude, end);
+    if (value < 0) *--start = '-';
+    return start;
+}
+
+// An amount of cents with two decimals ("1234.56"), integers only
+inline char* formatCents(int64_t cents, char* end) {
+    uint64_t magnitude = cents < 0 ? 0 - static_cast<uint64_t>(cents) : static_cast<uint64_t>(cents);
+    char* start = formatUnsigned(magnitude / 100, end - 3);
+    end[-3] = '.';
+    end[-2] = static_cast<char>('0' + (magnitude / 10) % 10);
+    end[-1] = static_cast<char>('0' + magnitude % 10);
+    if (cents < 0) *--start = '-';
+    return start;
+}
+
+// Cents, wide enough for any total of price * quantity over the inventory
+typedef __int128 MoneySum;
+
+char* formatCents(MoneySum cents, char* end);
+
+// class used to hold an amount of money as a whole number of cents, so prices compare, sort
+// and add up exactly and print without going through floating point
+class Money {
+private:
+    int64_t cents;
+
+public:
+    constexpr Money() : cents(0) {}
+
+    static constexpr Money fromCents(int64_t amount) {
+        Money money;
+        money.cents = amount;
+        return money;
+    }
+
+    constexpr int64_t getCents() const { return cents; }
+
+    bool operator==(Money other) const { return cents == other.cents; }
+    bool operator!=(Money other) const { return cents != other.cents; }
+    bool operator<(Money other) const { return cents < other.cents; }
+    bool operator<=(Money other) const { return cents <= other.cents; }
+    bool operator>(Money other) const { return cents > other.cents; }
+    bool operator>=(Money other) const { return cents >= other.cents; }
+
+    // Writes "1234.56" right-to-left ending just before end, returns the first character
+    char* format(char* end) const { return formatCents(cents, end); }
+};
+
+// Honors setw and left/right like any other field
+std::ostream& operator<<(std::ostream& out, Money money);
+
+// Outcome of parsing or validating a numeric field; the parsers only write their output on NUMBER_OK
+enum NumberStatus : uint8_t { NUMBER_OK, NUMBER_EMPTY, NUMBER_MALFORMED, NUMBER_OUT_OF_RANGE, NUMBER_NOT_POSITIVE,
+                              NUMBER_TOO_MANY_DIGITS };
+
+const char* describeNumber(NumberStatus status);
+
+// Digits only (no sign or spaces), within the range of an int
+NumberStatus parseCount(std::string_view text, int& value);
+
+// A count with an optional leading + or -
+NumberStatus parseSignedCount(std::string_view text, int& value);
+
+// Digits with at most one decimal point ("12", "12.5", ".5", "12."), no sign or exponent
+NumberStatus parseDecimal(std::string_view text, double& value);
+
+// Same text as parseDecimal, read as integers and rounded half up to whole cents, so "19.99"
+// is exactly 1999 cents
+NumberStatus parseMoney(std::string_view text, Money& amount);
+
+NumberStatus checkQuantity(int quantity);
+
+// Highest price an item can have: 10 whole digits
+const Money MAX_PRICE = Money::fromCents(999999999999);
+
+NumberStatus checkPrice(Money price);
+
+// parseCount and parseMoney followed by checkQuantity and checkPrice
+NumberStatus parseQuantity(std::string_view text, int& quantity);
+NumberStatus parsePrice(std::string_view text, Money& price);
+
+// Looks up a category by name (case-insensitive), returns false if it is not one of the allowed ones
+bool parseCategory(std::string_view name, Category& category);
+
+// class used to represent the items individually; an item owns copies of its strings, so one
+// read back from a store stays valid after the store changes or goes away
+class Item {
+private:
+    std::string itemId;
+    std::string itemName;
+    int itemQuantity;
+    Money itemPrice;
+    std::string itemCategory;
+    
+public:
+    // Constructor using initialization list
+    Item(std::string_view id, std::string_view name, int quantity, Money price, std::string_view category)
+        : itemId(id), itemName(name), itemQuantity(quantity), itemPrice(price), itemCategory(category) {}
+
+    const std::string& getId() const { return itemId; }
+    const std::string& getName() const { return itemName; }
+    int getQuantity() const { return itemQuantity; }
+    Money getPrice() const { return itemPrice; }
+    const std::string& getCategory() const { return itemCategory; }
+
+    void setQuantity(int quantity) { itemQuantity = quantity; }
+    void setPrice(Money price) { itemPrice = price; }
+
+    void display(std::ostream& out = std::cout) const {
+        out << "Category: " << itemCategory << "\n"
+            << "ID: " << itemId << "\n"
+            << "Item Name: " << itemName << "\n"
+            << "Price: " << itemPrice << "\n"
+            << "Quantity: " << itemQuantity << "\n";
+    }
+};
+
+//abstract class used for validation of values
+class AbstractValidation {
+public:
+    virtual bool validateId(std::string_view id) const = 0;
+    virtual bool validateQuantity(int quantity) const = 0;
+    virtual bool validatePrice(Money price) const = 0;
+};
+
+//implementation of a concrete validation class
+class ItemValidation : public AbstractValidation {
+public:
+    bool validateId(std::string_view id) const override {
+        // Validation for ID (e.g., checking length, format)
+        return !id.empty() && isValidIdOrCategory(id);
+    }
+
+    bool validateQuantity(int quantity) const override {
+        return checkQuantity(quantity) == NUMBER_OK;
+    }
+
+    bool validatePrice(Money price) const override {
+        return checkPrice(price) == NUMBER_OK;  // Positive, at most 10 whole digits
+    }
+
+	bool validateCategory(std::string_view category) const {
+        Category parsed;
+        return parseCategory(category, parsed);
+    }
+
+    bool isValidIdOrCategory(std::string_view str) const {
+        for (char c : str) {
+            if (!isalnum(c)) {  // Check for non-alphanumeric characters
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool isValidNumericInput(const std::string& input, double& output) const {
+        return parseDecimal(input, output) == NUMBER_OK;
+    }
+
+    bool isValidNumericInput(const std::string& input, int& output) const {
+        return parseCount(input, output) == NUMBER_OK;
+    }
+};
+
+// Operation statistics are compiled in only with INVENTORY_STATS defined (cmake -DINVENTORY_STATS=ON);
+// without it STAT_SCOPE expands to nothing and no operation pays for them
+#ifdef INVENTORY_STATS
+constexpr bool STATS_ENABLED = true;
+#else
+constexpr bool STATS_ENABLED = false;
+#endif
+
+// Operations that are counted and timed: calls into the store and engines, then the menu actions
+// (which include the time spent waiting for input) and batch commands
+enum StatOperation : uint8_t {
+    STAT_ADD, STAT_REMOVE, STAT_FIND, STAT_SET_QUANTITY, STAT_SET_PRICE, STAT_ADJUST_QUANTITY, STAT_TEXT_SEARCH,
+    STAT_SORT, STAT_FILTER, STAT_VALUATION, STAT_COMPACT, STAT_SNAPSHOT_SAVE, STAT_SNAPSHOT_LOAD, STAT_JOURNAL_REPLAY,
+    STAT_IMPORT, STAT_EXPORT, STAT_REPORT, STAT_MENU_ADD, STAT_MENU_UPDATE, STAT_MENU_REMOVE, STAT_MENU_CATEGORY,
+    STAT_MENU_DISPLAY_ALL, STAT_MENU_SEARCH, STAT_MENU_SORT, STAT_MENU_LOW_STOCK, STAT_MENU_REPORT, STAT_BATCH_COMMAND,
+    STAT_OPERATION_COUNT
+};
+
+const char* const STAT_NAMES[STAT_OPERATION_COUNT] = {
+    "add", "remove", "find", "set_quantity", "set_price", "adjust_quantity", "text_search",
+    "sort", "filter", "valuation", "compact", "snapshot_save", "snapshot_load", "journal_replay",
+    "import", "export", "report", "menu_add", "menu_update", "menu_remove", "menu_category",
+    "menu_display_all", "menu_search", "menu_sort", "menu_low_stock", "menu_report", "batch_command"};
+
+// class used to record how long one kind of operation takes, HDR style: values below 16 ticks
+// have a bucket each, above that every power of two is split into 16 buckets, so any percentile
+// is known to within 1/16 of its value at a fixed 8 KB. Recording is lock-free.
+class LatencyHistogram {
+public:
+    static constexpr size_t SUB_BUCKETS = 16;
+    static constexpr size_t BUCKET_COUNT = (64 - 3) * SUB_BUCKETS;
+
+    static size_t bucketOf(uint64_t ticks) {
+        if (ticks < SUB_BUCKETS) return static_cast<size_t>(ticks);
+        int exponent = 63 - __builtin_clzll(ticks);  // At least 4 here
+        return static_cast<size_t>(exponent - 3) * SUB_BUCKETS + ((ticks >> (exponent - 4)) & (SUB_BUCKETS - 1));
+    }
+
+    // Lowest value that lands in the bucket
+    static uint64_t bucketStart(size_t bucket) {
+        if (bucket < SUB_BUCKETS) return bucket;
+        int exponent = static_cast<int>(bucket / SUB_BUCKETS) + 3;
+        return static_cast<uint64_t>(SUB_BUCKETS + bucket % SUB_BUCKETS) << (exponent - 4);
+    }
+
+private:
+    std::atomic<uint64_t> buckets[BUCKET_COUNT] = {};
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> totalTicks{0};
+    std::atomic<uint64_t> maxTicks{0};
+
+public:
+    void record(uint64_t ticks) {
+        buckets[bucketOf(ticks)].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        totalTicks.fetch_add(ticks, std::memory_order_relaxed);
+        uint64_t seen = maxTicks.load(std::memory_order_relaxed);
+        while (ticks > seen && !maxTicks.compare_exchange_weak(seen, ticks, std::memory_order_relaxed)) {}
+    }
+
+    uint64_t getCount() const { return count.load(std::memory_order_relaxed); }
+    uint64_t getTotalTicks() const { return totalTicks.load(std::memory_order_relaxed); }
+    uint64_t getMaxTicks() const { return maxTicks.load(std::memory_order_relaxed); }
+
+    // Highest value of the bucket holding the given fraction (0.5 for the median) of the recorded
+    // values, but no more than the largest value recorded
+    uint64_t percentile(double fraction) const {
+        uint64_t total = getCount();
+        if (total == 0) return 0;
+        uint64_t wanted = std::max<uint64_t>(1, static_cast<uint64_t>(ceil(fraction * total)));
+        uint64_t seen = 0;
+        for (size_t b = 0; b < BUCKET_COUNT; ++b) {
+            seen += buckets[b].load(std::memory_order_relaxed);
+            if (seen >= wanted) return std::min(b + 1 < BUCKET_COUNT ? bucketStart(b + 1) - 1 : UINT64_MAX, getMaxTicks());
+        }
+        return getMaxTicks();  // Records that raced in after count was read
+    }
+
+    void reset() {
+        for (auto& bucket : buckets) bucket.store(0, std::memory_order_relaxed);
+        count.store(0, std::memory_order_relaxed);
+        totalTicks.store(0, std::memory_order_relaxed);
+        maxTicks.store(0, std::memory_order_relaxed);
+    }
+};
+
+// class used to keep a LatencyHistogram per StatOperation and report them in nanoseconds
+//
+// Times are taken with rdtsc where available (a few ns, no system call) and converted with the
+// tick rate measured against steady_clock over the life of the process.
+class OperationStats {
+private:
+    LatencyHistogram histograms[STAT_OPERATION_COUNT];
+    uint64_t startTicks;
+    std::chrono::steady_clock::time_point startTime;
+
+public:
+    OperationStats() : startTicks(now()), startTime(std::chrono::steady_clock::now()) {}
+
+    static uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+    }
+
+    void record(StatOperation operation, uint64_t ticks) { histograms[operation].record(ticks); }
+
+    const LatencyHistogram& get(StatOperation operation) const { return histograms[operation]; }
+
+    double nanosecondsPerTick() const {
+#if defined(__x86_64__) || defined(__i386__)
+        uint64_t ticks = now() - startTicks;
+        double nanoseconds = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - startTime).count();
+        return ticks > 0 ? nanoseconds / ticks : 1.0;
+#else
+        return 1.0;
+#endif
+    }
+
+    // Column headings of report(), also written on their own when statistics are compiled out
+    static void reportHeader(std::ostream& out, bool tabSeparated) {
+        if (tabSeparated) {
+            out << "operation\tcount\tmean_ns\tp50_ns\tp90_ns\tp99_ns\tmax_ns\ttotal_ns\n";
+        } else {
+            out << std::left << std::setw(18) << "OPERATION" << std::right << std::setw(10) << "COUNT" << std::setw(12) << "MEAN us"
+                << std::setw(12) << "P50 us" << std::setw(12) << "P90 us" << std::setw(12) << "P99 us" << std::setw(12) << "MAX us"
+                << std::setw(12) << "TOTAL ms" << "\n";
+            out << std::string(100, '-') << "\n";
+        }
+    }
+
+    // One row per operation that ran: aligned columns in microseconds for people, or with
+    // tabSeparated tab-separated nanoseconds for other tools
+    void report(std::ostream& out, bool tabSeparated) const {
+        double scale = nanosecondsPerTick();
+        double unit = tabSeparated ? 1.0 : 1000.0;
+        reportHeader(out, tabSeparated);
+        out << std::fixed;
+        for (int op = 0; op < STAT_OPERATION_COUNT; ++op) {
+            const LatencyHistogram& histogram = histograms[op];
+            uint64_t count = histogram.getCount();
+            if (count == 0) continue;
+            double values[] = {static_cast<double>(histogram.getTotalTicks()) / count,
+                               static_cast<double>(histogram.percentile(0.5)), static_cast<double>(histogram.percentile(0.9)),
+                               static_cast<double>(histogram.percentile(0.99)), static_cast<double>(histogram.getMaxTicks())};
+            if (tabSeparated) {
+                out << STAT_NAMES[op] << "\t" << count << std::setprecision(0);
+                for (double value : values) out << "\t" << value * scale;
+                out << "\t" << histogram.getTotalTicks() * scale << "\n";
+            } else {
+                out << std::left << std::setw(18) << STAT_NAMES[op] << std::right << std::setw(10) << count << std::setprecision(2);
+                for (double value : values) out << std::setw(12) << value * scale / unit;
+                out << std::setw(12) << histogram.getTotalTicks() * scale / 1e6 << "\n";
+            }
+        }
+        out.unsetf(std::ios::floatfield);
+    }
+
+    void reset() {
+        for (auto& histogram : histograms) histogram.reset();
+    }
+};
+
+#ifdef INVENTORY_STATS
+// The statistics of this process; only defined when they are compiled in, so default builds
+// carry neither the histograms nor the tick calibration
+inline OperationStats operationStats;
+
+// class used to time the scope it is declared in and record it under an operation
+class StatScope {
+private:
+    StatOperation operation;
+    uint64_t start;
+
+public:
+    explicit StatScope(StatOperation op) : operation(op), start(OperationStats::now()) {}
+    ~StatScope() { operationStats.record(operation, OperationStats::now() - start); }
+};
+
+#define STAT_SCOPE(operation) StatScope statScope(operation)
+#else
+#define STAT_SCOPE(operation) ((void)0)
+#endif
+
+// class used to keep every string once in large arena blocks and hand out stable string_views
+// (blocks are never moved or freed, so a view stays valid for the life of the pool)
+class StringPool {
+private:
+    static constexpr size_t BLOCK_SIZE = 64 * 1024;
+    static constexpr uint32_t EMPTY_ENTRY = UINT32_MAX;
+
+    std::vector<std::unique_ptr<char[]>> blocks;
+    std::vector<std::unique_ptr<char[]>> largeBlocks;  // Strings longer than a block, one allocation each
+    size_t blockUsed;               // Bytes used in the newest block
+    std::vector<std::string_view> entries;    // Interned strings, indexed by reference
+    std::vector<uint32_t> table;         // Open-addressing intern table holding references, EMPTY_ENTRY if unused
+    size_t tableMask;
+
+    static size_t hashText(std::string_view text);
+    size_t probe(std::string_view text) const;
+
+    // Copies the text into the arena; oversized strings get a block of their own
+    std::string_view store(std::string_view text);
+
+public:
+    StringPool() : blockUsed(0), table(64, EMPTY_ENTRY), tableMask(63) {}
+
+    // Returns the reference of the text, storing it on first use
+    uint32_t intern(std::string_view text);
+
+    // Presizes the intern table for count strings so bulk loads never rehash
+    void reserve(size_t count);
+
+    std::string_view get(uint32_t ref) const { return entries[ref]; }
+    size_t size() const { return entries.size(); }
+};
+
+// class used to hold the result of a filter: one bit per inventory row
+class SelectionBitmap {
+private:
+    std::vector<uint64_t> words;
+    size_t bitCount;
+
+public:
+    SelectionBitmap(size_t rows = 0) : words((rows + 63) / 64, 0), bitCount(rows) {}
+
+    size_t size() const { return bitCount; }
+    uint64_t* data() { return words.data(); }
+
+    bool test(size_t row) const { return (words[row / 64] >> (row % 64)) & 1; }
+    void set(size_t row) { words[row / 64] |= uint64_t(1) << (row % 64); }
+    void reset(size_t row) { words[row / 64] &= ~(uint64_t(1) << (row % 64)); }
+
+    // Grows or shrinks to the given number of rows; new rows start unselected
+    void resize(size_t rows) {
+        words.resize((rows + 63) / 64, 0);
+        if (rows % 64 != 0) words.back() &= (uint64_t(1) << (rows % 64)) - 1;
+        bitCount = rows;
+    }
+
+    // Keeps only the rows selected by both bitmaps (predicates are combined with AND)
+    void intersect(const SelectionBitmap& other) {
+        for (size_t i = 0; i < words.size(); ++i) words[i] &= other.words[i];
+    }
+
+    size_t count() const {
+        size_t total = 0;
+        for (uint64_t word : words) total += static_cast<size_t>(__builtin_popcountll(word));
+        return total;
+    }
+
+    // Calls visit(row) for every selected row in ascending order; stops early if visit returns false
+    template <typename Visitor>
+    void forEach(Visitor visit) const {
+        for (size_t i = 0; i < words.size(); ++i) {
+            uint64_t word = words[i];
+            while (word != 0) {
+                size_t row = i * 64 + static_cast<size_t>(__builtin_ctzll(word));
+                if (!visit(row)) return;
+                word &= word - 1;
+            }
+        }
+    }
+};
+
+// class used to keep (key, row) pairs in order in a B+tree, for ordered walks, top-K and range
+// queries that never sort
+//
+// Entries are ordered by key, then by row. Leaves hold the entries and are linked both ways
+// for in-order walks; branches hold, for every child, the smallest entry the child may hold.
+// Insert and erase are O(log n); underfull nodes borrow from or merge with a sibling.
+class OrderedIndex {
+public:
+    struct Entry {
+        uint64_t key;
+        uint32_t row;
+
+        bool operator<(const Entry& other) const {
+            return key != other.key ? key < other.key : row < other.row;
+        }
+        bool operator==(const Entry& other) const { return key == other.key && row == other.row; }
+    };
+
+    // Maps signed cents onto an unsigned key with the same ordering (flip the sign bit)
+    static uint64_t priceKey(Money price);
+
+    static uint64_t quantityKey(int quantity);
+
+private:
+    static constexpr int CAPACITY = 64;      // Entries per leaf, children per branch
+    static constexpr int MINIMUM = CAPACITY / 4;  // Below this a node borrows or merges
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    struct Leaf {
+        Entry entries[CAPACITY];
+        int count;
+        uint32_t prev, next;  // Neighbouring leaves in key order, NONE at either end
+    };
+
+    struct Branch {
+        Entry lowest[CAPACITY];  // lowest[i] <= every entry under children[i]
+        uint32_t children[CAPACITY];
+        int count;
+    };
+
+    // deque so references stay valid while nodes are added
+    std::deque<Leaf> leaves;
+    std::deque<Branch> branches;
+    std::vector<uint32_t> freeLeaves;
+    std::vector<uint32_t> freeBranches;
+    uint32_t root;
+    int height;  // 0 while the root is a leaf
+    size_t entryCount;
+
+    uint32_t newLeaf();
+    uint32_t newBranch();
+
+    // Child of the branch whose range holds the entry; child 0 also takes anything smaller
+    static int childIndex(const Branch& branch, const Entry& entry);
+
+    // Smallest entry under the node
+    Entry lowestOf(uint32_t node, int level) const;
+
+    // Inserts below node; when the node splits, returns true with the new right node and its lowest entry
+    bool insertInto(uint32_t node, int level, const Entry& entry, Entry& splitLowest, uint32_t& splitNode);
+
+    // Erases below node; returns true if the node is now underfull
+    bool eraseFrom(uint32_t node, int level, const Entry& entry, bool& found);
+
+    // Fixes an underfull child by merging it with a neighbour or, if both don't fit in one node, by sharing evenly
+    void rebalance(uint32_t parent, int child, int childLevel);
+
+    static void removeChild(Branch& branch, int index);
+
+    // Leaf and position of the first entry not less than the given one (position == count past the end)
+    void lowerBound(const Entry& entry, uint32_t& leaf, int& position) const;
+
+public:
+    OrderedIndex() { clear(); }
+
+    size_t size() const { return entryCount; }
+
+    void clear();
+    void insert(uint64_t key, uint32_t row);
+
+    // Returns false if the pair was not in the index
+    bool erase(uint64_t key, uint32_t row);
+
+    // Rebuilds the index from entries already in order, packing nodes 3/4 full
+    void assign(const std::vector<Entry>& sorted);
+
+    // Calls visit(entry) in ascending order starting at the first entry with a key of at least
+    // fromKey; stops when visit returns false
+    template <typename Visitor>
+    void forEachAscending(uint64_t fromKey, Visitor visit) const {
+        uint32_t leaf;
+        int position;
+        lowerBound(Entry{fromKey, 0}, leaf, position);
+        while (leaf != NONE) {
+            const Leaf& node = leaves[leaf];
+            for (; position < node.count; ++position) {
+                if (!visit(node.entries[position])) return;
+            }
+            leaf = node.next;
+            position = 0;
+        }
+    }
+
+    // Calls visit(entry) in descending order starting at the last entry with a key of at most
+    // throughKey; stops when visit returns false
+    template <typename Visitor>
+    void forEachDescending(uint64_t throughKey, Visitor visit) const {
+        uint32_t leaf;
+        int position;
+        if (throughKey == UINT64_MAX) {
+            lowerBound(Entry{UINT64_MAX, UINT32_MAX}, leaf, position);
+            if (position < leaves[leaf].count) ++position;  // Only the (UINT64_MAX, UINT32_MAX) entry itself
+        } else {
+            lowerBound(Entry{throughKey + 1, 0}, leaf, position);
+        }
+        while (leaf != NONE) {
+            const Leaf& node = leaves[leaf];
+            while (position > 0) {
+                if (!visit(node.entries[--position])) return;
+            }
+            leaf = node.prev;
+            if (leaf != NONE) position = leaves[leaf].count;
+        }
+    }
+};
+
+// class used to find items by fragments of their ID or name: every lowercased three-character
+// window (trigram) of the text maps to the rows holding it
+//
+// Texts are padded with two NUL bytes in front and one behind, so prefixes as short as one
+// character have trigrams of their own. Postings of removed rows are left in place; searches
+// check every candidate against the actual text, and the store rebuilds the index once too
+// many stale postings pile up.
+class TrigramIndex {
+private:
+    std::unordered_map<uint32_t, std::vector<uint32_t>> postings;  // Trigram code -> rows, in insertion order
+    std::vector<uint32_t> scratch;
+
+public:
+    // Sorted, distinct trigram codes of the lowercased text, with the front and/or back padding
+    static void gramsOf(std::string_view text, bool padFront, bool padBack, std::vector<uint32_t>& grams);
+
+    // Files the row under every trigram of the text; a row is listed once per trigram even
+    // when several of its texts share it, as long as they are inserted back to back
+    void insert(uint32_t row, std::string_view text);
+
+    // Rows filed under the trigram, or nullptr if no text ever had it
+    const std::vector<uint32_t>* rowsWith(uint32_t gram) const;
+
+    void clear();
+};
+
+// Rows per chunk of item columns; a multiple of 64 so every chunk starts on a bitmap word
+constexpr size_t CHUNK_ROWS = 1024;
+
+// struct used to hold the columns of CHUNK_ROWS consecutive rows
+//
+// Chunks are shared between the store and its snapshots. The store copies a chunk before
+// writing to it while a snapshot still holds it (copy-on-write), so snapshots never change.
+struct ItemChunk {
+    std::string_view ids[CHUNK_ROWS];       // Views into the store's StringPool
+    std::string_view names[CHUNK_ROWS];
+    int quantities[CHUNK_ROWS];
+    int64_t prices[CHUNK_ROWS];        // Money in cents
+    uint8_t categoryCodes[CHUNK_ROWS];
+    uint32_t generations[CHUNK_ROWS];  // Bumped whenever a row's item goes away
+    uint64_t live[CHUNK_ROWS / 64];    // One bit per row, set while the row holds an item
+    // Posting list per category code: offsets of the chunk's live rows in the category, ascending.
+    // Kept in the chunk so snapshots share them like the columns.
+    std::vector<std::vector<uint16_t>> categoryRows;
+};
+
+class ItemColumns;
+
+// class used to refer to one item stored in the columns of an InventoryStore or InventoryView,
+// offering the same accessors as Item without copying anything out of the store
+//
+// A handle names a row plus the generation the row had when the handle was made. Rows never
+// move while the item lives, so a handle survives other adds and removes; once its item is
+// removed (or moved by compact()) the generation no longer matches and the handle tests false.
+class ItemRef {
+private:
+    const ItemColumns* columns;
+    uint32_t row;
+    uint32_t generation;
+
+public:
+    ItemRef() : columns(nullptr), row(0), generation(0) {}
+    ItemRef(const ItemColumns* owner, uint32_t index, uint32_t gen) : columns(owner), row(index), generation(gen) {}
+
+    explicit operator bool() const;  // False for "not found" and for handles whose item is gone
+    uint32_t getRow() const { return row; }
+    uint32_t getGeneration() const { return generation; }
+
+    std::string_view getId() const;
+    std::string_view getName() const;
+    int getQuantity() const;
+    Money getPrice() const;
+    std::string_view getCategory() const;
+
+    void display(std::ostream& out = std::cout) const;
+};
+
+// abstract class used to observe every change made to the inventory
+class InventoryListener {
+public:
+    virtual ~InventoryListener() {}
+    virtual void onAdd(const ItemRef& item) = 0;
+    virtual void onRemove(std::string_view id) = 0;
+    virtual void onQuantityChange(std::string_view id, int quantity) = 0;
+    virtual void onPriceChange(std::string_view id, Money price) = 0;
+
+    // Relative quantity change from adjustQuantity; delta is what was actually applied.
+    // Listeners that only track absolute values can keep this default.
+    virtual void onQuantityAdjust(std::string_view id, int /*delta*/, int quantity) { onQuantityChange(id, quantity); }
+};
+
+// class used to read item columns, shared by the live InventoryStore and its InventoryViews
+//
+// Items are stored column by column (structure of arrays) in fixed-size chunks: quantities
+// and prices in dense arrays, categories as one-byte codes into a small dictionary, IDs and
+// names as views into an interned string pool. Scans over one field only touch that field.
+class ItemColumns {
+protected:
+    using ChunkTable = std::vector<std::shared_ptr<ItemChunk>>;
+
+    std::shared_ptr<ChunkTable> chunks;  // Shared with snapshots; the store copies it before changing it
+    size_t rows;                    // Rows in use, dead ones included
+    size_t liveCount;
+    std::vector<std::string_view> categoryNames;  // Category dictionary, indexed by code; views into the string pool
+
+    const ItemChunk& chunkOf(size_t row) const { return *(*chunks)[row / CHUNK_ROWS]; }
+
+public:
+    ItemColumns() : chunks(std::make_shared<ChunkTable>()), rows(0), liveCount(0) {}
+
+    bool empty() const { return liveCount == 0; }
+    size_t size() const { return liveCount; }  // Live items
+    size_t rowCount() const { return rows; }   // Rows in the columns, dead ones included
+    size_t deadCount() const { return rows - liveCount; }
+
+    bool isLive(size_t row) const {
+        return row < rows && ((chunkOf(row).live[(row % CHUNK_ROWS) / 64] >> (row % 64)) & 1);
+    }
+    bool isCurrent(uint32_t row, uint32_t generation) const {
+        return isLive(row) && chunkOf(row).generations[row % CHUNK_ROWS] == generation;
+    }
+
+    // Row accessors used by ItemRef
+    std::string_view idAt(size_t row) const { return chunkOf(row).ids[row % CHUNK_ROWS]; }
+    std::string_view nameAt(size_t row) const { return chunkOf(row).names[row % CHUNK_ROWS]; }
+    // Quantity and price use relaxed atomic access so ConcurrentInventory can update them
+    // while other threads read (a plain move on x86, no fence)
+    int quantityAt(size_t row) const {
+        return __atomic_load_n(&chunkOf(row).quantities[row % CHUNK_ROWS], __ATOMIC_RELAXED);
+    }
+    Money priceAt(size_t row) const {
+        return Money::fromCents(__atomic_load_n(&chunkOf(row).prices[row % CHUNK_ROWS], __ATOMIC_RELAXED));
+    }
+    uint8_t categoryCodeAt(size_t row) const { return chunkOf(row).categoryCodes[row % CHUNK_ROWS]; }
+    std::string_view categoryAt(size_t row) const { return categoryNames[categoryCodeAt(row)]; }
+
+    // Hints for walks in an order other than row order (sorted exports): start loading a row's
+    // column entries, and later, once its string_views are cached, the ID and name bytes
+    void prefetchRow(size_t row) const {
+        const ItemChunk& chunk = chunkOf(row);
+        size_t offset = row % CHUNK_ROWS;
+        __builtin_prefetch(&chunk.ids[offset]);
+        __builtin_prefetch(&chunk.names[offset]);
+        __builtin_prefetch(&chunk.quantities[offset]);
+        __builtin_prefetch(&chunk.prices[offset]);
+        __builtin_prefetch(&chunk.categoryCodes[offset]);
+    }
+    void prefetchText(size_t row) const {
+        __builtin_prefetch(idAt(row).data());
+        __builtin_prefetch(nameAt(row).data());
+    }
+
+    // Chunks for scans, filters, sorting and aggregation; dead rows hold stale values,
+    // so every scan must be masked with the chunk's live bits
+    size_t chunkCount() const { return (rows + CHUNK_ROWS - 1) / CHUNK_ROWS; }
+    const ItemChunk& getChunk(size_t index) const { return *(*chunks)[index]; }
+    size_t rowsInChunk(size_t index) const { return std::min(CHUNK_ROWS, rows - index * CHUNK_ROWS); }
+    const std::vector<std::string_view>& getCategoryNames() const { return categoryNames; }
+
+    // Returns the dictionary code of the category (case-insensitive), or -1 if it is unknown
+    int findCategoryCode(std::string_view category) const;
+
+    // Calls visit(row) for the live rows of the category in ascending order, reading only each
+    // chunk's posting list, until visit returns false
+    template <typename Visitor>
+    void forEachInCategory(uint8_t code, Visitor visit) const {
+        for (size_t c = 0; c < chunkCount(); ++c) {
+            const ItemChunk& chunk = getChunk(c);
+            if (code >= chunk.categoryRows.size()) continue;
+            for (uint16_t offset : chunk.categoryRows[code]) {
+                if (!visit(static_cast<uint32_t>(c * CHUNK_ROWS + offset))) return;
+            }
+        }
+    }
+
+    // The category's rows as a bitmap, to combine with FilterEngine predicates
+    SelectionBitmap categoryRows(uint8_t code) const;
+
+    // Calls visit(row) for every live row in ascending order
+    template <typename Visitor>
+    void forEachLiveRow(Visitor visit) const {
+        for (size_t c = 0; c < chunkCount(); ++c) {
+            const ItemChunk& chunk = getChunk(c);
+            for (size_t w = 0; w < CHUNK_ROWS / 64; ++w) {
+                uint64_t word = chunk.live[w];
+                while (word != 0) {
+                    visit(c * CHUNK_ROWS + w * 64 + static_cast<size_t>(__builtin_ctzll(word)));
+                    word &= word - 1;
+                }
+            }
+        }
+    }
+
+    // Iterates the live items in row order as ItemRefs, skipping tombstones
+    class const_iterator {
+    private:
+        const ItemColumns* columns;
+        uint32_t row;
+
+        void skipDead() {
+            while (row < columns->rowCount() && !columns->isLive(row)) ++row;
+        }
+
+    public:
+        const_iterator(const ItemColumns* owner, uint32_t index) : columns(owner), row(index) { skipDead(); }
+        ItemRef operator*() const { return columns->at(row); }
+        const_iterator& operator++() { ++row; skipDead(); return *this; }
+        bool operator!=(const const_iterator& other) const { return row != other.row; }
+    };
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, static_cast<uint32_t>(rowCount())); }
+
+    // Handle to the item in a live row
+    ItemRef at(size_t row) const {
+        return ItemRef(this, static_cast<uint32_t>(row), chunkOf(row).generations[row % CHUNK_ROWS]);
+    }
+};
+
+// class used to hold a consistent point-in-time view of the inventory
+//
+// Taking one copies a pointer to the chunk table and the small category dictionary, nothing
+// else; the store copies whatever it changes afterwards. A view must not outlive its store,
+// whose string pool holds the IDs and names.
+class InventoryView : public ItemColumns {
+public:
+    InventoryView() {}
+    explicit InventoryView(const ItemColumns& columns) : ItemColumns(columns) {}
+};
+
+// class used to own the items and index them by their normalized (uppercase) ID
+//
+// Rows work like a slot map: removing an item only marks its row dead (a tombstone), bumps the
+// row's generation and puts the row on a free list for the next add, so removal is O(1) and no
+// other row moves. Scans skip dead rows through the live bits; compact() squeezes them out.
+class InventoryStore : public ItemColumns {
+private:
+    static constexpr int EMPTY_SLOT = -1;
+
+    StringPool strings;            // Removed items' strings stay interned and are reused if the text comes back
+    std::vector<uint32_t> freeRows;     // Dead rows waiting to be reused, most recently freed last
+
+    std::vector<int> slots;   // Open-addressing table holding rows, EMPTY_SLOT if unused
+    size_t slotMask;     // slots.size() - 1, the table size is always a power of two
+    std::vector<InventoryListener*> listeners;  // Notified after every successful change
+
+    // Price and quantity order of the live rows, built on first use. Once built, a change only
+    // sets the row's bit in dirtyRows (and the word's bit in dirtyWords) with an atomic OR, so
+    // ConcurrentInventory's per-item updates never meet on a lock; the next ordered walk refiles
+    // the marked rows under orderLock. filedPriceKeys/filedQuantityKeys remember the key each row
+    // is filed under so a refile can move it, filedRows whether it is filed at all.
+    mutable OrderedIndex priceOrder;
+    mutable OrderedIndex quantityOrder;
+    mutable std::vector<uint64_t> filedPriceKeys;
+    mutable std::vector<uint64_t> filedQuantityKeys;
+    mutable std::vector<uint8_t> filedRows;
+    mutable std::vector<uint64_t> dirtyRows;   // One bit per row, accessed with __atomic builtins
+    mutable std::vector<uint64_t> dirtyWords;  // One bit per dirtyRows word that may be non-zero
+    mutable std::atomic<bool> ordersBuilt{false};
+    mutable std::atomic<bool> ordersDirty{false};
+    mutable std::shared_mutex orderLock;
+
+    // Trigram index over IDs and names for text search, also built on first use. Removed rows
+    // only count as stale until there are more of them than live rows, then the index is dropped.
+    mutable TrigramIndex textIndex;
+    mutable size_t staleTextRows = 0;
+    mutable bool textIndexBuilt = false;
+    mutable std::shared_mutex textLock;
+
+    // FNV-1a hash over the uppercased characters so lookups never build a normalized copy
+    static size_t hashId(std::string_view id);
+
+    // Linear probing: returns the slot holding the ID, or the empty slot where it would go
+    size_t probe(std::string_view id) const;
+
+    void rehash(size_t capacity);
+
+    // Double the table once the load factor would pass 1/2
+    void growIfNeeded();
+
+    // Backward-shift deletion keeps probe chains intact without tombstones
+    void eraseSlot(size_t slot);
+
+    // Returns the dictionary code of the category, adding it on first use
+    uint8_t categoryCode(std::string_view category);
+
+    // Returns the chunk holding the row for writing, copying the chunk table and the chunk
+    // first if a snapshot still shares them
+    ItemChunk& ownChunk(size_t row);
+
+    void setLive(size_t row, bool live);
+
+    // Returns a dead row to reuse, or the next row past the end, adding a chunk when needed.
+    // Chunks past the end are kept after compact(), so their rows remember their generations.
+    uint32_t allocateRow();
+
+    int rowOf(std::string_view id) const { return slots[probe(id)]; }
+
+    // Files the row in its chunk's posting list for its category; the list stays in row order
+    void linkPosting(uint32_t row);
+
+    // Drops the row from its posting list; a list holds at most CHUNK_ROWS entries, so the
+    // search and the shift are bounded
+    void unlinkPosting(uint32_t row);
+
+    // Bulk-loads both ordered indexes from the columns; the caller holds orderLock exclusively
+    void buildOrders() const;
+
+    // Files the row under its current price and quantity, or takes it out if it is dead;
+    // the caller holds orderLock exclusively
+    void refileRow(uint32_t row) const;
+
+    // Takes the marks off the dirty rows and refiles them; the caller holds orderLock
+    // exclusively. A row marked again meanwhile keeps its bit for the next walk.
+    void refileDirtyRows() const;
+
+    void ensureOrders() const;
+
+    // Marks the row for refiling by the next ordered walk. Callers read filed (ordersBuilt)
+    // before changing the row, so a concurrent first build either sees the change or the mark.
+    void markDirty(uint32_t row, bool filed);
+
+    void ensureTextIndex() const;
+    void indexText(uint32_t row);
+
+    // Drops the text index instead of letting stale postings outnumber live rows
+    void dropTextIndex();
+
+    // Similarity of two trigram sets: shared trigrams over all distinct trigrams (Jaccard)
+    static double similarity(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b);
+
+public:
+    InventoryStore();
+
+    // Views share the chunks; copying the store itself would share them with a second writer
+    InventoryStore(const InventoryStore&) = delete;
+    InventoryStore& operator=(const InventoryStore&) = delete;
+
+    // Consistent point-in-time view in O(1); later changes to the store don't show up in it
+    InventoryView snapshot() const { return InventoryView(*this); }
+
+    // True while a snapshot still shares the row's chunk, so writing it means copying the chunk
+    bool isShared(size_t row) const;
+
+    // Presizes the chunk table and the index so bulk loads never rehash
+    void reserve(size_t count);
+
+    bool contains(std::string_view id) const;
+
+    // Returns the item with the given ID (case-insensitive), or an empty ItemRef if not found
+    ItemRef find(std::string_view id) const;
+
+    // Adds the item, returns false if an item with the same ID already exists
+    bool add(std::string_view id, std::string_view name, int quantity, Money price, std::string_view category);
+
+    bool add(const Item& item);
+
+    // Sets the quantity of the item with the given ID, returns false if it was not found
+    bool setQuantity(std::string_view id, int quantity);
+
+    // Sets the price of the item with the given ID, returns false if it was not found
+    bool setPrice(std::string_view id, Money price);
+
+    // How adjustQuantity treats a decrement larger than the stock on hand
+    enum AdjustMode { ALLOW_NEGATIVE, FLOOR_AT_ZERO, REJECT_IF_INSUFFICIENT };
+    // REJECTED is insufficient stock under REJECT_IF_INSUFFICIENT, OUT_OF_RANGE a result outside int
+    enum AdjustResult { ADJUSTED, NOT_FOUND, REJECTED, OUT_OF_RANGE };
+
+    struct QuantityDelta {
+        std::string_view id;
+        int delta;
+    };
+
+    // Adds delta (negative to take stock out) to the item's quantity with a compare-and-swap
+    // loop, so concurrent adjustments of one item never lose an update. The resulting
+    // quantity is stored in *quantity when given.
+    AdjustResult adjustQuantity(std::string_view id, int delta, AdjustMode mode = ALLOW_NEGATIVE, int* quantity = nullptr);
+
+    // Applies the deltas in order in one call, e.g. a burst of sales; returns how many were
+    // applied and, when results is given, fills it with one AdjustResult per delta
+    size_t adjustQuantities(const std::vector<QuantityDelta>& deltas, AdjustMode mode = ALLOW_NEGATIVE,
+                            std::vector<AdjustResult>* results = nullptr);
+
+    void addListener(InventoryListener* listener) { listeners.push_back(listener); }
+
+    // Returns false if the listener was not registered
+    bool removeListener(InventoryListener* listener);
+
+    enum OrderedField { PRICE_ORDER, QUANTITY_ORDER };
+
+    // Calls visit(row) for the live rows in price or quantity order, starting at the first row
+    // whose key is at least (ascending) or at most (descending) the given bound, until visit
+    // returns false. Equal values come in row order both ways, as SortEngine orders them. The
+    // visitor must not change the store.
+    template <typename Visitor>
+    void walkInOrder(OrderedField field, bool ascending, uint64_t bound, Visitor visit) const {
+        ensureOrders();
+        std::shared_lock<std::shared_mutex> lock(orderLock);
+        const OrderedIndex& index = (field == PRICE_ORDER) ? priceOrder : quantityOrder;
+        if (ascending) {
+            index.forEachAscending(bound, [&](const OrderedIndex::Entry& entry) { return visit(entry.row); });
+            return;
+        }
+        // The index holds equal values by ascending row; hand each run of them over reversed
+        std::vector<uint32_t> run;
+        uint64_t runKey = 0;
+        bool stopped = false;
+        auto flush = [&]() {
+            for (auto row = run.rbegin(); row != run.rend() && !stopped; ++row) stopped = !visit(*row);
+            run.clear();
+            return !stopped;
+        };
+        index.forEachDescending(bound, [&](const OrderedIndex::Entry& entry) {
+            if (!run.empty() && entry.key != runKey && !flush()) return false;
+            runKey = entry.key;
+            run.push_back(entry.row);
+            return true;
+        });
+        flush();
+    }
+
+    template <typename Visitor>
+    void walkInOrder(OrderedField field, bool ascending, Visitor visit) const {
+        walkInOrder(field, ascending, ascending ? 0 : UINT64_MAX, visit);
+    }
+
+    // All live rows in price or quantity order, read off the index without sorting
+    std::vector<uint32_t> rowsInOrder(OrderedField field, bool ascending) const;
+
+    // The count rows with the highest (or lowest) values, best first
+    std::vector<uint32_t> topRows(OrderedField field, size_t count, bool highest) const;
+
+    // Rows priced within [low, high], cheapest first
+    std::vector<uint32_t> rowsWithPriceBetween(Money low, Money high) const;
+
+    // Rows with a quantity within [low, high], lowest first
+    std::vector<uint32_t> rowsWithQuantityBetween(int low, int high) const;
+
+    enum TextMatch { PREFIX_MATCH, SUBSTRING_MATCH, FUZZY_MATCH };
+
+    // Lowest trigram similarity a fuzzy match may have
+    static constexpr double FUZZY_THRESHOLD = 0.3;
+
+    // Rows whose ID or name starts with, contains, or (FUZZY_MATCH) resembles the text, ignoring
+    // case, best match first and at most limit of them (0 for all). Prefix and substring matches
+    // rank exact matches first, then earlier and shorter matches; fuzzy matches rank by similarity.
+    std::vector<uint32_t> searchText(std::string_view text, TextMatch match, size_t limit = 0) const;
+
+    // Removes the item with the given ID, returns false if it was not found
+    bool remove(std::string_view id);
+
+    // True once tombstones make up at least half of a non-trivial column set
+    bool needsCompaction() const;
+
+    // Moves live rows down over the tombstones so the columns are dense again and returns the
+    // number of rows moved. Handles to moved items go stale (look them up again by ID); handles
+    // to items that stayed put remain valid. Snapshots keep their own copy of changed chunks.
+    size_t compact();
+};
+
+inline ItemRef::operator bool() const { return columns != nullptr && columns->isCurrent(row, generation); }
+inline std::string_view ItemRef::getId() const { return columns->idAt(row); }
+inline std::string_view ItemRef::getName() const { return columns->nameAt(row); }
+inline int ItemRef::getQuantity() const { return columns->quantityAt(row); }
+inline Money ItemRef::getPrice() const { return columns->priceAt(row); }
+inline std::string_view ItemRef::getCategory() const { return columns->categoryAt(row); }
+
+// class used to let several threads (receiving docks, POS terminals) share one InventoryStore
+//
+// Readers take one of several read stripes, each a shared_mutex on its own cache line, so
+// readers on different cores never write to the same lock word and reads scale with cores.
+// Structural changes (add, remove, compaction) take every stripe exclusively. Quantity and
+// price updates only need a read stripe plus a per-item lock, which keeps the store and its
+// listeners (the change log) in the same order when two threads update the same item.
+// Quantity adjustments share that item lock with each other: the counter itself is updated
+// lock-free and applied deltas commute, so only absolute sets have to exclude them.
+// snapshot() hands out an InventoryView in O(1); while a view shares an item's chunk, an update
+// to that item falls back to holding every stripe so the chunk can be copied safely.
+class ConcurrentInventory {
+private:
+    static constexpr size_t READ_STRIPES = 16;
+    static constexpr size_t ITEM_LOCKS = 64;
+
+    struct alignas(64) ReadStripe { std::shared_mutex lock; };
+    struct alignas(64) ItemLock { std::shared_mutex lock; };
+
+    InventoryStore store;
+    mutable ReadStripe stripes[READ_STRIPES];
+    mutable ItemLock itemLocks[ITEM_LOCKS];  // Shared by rows with the same row % ITEM_LOCKS
+
+    // Threads are dealt stripes round-robin on first use and keep them
+    static size_t stripeOfThread();
+
+    class ReadGuard {
+    private:
+        std::shared_mutex& stripe;
+
+    public:
+        explicit ReadGuard(const ConcurrentInventory& owner) : stripe(owner.stripes[stripeOfThread()].lock) {
+            stripe.lock_shared();
+        }
+        ~ReadGuard() { stripe.unlock_shared(); }
+    };
+
+    // Takes the stripes in index order, so two writers can never deadlock
+    class WriteGuard {
+    private:
+        const ConcurrentInventory& owner;
+
+    public:
+        explicit WriteGuard(const ConcurrentInventory& inventory) : owner(inventory) {
+            for (auto& stripe : owner.stripes) stripe.lock.lock();
+        }
+        ~WriteGuard() {
+            for (size_t i = READ_STRIPES; i-- > 0;) owner.stripes[i].lock.unlock();
+        }
+    };
+
+    std::shared_mutex& itemLockOf(const ItemRef& item) const { return itemLocks[item.getRow() % ITEM_LOCKS].lock; }
+
+    // Runs update() under a read stripe and the item's lock (shared or exclusive), unless a
+    // snapshot shares the item's chunk; then it runs with every stripe held, which is the only
+    // time a chunk may be copied. Snapshots are only taken with every stripe held, so a chunk
+    // seen unshared here stays unshared until the stripe is released.
+    template <typename Result, typename Update>
+    Result updateItem(std::string_view id, bool sharedItemLock, Result notFound, Update update) {
+        {
+            ReadGuard guard(*this);
+            ItemRef item = store.find(id);
+            if (!item) return notFound;
+            if (!store.isShared(item.getRow())) {
+                std::shared_mutex& itemLock = itemLockOf(item);
+                if (sharedItemLock) {
+                    std::shared_lock<std::shared_mutex> itemGuard(itemLock);
+                    return update();
+                }
+                std::lock_guard<std::shared_mutex> itemGuard(itemLock);
+                return update();
+            }
+        }
+        WriteGuard guard(*this);
+        return update();
+    }
+
+public:
+    size_t size() const;
+    bool contains(std::string_view id) const;
+
+    // Copies the item out, strings included, so it can be kept after the lock is released
+    bool find(std::string_view id, Item& item) const;
+
+    // Runs reader(const InventoryStore&) under a read stripe; for search, display, sorting and filters
+    template <typename Reader>
+    auto read(Reader reader) const {
+        ReadGuard guard(*this);
+        return reader(static_cast<const InventoryStore&>(store));
+    }
+
+    // Runs writer(InventoryStore&) with every stripe held; for changes the methods below don't cover
+    template <typename Writer>
+    auto write(Writer writer) {
+        WriteGuard guard(*this);
+        return writer(store);
+    }
+
+    bool add(const Item& item);
+    bool remove(std::string_view id);
+    bool setQuantity(std::string_view id, int quantity);
+    bool setPrice(std::string_view id, Money price);
+    InventoryStore::AdjustResult adjustQuantity(std::string_view id, int delta,
+                                                InventoryStore::AdjustMode mode = InventoryStore::ALLOW_NEGATIVE,
+                                                int* quantity = nullptr);
+
+    // Takes the read stripe once for the whole batch, or every stripe if a snapshot
+    // shares one of the items' chunks
+    size_t adjustQuantities(const std::vector<InventoryStore::QuantityDelta>& deltas,
+                            InventoryStore::AdjustMode mode = InventoryStore::ALLOW_NEGATIVE,
+                            std::vector<InventoryStore::AdjustResult>* results = nullptr);
+
+    // Consistent view that readers can walk without holding any lock
+    InventoryView snapshot() const;
+
+    // Listeners are called from whichever thread made the change, so they must be thread-safe
+    void addListener(InventoryListener* listener);
+
+    void compactIfNeeded();
+};
+
+// class used to evaluate predicates over the quantity, price and category columns into bitmaps,
+// with AVX2 and SSE2 kernels chosen at runtime from the CPU features and a scalar fallback
+class FilterEngine {
+public:
+    enum Kernel { SCALAR, SSE2, AVX2 };
+
+private:
+    Kernel kernel;
+
+    static Kernel detectKernel();
+
+public:
+    FilterEngine() : kernel(detectKernel()) {}
+
+    Kernel getKernel() const { return kernel; }
+
+    // Lets tests and benchmarks compare kernels; a kernel the CPU lacks falls back to the detected one
+    void useKernel(Kernel requested) {
+        kernel = (requested <= detectKernel()) ? requested : detectKernel();
+    }
+
+    const char* getKernelName() const;
+
+    // Runs kernel(chunk, rows, bits) over every chunk, each writing its own words of the
+    // selection, then drops tombstoned rows since they hold stale values
+    template <typename ChunkKernel>
+    static SelectionBitmap scan(const ItemColumns& inventory, ChunkKernel kernel) {
+        STAT_SCOPE(STAT_FILTER);
+        SelectionBitmap selection(inventory.rowCount());
+        for (size_t c = 0; c < inventory.chunkCount(); ++c) {
+            const ItemChunk& chunk = inventory.getChunk(c);
+            uint64_t* bits = selection.data() + c * (CHUNK_ROWS / 64);
+            kernel(chunk, inventory.rowsInChunk(c), bits);
+            for (size_t w = 0; w < CHUNK_ROWS / 64 && c * CHUNK_ROWS + w * 64 < inventory.rowCount(); ++w) {
+                bits[w] &= chunk.live[w];
+            }
+        }
+        return selection;
+    }
+
+    SelectionBitmap quantityAtMost(const ItemColumns& inventory, int maximum) const;
+
+    // Inclusive on both ends
+    SelectionBitmap priceBetween(const ItemColumns& inventory, Money lowest, Money highest) const;
+
+    SelectionBitmap categoryEquals(const ItemColumns& inventory, uint8_t code) const;
+};
+
+// class used to add up what the stock is worth (price * quantity), exactly, in cents
+//
+// Prices are split into two 20-bit halves, so a quantity times a half stays under 2^51 and a
+// whole chunk adds up in plain 64-bit lanes; the halves are put back together once per chunk
+// in 128 bits. Exact for every price checkPrice accepts (under 2^40 cents). Blocks of 64 live
+// rows are summed without branches, which the compiler vectorizes; an AVX2 copy is used when
+// the CPU has it.
+class ValuationEngine {
+private:
+    bool avx2;
+
+public:
+    ValuationEngine();
+
+    // Value of the live rows of one chunk
+    MoneySum chunkValue(const ItemChunk& chunk) const;
+
+    MoneySum totalValue(const ItemColumns& inventory) const {
+        STAT_SCOPE(STAT_VALUATION);
+        MoneySum total = 0;
+        for (size_t c = 0; c < inventory.chunkCount(); ++c) total += chunkValue(inventory.getChunk(c));
+        return total;
+    }
+};
+
+// class used to aggregate the whole inventory in one pass: stock value, item counts and price
+// range per category, and how quantities are spread. Threads take contiguous chunk ranges, each
+// folds its rows into private totals, and the totals are merged at the end (a parallel reduction).
+class ReportEngine {
+public:
+    // Quantities fall into power-of-two buckets: 0 or less, 1, 2-3, 4-7, ... 2^30 and up
+    static constexpr size_t QUANTITY_BUCKETS = 32;
+    // Smaller inventories are not worth starting a thread for
+    static constexpr size_t MIN_CHUNKS_PER_THREAD = 64;
+
+    struct Totals {
+        size_t items = 0;
+        int64_t units = 0;       // Sum of the quantities
+        MoneySum value = 0;      // Sum of price times quantity, in cents
+        MoneySum priceSum = 0;   // For the average price
+        int64_t minCents = INT64_MAX;
+        int64_t maxCents = INT64_MIN;
+
+        void add(int quantity, int64_t cents) {
+            ++items;
+            units += quantity;
+            value += MoneySum(quantity) * cents;
+            priceSum += cents;
+            minCents = std::min(minCents, cents);
+            maxCents = std::max(maxCents, cents);
+        }
+
+        void merge(const Totals& other) {
+            items += other.items;
+            units += other.units;
+            value += other.value;
+            priceSum += other.priceSum;
+            minCents = std::min(minCents, other.minCents);
+            maxCents = std::max(maxCents, other.maxCents);
+        }
+
+        // Price accessors are only meaningful when items > 0
+        Money minPrice() const { return Money::fromCents(minCents); }
+        Money maxPrice() const { return Money::fromCents(maxCents); }
+        Money averagePrice() const {  // Rounded to the nearest cent
+            return Money::fromCents(static_cast<int64_t>((priceSum + MoneySum(items / 2)) / MoneySum(items)));
+        }
+    };
+
+    struct Report {
+        Totals overall;
+        std::vector<std::string_view> categoryNames;  // Views into the store's string pool
+        std::vector<Totals> categories;          // Indexed by category code, like categoryNames
+        uint64_t quantityHistogram[QUANTITY_BUCKETS] = {};
+        size_t threads = 0;
+        double milliseconds = 0;
+    };
+
+    static size_t quantityBucket(int quantity);
+
+    // Lowest quantity of a bucket (bucket 0 holds everything up to zero)
+    static int64_t bucketStart(size_t bucket) { return bucket == 0 ? 0 : int64_t(1) << (bucket - 1); }
+
+private:
+    struct Partial {
+        std::vector<Totals> categories;
+        uint64_t histogram[QUANTITY_BUCKETS] = {};
+    };
+
+    static void addChunk(const ItemChunk& chunk, Partial& partial);
+public:
+    // Builds the report with the given number of threads, or one per core (capped by the
+    // inventory size) when threads is 0. The inventory must not change while this runs.
+    Report build(const ItemColumns& inventory, size_t threads = 0) const;
+
+    // Writes the report as aligned tables, or tab-separated for spreadsheets and scripts
+    static void write(std::ostream& out, const Report& report, bool tabSeparated);
+};
+
+// class used to stream output into a file descriptor through one large buffer, so writing a
+// million rows takes a few dozen write calls and nothing is formatted twice
+class OutputBuffer {
+private:
+    static constexpr size_t CAPACITY = 1 << 20;
+
+    int fd;
+    std::string buffer;
+    bool failed;
+
+public:
+    explicit OutputBuffer(int descriptor) : fd(descriptor), failed(false) { buffer.reserve(CAPACITY + 4096); }
+
+    // Writes the whole range, retrying on short writes and interrupts
+    static bool writeAll(int fd, const char* data, size_t size);
+
+    void append(std::string_view text) { buffer.append(text); }
+    void append(char c) { buffer.push_back(c); }
+    void appendBytes(const void* data, size_t size) { buffer.append(static_cast<const char*>(data), size); }
+
+    void appendInteger(int64_t value);
+    void appendPrice(Money price);
+
+    // Called after every record; writes the buffer out once it is full
+    void recordDone();
+
+    // Returns false if this or any earlier write failed
+    bool flush();
+};
+
+// class used to save the inventory to a binary snapshot file and load it back at startup
+//
+// File layout (native byte order):
+//   SnapshotHeader | SnapshotRecord[itemCount] | string heap[heapSize]
+// Every record is fixed-width and points into the heap for its ID, name and category,
+// so loading is a single mmap plus one pass over the records. Only files of the current
+// VERSION load; files written by an older version are rejected.
+class InventorySnapshot {
+private:
+    static constexpr char MAGIC[8] = {'I', 'N', 'V', 'S', 'N', 'A', 'P', '\0'};
+    static constexpr uint32_t VERSION = 4;
+
+    struct SnapshotHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t recordSize;
+        uint64_t itemCount;
+        uint64_t heapSize;
+        uint64_t checkpointLsn;  // Last change log record contained in the snapshot
+    };
+
+    // Lengths are 32-bit like the offsets, so no string is too long to be saved
+    struct SnapshotRecord {
+        uint32_t idOffset;
+        uint32_t nameOffset;
+        uint32_t categoryOffset;
+        uint32_t idLength;
+        uint32_t nameLength;
+        uint32_t categoryLength;
+        int32_t quantity;
+        uint32_t reserved;  // Zero; keeps price aligned without uninitialized padding in the file
+        int64_t price;      // Cents
+    };
+    static_assert(sizeof(SnapshotHeader) == 40, "snapshot header must stay fixed-width");
+    static_assert(sizeof(SnapshotRecord) == 40, "snapshot records must stay fixed-width");
+
+    std::string path;
+    std::string errorMessage;
+    uint64_t checkpointLsn;
+
+    bool fail(const std::string& message);
+
+public:
+    InventorySnapshot(const std::string& snapshotPath) : path(snapshotPath), checkpointLsn(0) {}
+
+    const std::string& getPath() const { return path; }
+    const std::string& getError() const { return errorMessage; }
+
+    // The change log LSN the snapshot is up to date with: written by save(), read back by load()
+    // (0 when there was no snapshot) and passed to WriteAheadLog::replay
+    uint64_t getCheckpointLsn() const { return checkpointLsn; }
+    void setCheckpointLsn(uint64_t lsn) { checkpointLsn = lsn; }
+
+    // Writes the snapshot to a temporary file and renames it over the old one,
+    // so a crash mid-write never leaves a truncated snapshot behind. Accepts the store or
+    // an InventoryView, so a view lets writers carry on while the file is written.
+    // Saves every live item, or only the given rows in the given order (an export of a
+    // selection). Records and strings are streamed straight from the columns; a first pass
+    // over the rows sizes the heap so the header can go first.
+    bool save(const ItemColumns& inventory, const std::vector<uint32_t>* rows = nullptr);
+
+    // Maps the snapshot and adds every record to the inventory; a missing file is not an error
+    bool load(InventoryStore& inventory);
+
+private:
+    // IDs are saved the way the store keeps them: non-empty, alphanumeric and uppercase
+    static bool isStoredId(std::string_view id);
+
+    bool loadMapped(const char* data, size_t fileSize, InventoryStore& inventory);
+};
+
+// class used to journal every inventory change to an append-only log before it is confirmed
+//
+// Record layout (native byte order):
+//   uint32 payloadLength | uint32 crc32(lsn + type + payload) | uint64 lsn | uint8 type | payload
+// Appends are buffered and a background thread writes and fsyncs them in groups, at most
+// once per commit window, so many changes share one fsync. Replaying the log on top of the
+// last snapshot restores every confirmed change; a torn or corrupt tail is cut off.
+//
+// The log sequence number (LSN) keeps counting across checkpoints and restarts. A snapshot
+// records the LSN of the last change it holds and replay skips everything up to it, so a crash
+// between saving the snapshot and emptying the log never applies a change twice.
+class WriteAheadLog : public InventoryListener {
+private:
+    enum RecordType : uint8_t { RECORD_REMOVE = 2, RECORD_QUANTITY = 3, RECORD_ADJUST = 5, RECORD_ADD = 6, RECORD_PRICE = 7 };
+    static constexpr size_t RECORD_HEADER_SIZE = 2 * sizeof(uint32_t) + sizeof(uint64_t) + 1;
+
+    std::string path;
+    std::chrono::microseconds commitWindow;
+    bool waitForDurability;  // Block each change until its group has been fsynced
+    int fd;
+
+    mutable std::mutex logMutex;
+    std::condition_variable pendingCondition;  // Signalled when records are appended or on shutdown
+    std::condition_variable durableCondition;  // Signalled after every group commit
+    std::string pending;            // Encoded records waiting for the next group commit
+    std::string group;              // The flusher's buffer; swapped with pending so both keep their capacity
+    uint64_t appendedLsn;      // Sequence number of the last appended record
+    uint64_t durableLsn;       // Sequence number of the last fsynced record
+    bool writeFailed;
+    bool stopping;
+    bool flushing;             // The flusher is writing a group outside the lock
+    std::thread flusher;
+
+    struct Crc32Table {
+        uint32_t entries[256];
+        Crc32Table() {
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320U ^ (c >> 1) : c >> 1;
+                entries[i] = c;
+            }
+        }
+    };
+
+    static uint32_t crc32(const char* data, size_t size);
+
+    template <typename T>
+    static void put(std::string& out, T value) {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    static void putString(std::string& out, std::string_view str);
+
+    template <typename T>
+    static bool get(const char*& cursor, const char* end, T& value) {
+        if (static_cast<size_t>(end - cursor) < sizeof(T)) return false;
+        memcpy(&value, cursor, sizeof(T));
+        cursor += sizeof(T);
+        return true;
+    }
+
+    static bool getString(const char*& cursor, const char* end, std::string& str);
+
+    // Frames a record into the pending buffer, with encode(string&) appending the payload in
+    // place, and waits for its group commit if required
+    template <typename Encoder>
+    void append(RecordType type, Encoder encode) {
+        std::unique_lock<std::mutex> lock(logMutex);
+        if (fd < 0) return;  // Not opened, e.g. while replaying
+        bool wasEmpty = pending.empty();
+        size_t start = pending.size();
+        uint64_t lsn = ++appendedLsn;
+        pending.append(2 * sizeof(uint32_t), '\0');  // Length and checksum, filled in once the payload is known
+        put<uint64_t>(pending, lsn);
+        pending.push_back(static_cast<char>(type));
+        encode(pending);
+        uint32_t payloadLength = static_cast<uint32_t>(pending.size() - start - RECORD_HEADER_SIZE);
+        uint32_t checksum = crc32(pending.data() + start + 2 * sizeof(uint32_t), sizeof(uint64_t) + 1 + payloadLength);
+        memcpy(&pending[start], &payloadLength, sizeof(payloadLength));
+        memcpy(&pending[start + sizeof(uint32_t)], &checksum, sizeof(checksum));
+        // The flusher only waits for an empty buffer to fill, so bulk appends don't wake it each time
+        if (wasEmpty) pendingCondition.notify_one();
+
+        if (waitForDurability) {
+            durableCondition.wait(lock, [&] { return durableLsn >= lsn || writeFailed; });
+        }
+    }
+
+    // Background group commit: wait for work, let the window fill, then write and fsync once
+    void flushLoop();
+
+    static bool writeAll(int fd, const char* data, size_t size);
+
+    // Replaces the log with a copy holding only the records newer than lsn and reopens it; the
+    // caller holds logMutex with the flusher idle, so the file only holds whole, written records
+    bool keepRecordsAfter(uint64_t lsn);
+
+    // Applies one decoded record to the inventory, returns false if the payload is malformed
+    static bool apply(uint8_t type, const char* cursor, const char* end, InventoryStore& inventory);
+
+public:
+    WriteAheadLog(const std::string& logPath, std::chrono::microseconds window = std::chrono::milliseconds(2))
+        : path(logPath), commitWindow(window), waitForDurability(true), fd(-1),
+          appendedLsn(0), durableLsn(0), writeFailed(false), stopping(false), flushing(false) {}
+
+    ~WriteAheadLog() { close(); }
+
+    const std::string& getPath() const { return path; }
+
+    // When disabled, changes return as soon as they are buffered; call sync() to make them durable
+    void setWaitForDurability(bool wait) { waitForDurability = wait; }
+
+    // Reapplies every intact record newer than checkpointLsn (the snapshot's) to the inventory
+    // and cuts off a torn or corrupt tail. Must be called before open() so the replayed changes
+    // are not journaled again.
+    bool replay(InventoryStore& inventory, size_t& appliedCount, std::string& error, uint64_t checkpointLsn = 0);
+
+    // Opens the log for appending and starts the group commit thread
+    bool open(std::string& error);
+
+    // Blocks until every appended record is durable, returns false if a write failed
+    bool sync();
+
+    // LSN of the newest record, the one to store in a snapshot taken now
+    uint64_t getLastLsn() const;
+
+    // Drops the records a snapshot holds, those up to snapshotLsn, once they are durable. It runs
+    // with the log locked and the flusher idle, so nothing appended or being written meanwhile is
+    // cut off: the log is emptied only if every written record is in the snapshot, otherwise it
+    // is rewritten with just the newer records.
+    bool checkpoint(uint64_t snapshotLsn);
+
+    // Flushes the remaining records and stops the group commit thread
+    void close();
+
+    void onAdd(const ItemRef& item) override;
+    void onRemove(std::string_view id) override;
+    void onQuantityChange(std::string_view id, int quantity) override;
+    void onPriceChange(std::string_view id, Money price) override;
+
+    // Deltas are logged instead of the new quantity: concurrent adjustments may reach the log
+    // in a different order than they hit the counter, and a sum does not depend on order
+    void onQuantityAdjust(std::string_view id, int delta, int /*quantity*/) override;
+};
+
+// class used to order items by one or more keys without copying or moving any Item
+class SortEngine {
+public:
+    enum SortField { BY_CATEGORY, BY_PRICE, BY_QUANTITY };
+
+    struct SortKey {
+        SortField field;
+        bool ascending;
+    };
+
+    // Returns rows of the inventory in sorted order; keys are listed from most to least significant
+    std::vector<uint32_t> sortedOrder(const ItemColumns& inventory, const std::vector<SortKey>& keys) const;
+
+    // Sorts only the given live rows, e.g. a filter's selection; ties keep the order given
+    std::vector<uint32_t> sortedOrder(const ItemColumns& inventory, const std::vector<uint32_t>& rows,
+                                      const std::vector<SortKey>& keys) const;
+
+    // Same order as sortedOrder, read off the store's price and quantity indexes when the keys
+    // are a price or quantity key, optionally after a category key: the walk already yields the
+    // order, and grouping it by category keeps that order inside each group. Anything else is sorted.
+    std::vector<uint32_t> indexedOrder(const InventoryStore& inventory, const std::vector<SortKey>& keys) const;
+
+private:
+    // Compact (key, index) pair that is sorted instead of the items
+    struct KeyIndex {
+        uint64_t key;
+        uint32_t index;
+    };
+
+    // Alphabetical rank of every category code in the dictionary, used as the sort key
+    static std::vector<uint64_t> rankCategories(const std::vector<std::string_view>& categoryNames);
+
+    // Stable LSD radix sort on the 64-bit key, one byte per pass; passes where every key shares the byte are skipped
+    static void radixSort(std::vector<KeyIndex>& entries, std::vector<KeyIndex>& scratch);
+};
+
+// class used to load supplier catalogs from CSV or TSV files in bulk
+//
+// The file is mapped into memory and cut at line breaks into one chunk per hardware thread.
+// Each thread splits, unquotes and validates its rows with the same rules as ItemValidation;
+// the valid rows are then added in file order on the calling thread, where the ID index turns
+// away IDs already in the inventory or earlier in the file. Fields are separated by tabs if
+// the first line has one, commas otherwise. A first line naming the columns (category, id,
+// price, quantity, name in any order) is a header; without one the columns are in ADD order.
+// Quoted fields may hold the separator and "" but not line breaks.
+class CsvImporter {
+public:
+    struct Report {
+        size_t rows = 0;      // Non-empty data lines
+        size_t imported = 0;
+        size_t rejected = 0;
+        double milliseconds = 0;
+    };
+
+private:
+    enum Column { CATEGORY_COLUMN, ID_COLUMN, PRICE_COLUMN, QUANTITY_COLUMN, NAME_COLUMN, COLUMN_COUNT };
+    enum RowError : uint8_t { ROW_OK, BAD_FIELD_COUNT, BAD_QUOTES, BAD_CATEGORY, BAD_ID, BAD_PRICE, BAD_QUANTITY };
+
+    static constexpr size_t MIN_CHUNK_BYTES = 1 << 20;  // Smaller files are not worth another thread
+    static constexpr size_t MAX_FIELDS = 16;
+
+    // One parsed line; the ID (uppercased) and name, or the offending field of a rejected row,
+    // are kept in the chunk's text buffer
+    struct ParsedRow {
+        uint32_t line;  // Line number within the chunk, from 0
+        uint32_t idOffset, idLength;
+        uint32_t nameOffset, nameLength;
+        int quantity;
+        Money price;
+        Category category;
+        RowError error;
+        NumberStatus numberError;  // Why the price or quantity was turned down
+    };
+
+    struct Chunk {
+        const char* begin;
+        const char* end;
+        size_t lines = 0;  // Line breaks inside the chunk
+        std::vector<ParsedRow> rows;
+        std::string text;
+    };
+
+    InventoryStore& inventory;
+    std::string errorMessage;
+
+    char separator;
+    int columns[COLUMN_COUNT];  // Field index of every column
+    size_t fieldsNeeded;
+
+    // Splits one line into fields, unquoting quoted ones into scratch; false on a stray quote
+    bool splitLine(std::string_view line, std::string_view* fields, size_t& count, std::string& scratch) const;
+
+    static bool isAlphanumeric(std::string_view field);
+
+    // Parses every line of the chunk into rows; runs on a worker thread
+    void parseChunk(Chunk& chunk) const;
+
+    // Reason a row was rejected; the offending field is stored where the ID would be
+    std::string describe(const Chunk& chunk, const ParsedRow& row) const;
+
+    // Reads the column order from a header line; false if the line is data
+    bool readHeader(std::string_view line);
+
+public:
+    CsvImporter(InventoryStore& inv) : inventory(inv) {}
+
+    const std::string& getError() const { return errorMessage; }
+
+    // Imports the file, writing "path:line: reason" to log for every rejected row; false if the
+    // file can't be read
+    bool import(const std::string& path, Report& report, std::ostream& log);
+};
+
+// class used to write a selection of items to a file for other tools: CSV (readable by
+// CsvImporter), JSON Lines, or the binary snapshot format (loadable by InventorySnapshot)
+//
+// The caller pushes the filter and sort down into the row list; the exporter then streams each
+// row from the columns into one large output buffer without building an Item or a line string.
+class InventoryExporter {
+public:
+    enum Format { CSV_FORMAT, JSONL_FORMAT, BINARY_FORMAT };
+
+private:
+    std::string errorMessage;
+
+    // Quotes the field if it holds a comma, a quote, a line break or outer spaces
+    static void appendCsvField(OutputBuffer& out, std::string_view field);
+
+    static void appendJsonString(OutputBuffer& out, std::string_view text);
+
+public:
+    const std::string& getError() const { return errorMessage; }
+
+    // Parses CSV, JSONL or BINARY (case-insensitive)
+    static bool parseFormat(std::string_view name, Format& format);
+
+    // Writes the rows, in the given order, to path; false (see getError) if it can't be written
+    bool write(const std::string& path, Format format, const ItemColumns& inventory, const std::vector<uint32_t>& rows);
+};
+
+// Outcome of an InventoryCore change; nothing was changed unless it is ITEM_OK
+enum ItemStatus : uint8_t { ITEM_OK, ITEM_INVALID_ID, ITEM_INVALID_CATEGORY, ITEM_INVALID_QUANTITY, ITEM_INVALID_PRICE,
+                            ITEM_DUPLICATE_ID, ITEM_NOT_FOUND, ITEM_INSUFFICIENT_STOCK, ITEM_QUANTITY_OUT_OF_RANGE };
+
+const char* describeItem(ItemStatus status);
+
+// class used to run the inventory operations without a console, for the menus, batch runs,
+// benchmarks and any program embedding the store: every change is checked with the same rules
+// the menus use and reports a status code, every query returns the matching items
+class InventoryCore {
+private:
+    InventoryStore& inventory;
+    ItemValidation validation;
+    SortEngine sortEngine;
+    FilterEngine filter;
+    std::string idBuffer;  // Uppercased ID of the item being added, reused so steady adds don't allocate
+
+    std::vector<ItemRef> itemsAt(const std::vector<uint32_t>& rows) const;
+    std::vector<ItemRef> itemsIn(const SelectionBitmap& selection) const;
+
+public:
+    // Quantity at or below which an item counts as low on stock
+    static constexpr int DEFAULT_LOW_STOCK = 5;
+
+    InventoryCore(InventoryStore& inv) : inventory(inv) {}
+
+    const InventoryStore& getStore() const { return inventory; }
+
+    // IDs are kept in uppercase; lookups ignore case either way. The result is a view of idBuffer,
+    // valid until the next call, so adding items reuses one buffer instead of copying every ID.
+    std::string_view normalizeId(std::string_view id);
+
+    bool isDuplicateId(std::string_view id) const { return inventory.contains(id); }
+
+    // Empty ItemRef if there is no item with the ID
+    ItemRef findItem(std::string_view id) const { return inventory.find(id); }
+
+    ItemStatus addItem(std::string_view id, std::string_view name, int quantity, Money price, std::string_view category);
+    ItemStatus setQuantity(std::string_view id, int quantity);
+    ItemStatus setPrice(std::string_view id, Money price);
+
+    // Relative change, e.g. +10 for a delivery or -2 for a sale; by default it refuses to take
+    // out more than is in stock
+    ItemStatus adjustQuantity(std::string_view id, int delta,
+                              InventoryStore::AdjustMode mode = InventoryStore::REJECT_IF_INSUFFICIENT);
+
+    ItemStatus removeItem(std::string_view id);
+
+    // The queries below return handles, which go stale once their item is removed
+
+    std::vector<ItemRef> itemsInCategory(Category category) const;
+    std::vector<ItemRef> lowStockItems(int threshold = DEFAULT_LOW_STOCK) const;
+    std::vector<ItemRef> sortedItems(const std::vector<SortEngine::SortKey>& keys) const;
+
+    // Best match first, at most limit items (0 for all)
+    std::vector<ItemRef> searchItems(std::string_view text, InventoryStore::TextMatch match, size_t limit = 0) const;
+
+    // Price * quantity over every item, in cents
+    MoneySum totalValue() const { return ValuationEngine().totalValue(inventory); }
+
+    // Value, counts and price range per category plus the quantity histogram, see ReportEngine
+    ReportEngine::Report stockReport(size_t threads = 0) const { return ReportEngine().build(inventory, threads); }
+};
+
+#endif
@@ -0,0 +1,433 @@
+// Out-of-line parts of the engines: the filter and valuation kernels, the parallel report
+// and the sort
+#include "inventory_core.h"
+
+// Scalar kernels, also used for the tail that does not fill a vector
+static void quantityAtMostScalar(const int* quantities, size_t begin, size_t end, int maximum, uint64_t* bits) {
+    for (size_t i = begin; i < end; ++i) {
+        bits[i / 64] |= uint64_t(quantities[i] <= maximum) << (i % 64);
+    }
+}
+
+static void priceBetweenScalar(const int64_t* prices, size_t begin, size_t end, int64_t low, int64_t high, uint64_t* bits) {
+    for (size_t i = begin; i < end; ++i) {
+        bits[i / 64] |= uint64_t(prices[i] >= low && prices[i] <= high) << (i % 64);
+    }
+}
+
+static void categoryEqualsScalar(const uint8_t* codes, size_t begin, size_t end, uint8_t code, uint64_t* bits) {
+    for (size_t i = begin; i < end; ++i) {
+        bits[i / 64] |= uint64_t(codes[i] == code) << (i % 64);
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// Each vector step produces a group of bits that never straddles a 64-bit word
+__attribute__((target("sse2")))
+static size_t quantityAtMostSse2(const int* quantities, size_t count, int maximum, uint64_t* bits) {
+    __m128i limit = _mm_set1_epi32(maximum);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(quantities + i));
+        uint64_t over = static_cast<uint64_t>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(values, limit))));
+        bits[i / 64] |= (~over & 0xF) << (i % 64);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t quantityAtMostAvx2(const int* quantities, size_t count, int maximum, uint64_t* bits) {
+    __m256i limit = _mm256_set1_epi32(maximum);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(quantities + i));
+        uint64_t over = static_cast<uint64_t>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(values, limit))));
+        bits[i / 64] |= (~over & 0xFF) << (i % 64);
+    }
+    return i;
+}
+
+// A price is inside when price - low and high - price are both non-negative, so one OR and
+// the sign bits do the job; SSE2 has no 64-bit compare. Bounds are clamped by priceBetween
+// so neither subtraction can overflow.
+__attribute__((target("sse2")))
+static size_t priceBetweenSse2(const int64_t* prices, size_t count, int64_t low, int64_t high, uint64_t* bits) {
+    __m128i lower = _mm_set1_epi64x(low), upper = _mm_set1_epi64x(high);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prices + i));
+        __m128i outside = _mm_or_si128(_mm_sub_epi64(values, lower), _mm_sub_epi64(upper, values));
+        uint64_t negative = static_cast<uint64_t>(_mm_movemask_pd(_mm_castsi128_pd(outside)));
+        bits[i / 64] |= (~negative & 0x3) << (i % 64);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t priceBetweenAvx2(const int64_t* prices, size_t count, int64_t low, int64_t high, uint64_t* bits) {
+    __m256i lower = _mm256_set1_epi64x(low), upper = _mm256_set1_epi64x(high);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256i values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(prices + i));
+        __m256i outside = _mm256_or_si256(_mm256_sub_epi64(values, lower), _mm256_sub_epi64(upper, values));
+        uint64_t negative = static_cast<uint64_t>(_mm256_movemask_pd(_mm256_castsi256_pd(outside)));
+        bits[i / 64] |= (~negative & 0xF) << (i % 64);
+    }
+    return i;
+}
+
+__attribute__((target("sse2")))
+static size_t categoryEqualsSse2(const uint8_t* codes, size_t count, uint8_t code, uint64_t* bits) {
+    __m128i wanted = _mm_set1_epi8(static_cast<char>(code));
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(codes + i));
+        uint64_t equal = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(values, wanted)));
+        bits[i / 64] |= equal << (i % 64);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t categoryEqualsAvx2(const uint8_t* codes, size_t count, uint8_t code, uint64_t* bits) {
+    __m256i wanted = _mm256_set1_epi8(static_cast<char>(code));
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(codes + i));
+        uint64_t equal = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(values, wanted)));
+        bits[i / 64] |= equal << (i % 64);
+    }
+    return i;
+}
+#endif
+
+FilterEngine::Kernel FilterEngine::detectKernel() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return AVX2;
+    if (__builtin_cpu_supports("sse2")) return SSE2;
+#endif
+    return SCALAR;
+}
+
+const char* FilterEngine::getKernelName() const {
+    switch (kernel) {
+        case AVX2: return "avx2";
+        case SSE2: return "sse2";
+        default: return "scalar";
+    }
+}
+
+SelectionBitmap FilterEngine::quantityAtMost(const ItemColumns& inventory, int maximum) const {
+    return scan(inventory, [&](const ItemChunk& chunk, size_t rows, uint64_t* bits) {
+        size_t done = 0;
+#if defined(__x86_64__) || defined(__i386__)
+        if (kernel == AVX2) done = quantityAtMostAvx2(chunk.quantities, rows, maximum, bits);
+        else if (kernel == SSE2) done = quantityAtMostSse2(chunk.quantities, rows, maximum, bits);
+#endif
+        quantityAtMostScalar(chunk.quantities, done, rows, maximum, bits);
+    });
+}
+
+SelectionBitmap FilterEngine::priceBetween(const ItemColumns& inventory, Money lowest, Money highest) const {
+    // Stored prices are far below 2^62 cents, so clamping the bounds there changes no result
+    const int64_t LIMIT = int64_t(1) << 62;
+    int64_t low = std::max(-LIMIT, std::min(LIMIT, lowest.getCents()));
+    int64_t high = std::max(-LIMIT, std::min(LIMIT, highest.getCents()));
+    return scan(inventory, [&](const ItemChunk& chunk, size_t rows, uint64_t* bits) {
+        size_t done = 0;
+#if defined(__x86_64__) || defined(__i386__)
+        if (kernel == AVX2) done = priceBetweenAvx2(chunk.prices, rows, low, high, bits);
+        else if (kernel == SSE2) done = priceBetweenSse2(chunk.prices, rows, low, high, bits);
+#endif
+        priceBetweenScalar(chunk.prices, done, rows, low, high, bits);
+    });
+}
+
+SelectionBitmap FilterEngine::categoryEquals(const ItemColumns& inventory, uint8_t code) const {
+    return scan(inventory, [&](const ItemChunk& chunk, size_t rows, uint64_t* bits) {
+        size_t done = 0;
+#if defined(__x86_64__) || defined(__i386__)
+        if (kernel == AVX2) done = categoryEqualsAvx2(chunk.categoryCodes, rows, code, bits);
+        else if (kernel == SSE2) done = categoryEqualsSse2(chunk.categoryCodes, rows, code, bits);
+#endif
+        categoryEqualsScalar(chunk.categoryCodes, done, rows, code, bits);
+    });
+}
+
+// Prices are split into two halves of HALF_BITS bits for ValuationEngine, see there
+static constexpr int HALF_BITS = 20;
+static constexpr int64_t HALF_MASK = (int64_t(1) << HALF_BITS) - 1;
+
+struct ValuationSums {
+    int64_t low = 0;   // Quantities times the low halves
+    int64_t high = 0;  // Quantities times the high halves
+};
+
+__attribute__((always_inline))
+static inline void addBlock(const int* quantities, const int64_t* prices, ValuationSums& sums) {
+    int64_t low = 0, high = 0;
+    for (size_t i = 0; i < 64; ++i) {
+        low += int64_t(quantities[i]) * int32_t(prices[i] & HALF_MASK);
+        high += int64_t(quantities[i]) * int32_t(prices[i] >> HALF_BITS);
+    }
+    sums.low += low;
+    sums.high += high;
+}
+
+static void addBlockScalar(const int* quantities, const int64_t* prices, ValuationSums& sums) {
+    addBlock(quantities, prices, sums);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+static void addBlockAvx2(const int* quantities, const int64_t* prices, ValuationSums& sums) {
+    addBlock(quantities, prices, sums);
+}
+#endif
+
+ValuationEngine::ValuationEngine() : avx2(false) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    avx2 = __builtin_cpu_supports("avx2");
+#endif
+}
+
+MoneySum ValuationEngine::chunkValue(const ItemChunk& chunk) const {
+    ValuationSums sums;
+    for (size_t w = 0; w < CHUNK_ROWS / 64; ++w) {
+        uint64_t word = chunk.live[w];
+        const int* quantities = chunk.quantities + w * 64;
+        const int64_t* prices = chunk.prices + w * 64;
+        if (word == ~0ULL) {
+#if defined(__x86_64__) || defined(__i386__)
+            if (avx2) {
+                addBlockAvx2(quantities, prices, sums);
+                continue;
+            }
+#endif
+            addBlockScalar(quantities, prices, sums);
+            continue;
+        }
+        while (word != 0) {  // Blocks with dead rows, row by row
+            int i = __builtin_ctzll(word);
+            sums.low += int64_t(quantities[i]) * (prices[i] & HALF_MASK);
+            sums.high += int64_t(quantities[i]) * (prices[i] >> HALF_BITS);
+            word &= word - 1;
+        }
+    }
+    return MoneySum(sums.high) * (int64_t(1) << HALF_BITS) + sums.low;
+}
+
+size_t ReportEngine::quantityBucket(int quantity) {
+    return quantity <= 0 ? 0 : 32 - static_cast<size_t>(__builtin_clz(static_cast<unsigned>(quantity)));
+}
+
+void ReportEngine::addChunk(const ItemChunk& chunk, Partial& partial) {
+    Totals* categories = partial.categories.data();
+    for (size_t w = 0; w < CHUNK_ROWS / 64; ++w) {
+        uint64_t word = chunk.live[w];
+        while (word != 0) {
+            size_t i = w * 64 + static_cast<size_t>(__builtin_ctzll(word));
+            int quantity = chunk.quantities[i];
+            categories[chunk.categoryCodes[i]].add(quantity, chunk.prices[i]);
+            ++partial.histogram[quantityBucket(quantity)];
+            word &= word - 1;
+        }
+    }
+}
+
+ReportEngine::Report ReportEngine::build(const ItemColumns& inventory, size_t threads) const {
+    STAT_SCOPE(STAT_REPORT);
+    auto start = std::chrono::steady_clock::now();
+    size_t chunkCount = inventory.chunkCount();
+    if (threads == 0) {
+        threads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), chunkCount / MIN_CHUNKS_PER_THREAD + 1);
+    }
+    threads = std::max<size_t>(1, std::min(threads, std::max<size_t>(chunkCount, 1)));
+
+    const std::vector<std::string_view>& names = inventory.getCategoryNames();
+    std::vector<Partial> partials(threads);
+    for (auto& partial : partials) partial.categories.resize(names.size());
+    auto reduce = [&](size_t part) {
+        for (size_t c = chunkCount * part / threads; c < chunkCount * (part + 1) / threads; ++c) {
+            addChunk(inventory.getChunk(c), partials[part]);
+        }
+    };
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < threads; ++i) workers.emplace_back(reduce, i);
+    reduce(0);
+    for (auto& worker : workers) worker.join();
+
+    Report report;
+    report.categoryNames = names;
+    report.categories.resize(names.size());
+    for (const auto& partial : partials) {
+        for (size_t code = 0; code < names.size(); ++code) report.categories[code].merge(partial.categories[code]);
+        for (size_t b = 0; b < QUANTITY_BUCKETS; ++b) report.quantityHistogram[b] += partial.histogram[b];
+    }
+    for (const auto& totals : report.categories) report.overall.merge(totals);
+    report.threads = threads;
+    report.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return report;
+}
+
+void ReportEngine::write(std::ostream& out, const Report& report, bool tabSeparated) {
+    auto sum = [](MoneySum cents) {
+        char digits[48];
+        char* end = digits + sizeof(digits);
+        return std::string(formatCents(cents, end), end);
+    };
+    auto price = [](const Totals& totals, Money money) {
+        if (totals.items == 0) return std::string("-");
+        std::ostringstream text;
+        text << money;
+        return text.str();
+    };
+    auto row = [&](std::string_view name, const Totals& totals) {
+        std::string minimum = price(totals, totals.minPrice()), maximum = price(totals, totals.maxPrice());
+        std::string average = price(totals, totals.items == 0 ? Money() : totals.averagePrice());
+        if (tabSeparated) {
+            out << name << '\t' << totals.items << '\t' << totals.units << '\t' << sum(totals.value) << '\t'
+                << minimum << '\t' << maximum << '\t' << average << '\n';
+        } else {
+            out << std::left << std::setw(16) << name << std::right << std::setw(12) << totals.items
+                << std::setw(14) << totals.units << std::setw(22) << sum(totals.value) << std::setw(16) << minimum
+                << std::setw(16) << maximum << std::setw(16) << average << '\n';
+        }
+    };
+
+    if (tabSeparated) {
+        out << "category\titems\tunits\tvalue\tmin_price\tmax_price\tavg_price\n";
+    } else {
+        out << std::left << std::setw(16) << "CATEGORY" << std::right << std::setw(12) << "ITEMS" << std::setw(14)
+            << "UNITS" << std::setw(22) << "STOCK VALUE" << std::setw(16) << "MIN PRICE" << std::setw(16) << "MAX PRICE"
+            << std::setw(16) << "AVG PRICE" << "\n";
+        out << std::string(112, '-') << "\n";
+    }
+    for (size_t code = 0; code < report.categories.size(); ++code) {
+        row(report.categoryNames[code], report.categories[code]);
+    }
+    if (!tabSeparated) out << std::string(112, '-') << "\n";
+    row(tabSeparated ? "total" : "TOTAL", report.overall);
+
+    // Histogram from the first to the last bucket that holds any item
+    size_t first = 0, last = QUANTITY_BUCKETS;
+    while (first < QUANTITY_BUCKETS && report.quantityHistogram[first] == 0) ++first;
+    while (last > first && report.quantityHistogram[last - 1] == 0) --last;
+    uint64_t largest = 0;
+    for (size_t b = first; b < last; ++b) largest = std::max(largest, report.quantityHistogram[b]);
+
+    out << "\n" << (tabSeparated ? "quantity\titems\n" : "QUANTITY           ITEMS\n");
+    for (size_t b = first; b < last; ++b) {
+        std::string label = (b == 0) ? "<=0" : std::to_string(bucketStart(b));
+        if (b > 1) label += "-" + std::to_string(bucketStart(b + 1) - 1);
+        uint64_t count = report.quantityHistogram[b];
+        if (tabSeparated) {
+            out << label << '\t' << count << '\n';
+        } else {
+            size_t bar = static_cast<size_t>((count * 40 + largest - 1) / largest);
+            out << std::left << std::setw(16) << label << std::right << std::setw(8) << count << "  "
+                << std::string(bar, '#') << '\n';
+        }
+    }
+}
+
+std::vector<uint32_t> SortEngine::sortedOrder(const ItemColumns& inventory, const std::vector<SortKey>& keys) const {
+    std::vector<uint32_t> rows;
+    rows.reserve(inventory.size());
+    inventory.forEachLiveRow([&](size_t row) {  // Tombstoned rows are left out
+        rows.push_back(static_cast<uint32_t>(row));
+    });
+    return sortedOrder(inventory, rows, keys);
+}
+
+std::vector<uint32_t> SortEngine::sortedOrder(const ItemColumns& inventory, const std::vector<uint32_t>& rows,
+                                              const std::vector<SortKey>& keys) const {
+    STAT_SCOPE(STAT_SORT);
+    std::vector<KeyIndex> entries(rows.size());
+    std::vector<KeyIndex> scratch(rows.size());
+    for (size_t i = 0; i < rows.size(); ++i) {
+        entries[i].index = rows[i];
+    }
+
+    // LSD over the keys: sort by the least significant key first, the stable passes keep its order for ties
+    for (size_t k = keys.size(); k-- > 0;) {
+        std::vector<uint64_t> categoryRanks;
+        if (keys[k].field == BY_CATEGORY) categoryRanks = rankCategories(inventory.getCategoryNames());
+
+        for (auto& entry : entries) {
+            uint64_t key = 0;
+            switch (keys[k].field) {
+                case BY_CATEGORY: key = categoryRanks[inventory.categoryCodeAt(entry.index)]; break;
+                case BY_PRICE: key = OrderedIndex::priceKey(inventory.priceAt(entry.index)); break;
+                case BY_QUANTITY: key = OrderedIndex::quantityKey(inventory.quantityAt(entry.index)); break;
+            }
+            entry.key = keys[k].ascending ? key : ~key;
+        }
+        radixSort(entries, scratch);
+    }
+
+    std::vector<uint32_t> order(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        order[i] = entries[i].index;
+    }
+    return order;
+}
+
+std::vector<uint32_t> SortEngine::indexedOrder(const InventoryStore& inventory, const std::vector<SortKey>& keys) const {
+    bool grouped = keys.size() == 2 && keys[0].field == BY_CATEGORY;
+    const SortKey& last = keys.empty() ? SortKey{BY_CATEGORY, true} : keys.back();
+    if (last.field == BY_CATEGORY || keys.size() > 2 || (keys.size() == 2 && !grouped)) {
+        return sortedOrder(inventory, keys);
+    }
+
+    STAT_SCOPE(STAT_SORT);  // After the fallback, which sortedOrder times itself
+    InventoryStore::OrderedField field = (last.field == BY_PRICE) ? InventoryStore::PRICE_ORDER
+                                                                  : InventoryStore::QUANTITY_ORDER;
+    if (!grouped) return inventory.rowsInOrder(field, last.ascending);
+
+    std::vector<uint64_t> ranks = rankCategories(inventory.getCategoryNames());
+    std::vector<std::vector<uint32_t>> groups(ranks.size());
+    inventory.walkInOrder(field, last.ascending, [&](uint32_t row) {
+        uint64_t rank = ranks[inventory.categoryCodeAt(row)];
+        groups[keys[0].ascending ? rank : ranks.size() - 1 - rank].push_back(row);
+        return true;
+    });
+    std::vector<uint32_t> order;
+    order.reserve(inventory.size());
+    for (const auto& group : groups) order.insert(order.end(), group.begin(), group.end());
+    return order;
+}
+
+std::vector<uint64_t> SortEngine::rankCategories(const std::vector<std::string_view>& categoryNames) {
+    std::vector<uint64_t> ranks(categoryNames.size());
+    for (size_t code = 0; code < categoryNames.size(); ++code) {
+        for (const auto& other : categoryNames) {
+            if (other < categoryNames[code]) ranks[code]++;
+        }
+    }
+    return ranks;
+}
+
+void SortEngine::radixSort(std::vector<KeyIndex>& entries, std::vector<KeyIndex>& scratch) {
+    size_t n = entries.size();
+    for (int shift = 0; shift < 64; shift += 8) {
+        size_t counts[256] = {0};
+        for (const auto& entry : entries) {
+            counts[(entry.key >> shift) & 0xFF]++;
+        }
+        if (counts[(entries.empty() ? 0 : entries[0].key >> shift) & 0xFF] == n) continue;
+
+        size_t offset = 0;
+        for (size_t& count : counts) {
+            size_t c = count;
+            count = offset;
+            offset += c;
+        }
+        for (const auto& entry : entries) {
+            scratch[counts[(entry.key >> shift) & 0xFF]++] = entry;
+        }
+        entries.swap(scratch);
+    }
+}
@@ -0,0 +1,846 @@
+// Out-of-line parts of persistence and file formats: snapshots, the write-ahead log, CSV
+// imports and the exporters
+#include "inventory_core.h"
+
+bool OutputBuffer::writeAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+void OutputBuffer::appendInteger(int64_t value) {
+    char digits[24];
+    char* end = digits + sizeof(digits);
+    char* start = formatInteger(value, end);
+    buffer.append(start, end - start);
+}
+
+void OutputBuffer::appendPrice(Money price) {
+    char digits[32];
+    char* end = digits + sizeof(digits);
+    char* start = price.format(end);
+    buffer.append(start, end - start);
+}
+
+void OutputBuffer::recordDone() {
+    if (buffer.size() >= CAPACITY) flush();
+}
+
+bool OutputBuffer::flush() {
+    if (!failed && !buffer.empty()) failed = !writeAll(fd, buffer.data(), buffer.size());
+    buffer.clear();
+    return !failed;
+}
+
+bool InventorySnapshot::fail(const std::string& message) {
+    errorMessage = message + (errno ? std::string(" (") + strerror(errno) + ")" : "");
+    return false;
+}
+
+bool InventorySnapshot::save(const ItemColumns& inventory, const std::vector<uint32_t>* rows) {
+    STAT_SCOPE(STAT_SNAPSHOT_SAVE);
+    errno = 0;
+    auto forEachRow = [&](auto visit) {
+        if (rows != nullptr) {
+            for (uint32_t row : *rows) visit(row);
+        } else {
+            inventory.forEachLiveRow([&](size_t row) { visit(static_cast<uint32_t>(row)); });
+        }
+    };
+
+    uint64_t heapSize = 0;
+    forEachRow([&](uint32_t row) {
+        heapSize += inventory.idAt(row).size() + inventory.nameAt(row).size() + inventory.categoryAt(row).size();
+    });
+    if (heapSize > UINT32_MAX) return fail("Snapshot string heap exceeds 4 GiB");
+
+    SnapshotHeader header;
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.recordSize = sizeof(SnapshotRecord);
+    header.itemCount = (rows != nullptr) ? rows->size() : inventory.size();
+    header.heapSize = heapSize;
+    header.checkpointLsn = checkpointLsn;
+
+    std::string tempPath = path + ".tmp";
+    int fd = ::open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return fail("Cannot create " + tempPath);
+
+    OutputBuffer out(fd);
+    out.appendBytes(&header, sizeof(header));
+    uint32_t offset = 0;
+    forEachRow([&](uint32_t row) {
+        SnapshotRecord record;
+        record.idLength = static_cast<uint32_t>(inventory.idAt(row).size());
+        record.nameLength = static_cast<uint32_t>(inventory.nameAt(row).size());
+        record.categoryLength = static_cast<uint32_t>(inventory.categoryAt(row).size());
+        record.idOffset = offset;
+        record.nameOffset = record.idOffset + record.idLength;
+        record.categoryOffset = record.nameOffset + record.nameLength;
+        offset = record.categoryOffset + record.categoryLength;
+        record.quantity = inventory.quantityAt(row);
+        record.reserved = 0;
+        record.price = inventory.priceAt(row).getCents();
+        out.appendBytes(&record, sizeof(record));
+        out.recordDone();
+    });
+    forEachRow([&](uint32_t row) {
+        out.append(inventory.idAt(row));
+        out.append(inventory.nameAt(row));
+        out.append(inventory.categoryAt(row));
+        out.recordDone();
+    });
+
+    bool ok = out.flush() && ::fsync(fd) == 0;
+    ::close(fd);
+    if (!ok) {
+        ::unlink(tempPath.c_str());
+        return fail("Cannot write " + tempPath);
+    }
+    if (::rename(tempPath.c_str(), path.c_str()) != 0) {
+        ::unlink(tempPath.c_str());
+        return fail("Cannot replace " + path);
+    }
+
+    // Make the rename itself durable
+    size_t slash = path.find_last_of('/');
+    std::string directory = (slash == std::string::npos) ? "." : path.substr(0, slash + 1);
+    int dirFd = ::open(directory.c_str(), O_RDONLY);
+    if (dirFd >= 0) {
+        ::fsync(dirFd);
+        ::close(dirFd);
+    }
+    return true;
+}
+
+bool InventorySnapshot::load(InventoryStore& inventory) {
+    STAT_SCOPE(STAT_SNAPSHOT_LOAD);
+    errno = 0;
+    checkpointLsn = 0;
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        if (errno == ENOENT) {
+            errno = 0;
+            return true;  // Nothing saved yet
+        }
+        return fail("Cannot open " + path);
+    }
+
+    struct stat info;
+    if (::fstat(fd, &info) != 0) {
+        ::close(fd);
+        return fail("Cannot stat " + path);
+    }
+    size_t fileSize = static_cast<size_t>(info.st_size);
+    if (fileSize < sizeof(SnapshotHeader)) {
+        ::close(fd);
+        return fail("Snapshot " + path + " is truncated");
+    }
+
+    void* mapping = ::mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) return fail("Cannot map " + path);
+    ::madvise(mapping, fileSize, MADV_SEQUENTIAL);
+
+    bool ok = loadMapped(static_cast<const char*>(mapping), fileSize, inventory);
+    ::munmap(mapping, fileSize);
+    return ok;
+}
+
+bool InventorySnapshot::isStoredId(std::string_view id) {
+    if (id.empty()) return false;
+    for (char c : id) {
+        if (!isalnum(static_cast<unsigned char>(c)) || islower(static_cast<unsigned char>(c))) return false;
+    }
+    return true;
+}
+
+bool InventorySnapshot::loadMapped(const char* data, size_t fileSize, InventoryStore& inventory) {
+    SnapshotHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) return fail("Snapshot " + path + " has an invalid signature");
+    if (header.version != VERSION) {
+        return fail("Snapshot " + path + " has unsupported version " + std::to_string(header.version));
+    }
+    if (header.recordSize != sizeof(SnapshotRecord)) return fail("Snapshot " + path + " has an unexpected record size");
+    checkpointLsn = header.checkpointLsn;
+
+    // Compared against what is left of the file, so a huge count or heap size can't wrap
+    size_t remaining = fileSize - sizeof(SnapshotHeader);
+    if (header.itemCount > remaining / sizeof(SnapshotRecord)) return fail("Snapshot " + path + " is truncated");
+    uint64_t recordBytes = header.itemCount * sizeof(SnapshotRecord);
+    if (header.heapSize != remaining - recordBytes) return fail("Snapshot " + path + " is truncated");
+
+    const SnapshotRecord* records = reinterpret_cast<const SnapshotRecord*>(data + sizeof(SnapshotHeader));
+    const char* heap = data + sizeof(SnapshotHeader) + recordBytes;
+
+    inventory.reserve(inventory.size() + header.itemCount);
+    for (uint64_t i = 0; i < header.itemCount; ++i) {
+        const SnapshotRecord& record = records[i];
+        if (uint64_t(record.idOffset) + record.idLength > header.heapSize
+            || uint64_t(record.nameOffset) + record.nameLength > header.heapSize
+            || uint64_t(record.categoryOffset) + record.categoryLength > header.heapSize) {
+            return fail("Snapshot " + path + " has a record outside the string heap");
+        }
+        // The same rules InventoryCore::addItem applies, except that any quantity is kept:
+        // adjustments may leave an item at zero or, when allowed, below it
+        std::string_view id(heap + record.idOffset, record.idLength);
+        Category category;
+        if (!isStoredId(id)) return fail("Snapshot " + path + " has an invalid ID at record " + std::to_string(i));
+        if (checkPrice(Money::fromCents(record.price)) != NUMBER_OK) {
+            return fail("Snapshot " + path + " has an invalid price at record " + std::to_string(i));
+        }
+        if (!parseCategory(std::string_view(heap + record.categoryOffset, record.categoryLength), category)) {
+            return fail("Snapshot " + path + " has an invalid category at record " + std::to_string(i));
+        }
+        if (!inventory.add(id, std::string_view(heap + record.nameOffset, record.nameLength),
+                           record.quantity, Money::fromCents(record.price), CATEGORY_NAMES[category])) {
+            return fail("Snapshot " + path + " repeats the ID " + std::string(id));
+        }
+    }
+    return true;
+}
+
+uint32_t WriteAheadLog::crc32(const char* data, size_t size) {
+    static const Crc32Table crcTable;  // Built once, thread-safe static initialization
+    const uint32_t* table = crcTable.entries;
+    uint32_t crc = 0xFFFFFFFFU;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ static_cast<unsigned char>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFU;
+}
+
+void WriteAheadLog::putString(std::string& out, std::string_view str) {
+    put<uint32_t>(out, static_cast<uint32_t>(str.size()));
+    out.append(str);
+}
+
+bool WriteAheadLog::getString(const char*& cursor, const char* end, std::string& str) {
+    uint32_t length;
+    if (!get(cursor, end, length) || static_cast<size_t>(end - cursor) < length) return false;
+    str.assign(cursor, length);
+    cursor += length;
+    return true;
+}
+
+void WriteAheadLog::flushLoop() {
+    std::unique_lock<std::mutex> lock(logMutex);
+    while (true) {
+        pendingCondition.wait(lock, [&] { return !pending.empty() || stopping; });
+        if (pending.empty() && stopping) return;
+        if (!stopping && commitWindow.count() > 0) {
+            pendingCondition.wait_for(lock, commitWindow, [&] { return stopping; });
+        }
+
+        group.swap(pending);
+        uint64_t groupLsn = appendedLsn;
+        int logFd = fd;
+        flushing = true;
+        lock.unlock();
+
+        bool ok = writeAll(logFd, group.data(), group.size()) && ::fdatasync(logFd) == 0;
+        group.clear();  // Keeps its capacity, so the next swap hands pending an allocated buffer
+
+        lock.lock();
+        flushing = false;
+        if (ok) {
+            durableLsn = groupLsn;
+        } else {
+            writeFailed = true;
+        }
+        durableCondition.notify_all();
+    }
+}
+
+bool WriteAheadLog::writeAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+bool WriteAheadLog::keepRecordsAfter(uint64_t lsn) {
+    int readFd = ::open(path.c_str(), O_RDONLY);
+    if (readFd < 0) return false;
+    struct stat info;
+    if (::fstat(readFd, &info) != 0) {
+        ::close(readFd);
+        return false;
+    }
+    size_t fileSize = static_cast<size_t>(info.st_size);
+    void* mapping = (fileSize > 0) ? ::mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, readFd, 0) : nullptr;
+    ::close(readFd);
+    if (mapping == MAP_FAILED) return false;
+
+    const char* data = static_cast<const char*>(mapping);
+    size_t offset = 0;
+    while (fileSize - offset >= RECORD_HEADER_SIZE) {
+        uint32_t payloadLength;
+        uint64_t recordLsn;
+        memcpy(&payloadLength, data + offset, sizeof(payloadLength));
+        memcpy(&recordLsn, data + offset + 2 * sizeof(uint32_t), sizeof(recordLsn));
+        if (recordLsn > lsn) break;
+        offset += RECORD_HEADER_SIZE + payloadLength;
+    }
+    offset = std::min(offset, fileSize);
+
+    std::string tempPath = path + ".tmp";
+    int tempFd = ::open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    bool ok = tempFd >= 0 && writeAll(tempFd, data + offset, fileSize - offset) && ::fsync(tempFd) == 0
+           && ::rename(tempPath.c_str(), path.c_str()) == 0;
+    if (mapping != nullptr) ::munmap(mapping, fileSize);
+    if (!ok) {
+        if (tempFd >= 0) ::close(tempFd);
+        ::unlink(tempPath.c_str());
+        return false;
+    }
+
+    // Make the rename durable, then append to the new file
+    size_t slash = path.find_last_of('/');
+    std::string directory = (slash == std::string::npos) ? "." : path.substr(0, slash + 1);
+    int dirFd = ::open(directory.c_str(), O_RDONLY);
+    if (dirFd >= 0) {
+        ::fsync(dirFd);
+        ::close(dirFd);
+    }
+    ::close(fd);
+    fd = tempFd;
+    return true;
+}
+
+bool WriteAheadLog::apply(uint8_t type, const char* cursor, const char* end, InventoryStore& inventory) {
+    std::string id, name, category;
+    int32_t quantity;
+    int64_t cents;
+    if (!getString(cursor, end, id)) return false;
+
+    switch (type) {
+        case RECORD_ADD:
+            if (!getString(cursor, end, name) || !getString(cursor, end, category)
+                || !get(cursor, end, quantity) || !get(cursor, end, cents)) return false;
+            inventory.add(id, name, quantity, Money::fromCents(cents), category);  // Already in the snapshot if it fails
+            return true;
+        case RECORD_REMOVE:
+            inventory.remove(id);
+            return true;
+        case RECORD_QUANTITY:
+            if (!get(cursor, end, quantity)) return false;
+            inventory.setQuantity(id, quantity);
+            return true;
+        case RECORD_PRICE:
+            if (!get(cursor, end, cents)) return false;
+            inventory.setPrice(id, Money::fromCents(cents));
+            return true;
+        case RECORD_ADJUST:  // The applied delta, so the mode that clamped it is not needed
+            if (!get(cursor, end, quantity)) return false;
+            inventory.adjustQuantity(id, quantity);
+            return true;
+    }
+    return false;
+}
+
+bool WriteAheadLog::replay(InventoryStore& inventory, size_t& appliedCount, std::string& error, uint64_t checkpointLsn) {
+    STAT_SCOPE(STAT_JOURNAL_REPLAY);
+    appliedCount = 0;
+    appendedLsn = durableLsn = checkpointLsn;  // New records continue after the snapshot and the log
+    int readFd = ::open(path.c_str(), O_RDWR);
+    if (readFd < 0) {
+        if (errno == ENOENT) return true;  // No log yet
+        error = "Cannot open " + path + " (" + strerror(errno) + ")";
+        return false;
+    }
+
+    struct stat info;
+    if (::fstat(readFd, &info) != 0) {
+        error = "Cannot stat " + path + " (" + strerror(errno) + ")";
+        ::close(readFd);
+        return false;
+    }
+    size_t fileSize = static_cast<size_t>(info.st_size);
+    if (fileSize == 0) {
+        ::close(readFd);
+        return true;
+    }
+
+    void* mapping = ::mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, readFd, 0);
+    if (mapping == MAP_FAILED) {
+        error = "Cannot map " + path + " (" + strerror(errno) + ")";
+        ::close(readFd);
+        return false;
+    }
+
+    const char* data = static_cast<const char*>(mapping);
+    size_t offset = 0;
+    while (fileSize - offset >= RECORD_HEADER_SIZE) {
+        uint32_t payloadLength, checksum;
+        memcpy(&payloadLength, data + offset, sizeof(payloadLength));
+        memcpy(&checksum, data + offset + sizeof(uint32_t), sizeof(checksum));
+        if (fileSize - offset - RECORD_HEADER_SIZE < payloadLength) break;  // Torn write
+
+        const char* body = data + offset + 2 * sizeof(uint32_t);
+        if (crc32(body, sizeof(uint64_t) + 1 + payloadLength) != checksum) break;  // Corrupt record
+        uint64_t lsn;
+        memcpy(&lsn, body, sizeof(lsn));
+        const char* payload = body + sizeof(uint64_t) + 1;
+        if (lsn > checkpointLsn) {  // Older records are already in the snapshot
+            if (!apply(static_cast<uint8_t>(payload[-1]), payload, payload + payloadLength, inventory)) break;
+            ++appliedCount;
+        }
+        appendedLsn = durableLsn = std::max(appendedLsn, lsn);
+
+        offset += RECORD_HEADER_SIZE + payloadLength;
+    }
+    ::munmap(mapping, fileSize);
+
+    // Drop everything after the last intact record so new appends follow valid data
+    if (offset < fileSize && ::ftruncate(readFd, static_cast<off_t>(offset)) != 0) {
+        error = "Cannot truncate " + path + " (" + strerror(errno) + ")";
+        ::close(readFd);
+        return false;
+    }
+    ::close(readFd);
+    return true;
+}
+
+bool WriteAheadLog::open(std::string& error) {
+    int logFd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (logFd < 0) {
+        error = "Cannot open " + path + " (" + strerror(errno) + ")";
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(logMutex);
+        fd = logFd;
+        stopping = false;
+        writeFailed = false;
+    }
+    flusher = std::thread(&WriteAheadLog::flushLoop, this);
+    return true;
+}
+
+bool WriteAheadLog::sync() {
+    std::unique_lock<std::mutex> lock(logMutex);
+    uint64_t lsn = appendedLsn;
+    pendingCondition.notify_one();
+    durableCondition.wait(lock, [&] { return durableLsn >= lsn || writeFailed || fd < 0; });
+    return !writeFailed;
+}
+
+uint64_t WriteAheadLog::getLastLsn() const {
+    std::lock_guard<std::mutex> lock(logMutex);
+    return appendedLsn;
+}
+
+bool WriteAheadLog::checkpoint(uint64_t snapshotLsn) {
+    if (!sync()) return false;
+    std::unique_lock<std::mutex> lock(logMutex);
+    durableCondition.wait(lock, [&] { return !flushing; });
+    if (fd < 0 || writeFailed) return false;
+    if (durableLsn <= snapshotLsn) return ::ftruncate(fd, 0) == 0 && ::fsync(fd) == 0;
+    return keepRecordsAfter(snapshotLsn);
+}
+
+void WriteAheadLog::close() {
+    {
+        std::lock_guard<std::mutex> lock(logMutex);
+        if (fd < 0) return;
+        stopping = true;
+    }
+    pendingCondition.notify_one();
+    if (flusher.joinable()) flusher.join();
+    std::lock_guard<std::mutex> lock(logMutex);
+    ::close(fd);
+    fd = -1;
+    durableCondition.notify_all();
+}
+
+void WriteAheadLog::onAdd(const ItemRef& item) {
+    append(RECORD_ADD, [&](std::string& payload) {
+        putString(payload, item.getId());
+        putString(payload, item.getName());
+        putString(payload, item.getCategory());
+        put<int32_t>(payload, item.getQuantity());
+        put<int64_t>(payload, item.getPrice().getCents());
+    });
+}
+
+void WriteAheadLog::onRemove(std::string_view id) {
+    append(RECORD_REMOVE, [&](std::string& payload) { putString(payload, id); });
+}
+
+void WriteAheadLog::onQuantityChange(std::string_view id, int quantity) {
+    append(RECORD_QUANTITY, [&](std::string& payload) {
+        putString(payload, id);
+        put<int32_t>(payload, quantity);
+    });
+}
+
+void WriteAheadLog::onPriceChange(std::string_view id, Money price) {
+    append(RECORD_PRICE, [&](std::string& payload) {
+        putString(payload, id);
+        put<int64_t>(payload, price.getCents());
+    });
+}
+
+void WriteAheadLog::onQuantityAdjust(std::string_view id, int delta, int /*quantity*/) {
+    append(RECORD_ADJUST, [&](std::string& payload) {
+        putString(payload, id);
+        put<int32_t>(payload, delta);
+    });
+}
+
+bool CsvImporter::splitLine(std::string_view line, std::string_view* fields, size_t& count, std::string& scratch) const {
+    count = 0;
+    scratch.clear();
+    scratch.reserve(line.size());  // Unquoted fields point into scratch, so it must not move
+    size_t position = 0;
+    while (true) {
+        if (count == MAX_FIELDS) return true;
+        if (position < line.size() && line[position] == '"') {
+            size_t start = scratch.size();
+            ++position;
+            while (true) {
+                if (position >= line.size()) return false;  // No closing quote
+                if (line[position] == '"') {
+                    if (position + 1 < line.size() && line[position + 1] == '"') {
+                        scratch += '"';
+                        position += 2;
+                        continue;
+                    }
+                    ++position;
+                    break;
+                }
+                scratch += line[position++];
+            }
+            fields[count++] = std::string_view(scratch.data() + start, scratch.size() - start);
+            while (position < line.size() && line[position] == ' ') ++position;
+            if (position == line.size()) return true;
+            if (line[position] != separator) return false;  // Text after the closing quote
+            ++position;
+        } else {
+            size_t next = line.find(separator, position);
+            std::string_view field =
+                line.substr(position, next == std::string_view::npos ? std::string_view::npos : next - position);
+            while (!field.empty() && field.front() == ' ') field.remove_prefix(1);
+            while (!field.empty() && field.back() == ' ') field.remove_suffix(1);
+            if (!field.empty() && field.front() == '"' && field.data() != line.data() + position) {
+                // A quoted field after leading spaces
+                position = static_cast<size_t>(field.data() - line.data());
+                continue;
+            }
+            fields[count++] = field;
+            if (next == std::string_view::npos) return true;
+            position = next + 1;
+        }
+    }
+}
+
+bool CsvImporter::isAlphanumeric(std::string_view field) {
+    for (char c : field) {
+        if (!isalnum(static_cast<unsigned char>(c))) return false;
+    }
+    return true;
+}
+
+void CsvImporter::parseChunk(Chunk& chunk) const {
+    std::string_view fields[MAX_FIELDS];
+    std::string scratch;
+    const char* cursor = chunk.begin;
+    uint32_t line = 0;
+    while (cursor < chunk.end) {
+        const char* lineEnd = static_cast<const char*>(memchr(cursor, '\n', chunk.end - cursor));
+        if (lineEnd == nullptr) lineEnd = chunk.end;
+        std::string_view text(cursor, lineEnd - cursor);
+        if (!text.empty() && text.back() == '\r') text.remove_suffix(1);
+        cursor = lineEnd + 1;
+        uint32_t number = line++;
+        if (text.find_first_not_of(" \t") == std::string_view::npos) continue;
+
+        ParsedRow row = {};
+        row.line = number;
+        std::string_view badField;
+        size_t count;
+        if (!splitLine(text, fields, count, scratch)) {
+            row.error = BAD_QUOTES;
+        } else if (count < fieldsNeeded) {
+            row.error = BAD_FIELD_COUNT;
+        } else {
+            std::string_view category = fields[columns[CATEGORY_COLUMN]];
+            std::string_view id = fields[columns[ID_COLUMN]];
+            std::string_view price = fields[columns[PRICE_COLUMN]];
+            std::string_view quantity = fields[columns[QUANTITY_COLUMN]];
+            std::string_view name = fields[columns[NAME_COLUMN]];
+            if (!parseCategory(category, row.category)) {
+                row.error = BAD_CATEGORY;
+                badField = category;
+            } else if (id.empty() || !isAlphanumeric(id)) {
+                row.error = BAD_ID;
+                badField = id;
+            } else if ((row.numberError = parsePrice(price, row.price)) != NUMBER_OK) {
+                row.error = BAD_PRICE;
+                badField = price;
+            } else if ((row.numberError = parseQuantity(quantity, row.quantity)) != NUMBER_OK) {
+                row.error = BAD_QUANTITY;
+                badField = quantity;
+            }
+            if (row.error == ROW_OK) {
+                row.idOffset = static_cast<uint32_t>(chunk.text.size());
+                row.idLength = static_cast<uint32_t>(id.size());
+                for (char c : id) chunk.text += static_cast<char>(toupper(static_cast<unsigned char>(c)));
+                row.nameOffset = static_cast<uint32_t>(chunk.text.size());
+                row.nameLength = static_cast<uint32_t>(name.size());
+                chunk.text.append(name);
+            }
+        }
+        if (row.error != ROW_OK) {
+            row.idOffset = static_cast<uint32_t>(chunk.text.size());
+            row.idLength = static_cast<uint32_t>(badField.size());
+            chunk.text.append(badField);
+        }
+        chunk.rows.push_back(row);
+    }
+    chunk.lines = line;
+}
+
+std::string CsvImporter::describe(const Chunk& chunk, const ParsedRow& row) const {
+    std::string field = "'" + chunk.text.substr(row.idOffset, row.idLength) + "'";
+    switch (row.error) {
+        case BAD_FIELD_COUNT: return "expected at least " + std::to_string(fieldsNeeded) + " fields";
+        case BAD_QUOTES: return "unbalanced quotes";
+        case BAD_CATEGORY: return "invalid category " + field;
+        case BAD_ID: return "invalid ID " + field;
+        case BAD_PRICE: return "invalid price " + field + " (" + describeNumber(row.numberError) + ")";
+        case BAD_QUANTITY: return "invalid quantity " + field + " (" + describeNumber(row.numberError) + ")";
+        default: return "";
+    }
+}
+
+bool CsvImporter::readHeader(std::string_view line) {
+    std::string_view fields[MAX_FIELDS];
+    size_t count;
+    std::string scratch;
+    if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+    if (!splitLine(line, fields, count, scratch)) return false;
+
+    static const char* const NAMES[COLUMN_COUNT] = {"category", "id", "price", "quantity", "name"};
+    int found[COLUMN_COUNT] = {-1, -1, -1, -1, -1};
+    for (size_t i = 0; i < count; ++i) {
+        for (int column = 0; column < COLUMN_COUNT; ++column) {
+            if (equalsIgnoreCase(fields[i], NAMES[column])) found[column] = static_cast<int>(i);
+        }
+    }
+    for (int column : found) {
+        if (column < 0) return false;
+    }
+    std::copy(found, found + COLUMN_COUNT, columns);
+    return true;
+}
+
+bool CsvImporter::import(const std::string& path, Report& report, std::ostream& log) {
+    STAT_SCOPE(STAT_IMPORT);
+    auto start = std::chrono::steady_clock::now();
+    report = Report();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        errorMessage = "Cannot open " + path + " (" + strerror(errno) + ")";
+        return false;
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0) {
+        errorMessage = "Cannot stat " + path + " (" + strerror(errno) + ")";
+        ::close(fd);
+        return false;
+    }
+    size_t size = static_cast<size_t>(info.st_size);
+    if (size == 0) {
+        ::close(fd);
+        return true;
+    }
+    void* mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        errorMessage = "Cannot map " + path + " (" + strerror(errno) + ")";
+        return false;
+    }
+    ::madvise(mapping, size, MADV_SEQUENTIAL);
+    const char* data = static_cast<const char*>(mapping);
+    const char* end = data + size;
+
+    // The first line picks the separator and may be a header
+    const char* firstEnd = static_cast<const char*>(memchr(data, '\n', size));
+    if (firstEnd == nullptr) firstEnd = end;
+    std::string_view first(data, firstEnd - data);
+    separator = (first.find('\t') != std::string_view::npos) ? '\t' : ',';
+    for (int column = 0; column < COLUMN_COUNT; ++column) columns[column] = column;  // ADD order
+    const char* body = data;
+    size_t lineOffset = 1;  // Line number of the first body line
+    if (readHeader(first)) {
+        body = std::min(firstEnd + 1, end);
+        lineOffset = 2;
+    }
+    fieldsNeeded = static_cast<size_t>(*std::max_element(columns, columns + COLUMN_COUNT)) + 1;
+
+    // Cut the body into chunks at line breaks and parse them in parallel
+    size_t threads =
+        std::max<size_t>(1, std::min<size_t>(std::thread::hardware_concurrency(), (end - body) / MIN_CHUNK_BYTES + 1));
+    std::vector<Chunk> chunks(threads);
+    const char* cursor = body;
+    for (size_t i = 0; i < threads; ++i) {
+        chunks[i].begin = cursor;
+        const char* cut = (i + 1 == threads) ? end : body + (end - body) * (i + 1) / threads;
+        if (cut < cursor) cut = cursor;
+        const char* lineEnd = (cut < end) ? static_cast<const char*>(memchr(cut, '\n', end - cut)) : nullptr;
+        cursor = (lineEnd == nullptr) ? end : lineEnd + 1;
+        chunks[i].end = cursor;
+    }
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < threads; ++i) workers.emplace_back([this, &chunks, i] { parseChunk(chunks[i]); });
+    parseChunk(chunks[0]);
+    for (auto& worker : workers) worker.join();
+
+    // Add in file order so the first of two rows with the same ID wins
+    size_t total = 0;
+    for (const auto& chunk : chunks) total += chunk.rows.size();
+    inventory.reserve(inventory.size() + total);
+    for (const auto& chunk : chunks) {
+        for (const auto& row : chunk.rows) {
+            ++report.rows;
+            size_t line = lineOffset + row.line;
+            if (row.error != ROW_OK) {
+                log << path << ":" << line << ": " << describe(chunk, row) << "\n";
+                ++report.rejected;
+                continue;
+            }
+            std::string_view id(chunk.text.data() + row.idOffset, row.idLength);
+            std::string_view name(chunk.text.data() + row.nameOffset, row.nameLength);
+            if (!inventory.add(id, name, row.quantity, row.price, CATEGORY_NAMES[row.category])) {
+                log << path << ":" << line << ": an item with ID '" << id << "' already exists\n";
+                ++report.rejected;
+                continue;
+            }
+            ++report.imported;
+        }
+        lineOffset += chunk.lines;
+    }
+    ::munmap(mapping, size);
+
+    report.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+void InventoryExporter::appendCsvField(OutputBuffer& out, std::string_view field) {
+    bool quote = field.find_first_of(",\"\r\n") != std::string_view::npos
+              || (!field.empty() && (field.front() == ' ' || field.back() == ' '));
+    if (!quote) {
+        out.append(field);
+        return;
+    }
+    out.append('"');
+    for (char c : field) {
+        if (c == '"') out.append('"');
+        out.append(c);
+    }
+    out.append('"');
+}
+
+void InventoryExporter::appendJsonString(OutputBuffer& out, std::string_view text) {
+    static const char HEX[] = "0123456789abcdef";
+    out.append('"');
+    size_t plain = 0;  // Start of the run of characters that need no escaping
+    for (size_t i = 0; i < text.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        out.append(text.substr(plain, i - plain));
+        out.append('\\');
+        if (c == '"' || c == '\\') {
+            out.append(static_cast<char>(c));
+        } else {
+            out.append("u00");
+            out.append(HEX[c >> 4]);
+            out.append(HEX[c & 0xF]);
+        }
+        plain = i + 1;
+    }
+    out.append(text.substr(plain));
+    out.append('"');
+}
+
+bool InventoryExporter::parseFormat(std::string_view name, Format& format) {
+    if (equalsIgnoreCase(name, "CSV")) format = CSV_FORMAT;
+    else if (equalsIgnoreCase(name, "JSONL")) format = JSONL_FORMAT;
+    else if (equalsIgnoreCase(name, "BINARY")) format = BINARY_FORMAT;
+    else return false;
+    return true;
+}
+
+bool InventoryExporter::write(const std::string& path, Format format, const ItemColumns& inventory,
+                              const std::vector<uint32_t>& rows) {
+    STAT_SCOPE(STAT_EXPORT);
+    if (format == BINARY_FORMAT) {
+        InventorySnapshot snapshot(path);
+        if (!snapshot.save(inventory, &rows)) {
+            errorMessage = snapshot.getError();
+            return false;
+        }
+        return true;
+    }
+
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        errorMessage = "Cannot create " + path + " (" + strerror(errno) + ")";
+        return false;
+    }
+    OutputBuffer out(fd);
+    if (format == CSV_FORMAT) out.append("category,id,price,quantity,name\n");
+    // Sorted rows jump around the columns, so fetch the rows ahead in two stages
+    const size_t COLUMNS_AHEAD = 16, TEXT_AHEAD = 8;
+    for (size_t i = 0; i < rows.size(); ++i) {
+        if (i + COLUMNS_AHEAD < rows.size()) inventory.prefetchRow(rows[i + COLUMNS_AHEAD]);
+        if (i + TEXT_AHEAD < rows.size()) inventory.prefetchText(rows[i + TEXT_AHEAD]);
+        uint32_t row = rows[i];
+        if (format == CSV_FORMAT) {
+            appendCsvField(out, inventory.categoryAt(row));
+            out.append(',');
+            appendCsvField(out, inventory.idAt(row));
+            out.append(',');
+            out.appendPrice(inventory.priceAt(row));
+            out.append(',');
+            out.appendInteger(inventory.quantityAt(row));
+            out.append(',');
+            appendCsvField(out, inventory.nameAt(row));
+            out.append('\n');
+        } else {
+            out.append("{\"category\":");
+            appendJsonString(out, inventory.categoryAt(row));
+            out.append(",\"id\":");
+            appendJsonString(out, inventory.idAt(row));
+            out.append(",\"name\":");
+            appendJsonString(out, inventory.nameAt(row));
+            out.append(",\"quantity\":");
+            out.appendInteger(inventory.quantityAt(row));
+            out.append(",\"price\":");
+            out.appendPrice(inventory.priceAt(row));
+            out.append("}\n");
+        }
+        out.recordDone();
+    }
+    bool ok = out.flush();
+    if (::close(fd) != 0) ok = false;
+    if (!ok) errorMessage = "Cannot write " + path + " (" + strerror(errno) + ")";
+    return ok;
+}
@@ -0,0 +1,1068 @@
+// Out-of-line parts of the store: the string pool, the ordered and text indexes, the column
+// store itself and its concurrent wrapper
+#include "inventory_core.h"
+
+size_t StringPool::hashText(std::string_view text) {
+    size_t hash = 1469598103934665603ULL;
+    for (char c : text) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+size_t StringPool::probe(std::string_view text) const {
+    size_t slot = hashText(text) & tableMask;
+    while (table[slot] != EMPTY_ENTRY && entries[table[slot]] != text) {
+        slot = (slot + 1) & tableMask;
+    }
+    return slot;
+}
+
+std::string_view StringPool::store(std::string_view text) {
+    if (text.empty()) return std::string_view();
+    if (text.size() > BLOCK_SIZE) {
+        largeBlocks.emplace_back(new char[text.size()]);
+        memcpy(largeBlocks.back().get(), text.data(), text.size());
+        return std::string_view(largeBlocks.back().get(), text.size());
+    }
+    if (blocks.empty() || blockUsed + text.size() > BLOCK_SIZE) {
+        blocks.emplace_back(new char[BLOCK_SIZE]);
+        blockUsed = 0;
+    }
+    char* data = blocks.back().get() + blockUsed;
+    memcpy(data, text.data(), text.size());
+    blockUsed += text.size();
+    return std::string_view(data, text.size());
+}
+
+uint32_t StringPool::intern(std::string_view text) {
+    if ((entries.size() + 1) * 2 > table.size()) {
+        table.assign(table.size() * 2, EMPTY_ENTRY);
+        tableMask = table.size() - 1;
+        for (uint32_t ref = 0; ref < entries.size(); ++ref) {
+            table[probe(entries[ref])] = ref;
+        }
+    }
+    size_t slot = probe(text);
+    if (table[slot] == EMPTY_ENTRY) {
+        table[slot] = static_cast<uint32_t>(entries.size());
+        entries.push_back(store(text));
+    }
+    return table[slot];
+}
+
+void StringPool::reserve(size_t count) {
+    entries.reserve(count);
+    size_t capacity = table.size();
+    while (capacity < count * 2) capacity *= 2;
+    if (capacity == table.size()) return;
+    table.assign(capacity, EMPTY_ENTRY);
+    tableMask = capacity - 1;
+    for (uint32_t ref = 0; ref < entries.size(); ++ref) {
+        table[probe(entries[ref])] = ref;
+    }
+}
+
+uint64_t OrderedIndex::priceKey(Money price) {
+    return static_cast<uint64_t>(price.getCents()) ^ 0x8000000000000000ULL;
+}
+
+uint64_t OrderedIndex::quantityKey(int quantity) {
+    return static_cast<uint64_t>(static_cast<uint32_t>(quantity) ^ 0x80000000U);
+}
+
+uint32_t OrderedIndex::newLeaf() {
+    uint32_t node;
+    if (!freeLeaves.empty()) {
+        node = freeLeaves.back();
+        freeLeaves.pop_back();
+    } else {
+        node = static_cast<uint32_t>(leaves.size());
+        leaves.emplace_back();
+    }
+    leaves[node].count = 0;
+    leaves[node].prev = leaves[node].next = NONE;
+    return node;
+}
+
+uint32_t OrderedIndex::newBranch() {
+    uint32_t node;
+    if (!freeBranches.empty()) {
+        node = freeBranches.back();
+        freeBranches.pop_back();
+    } else {
+        node = static_cast<uint32_t>(branches.size());
+        branches.emplace_back();
+    }
+    branches[node].count = 0;
+    return node;
+}
+
+int OrderedIndex::childIndex(const Branch& branch, const Entry& entry) {
+    return static_cast<int>(std::upper_bound(branch.lowest + 1, branch.lowest + branch.count, entry) - branch.lowest) - 1;
+}
+
+OrderedIndex::Entry OrderedIndex::lowestOf(uint32_t node, int level) const {
+    return level == 0 ? leaves[node].entries[0] : branches[node].lowest[0];
+}
+
+bool OrderedIndex::insertInto(uint32_t node, int level, const Entry& entry, Entry& splitLowest, uint32_t& splitNode) {
+    if (level == 0) {
+        Leaf& leaf = leaves[node];
+        int position = static_cast<int>(std::lower_bound(leaf.entries, leaf.entries + leaf.count, entry) - leaf.entries);
+        if (leaf.count < CAPACITY) {
+            std::copy_backward(leaf.entries + position, leaf.entries + leaf.count, leaf.entries + leaf.count + 1);
+            leaf.entries[position] = entry;
+            ++leaf.count;
+            return false;
+        }
+        // Full: move the upper half into a new leaf, then insert into the half it belongs to
+        uint32_t right = newLeaf();
+        Leaf& sibling = leaves[right];
+        int half = CAPACITY / 2;
+        std::copy(leaf.entries + half, leaf.entries + CAPACITY, sibling.entries);
+        sibling.count = CAPACITY - half;
+        leaf.count = half;
+        sibling.prev = node;
+        sibling.next = leaf.next;
+        if (leaf.next != NONE) leaves[leaf.next].prev = right;
+        leaf.next = right;
+
+        Leaf& target = (position <= half) ? leaf : sibling;
+        if (&target == &sibling) position -= half;
+        std::copy_backward(target.entries + position, target.entries + target.count, target.entries + target.count + 1);
+        target.entries[position] = entry;
+        ++target.count;
+
+        splitLowest = sibling.entries[0];
+        splitNode = right;
+        return true;
+    }
+
+    int child = childIndex(branches[node], entry);
+    Entry childLowest;
+    uint32_t childSplit;
+    bool childSplitHappened = insertInto(branches[node].children[child], level - 1, entry, childLowest, childSplit);
+    Branch& branch = branches[node];
+    if (entry < branch.lowest[0]) branch.lowest[0] = entry;
+    if (!childSplitHappened) return false;
+
+    int position = child + 1;
+    if (branch.count < CAPACITY) {
+        std::copy_backward(branch.lowest + position, branch.lowest + branch.count, branch.lowest + branch.count + 1);
+        std::copy_backward(branch.children + position, branch.children + branch.count, branch.children + branch.count + 1);
+        branch.lowest[position] = childLowest;
+        branch.children[position] = childSplit;
+        ++branch.count;
+        return false;
+    }
+
+    // Full: split the branch the same way
+    uint32_t right = newBranch();
+    Branch& sibling = branches[right];
+    int half = CAPACITY / 2;
+    std::copy(branch.lowest + half, branch.lowest + CAPACITY, sibling.lowest);
+    std::copy(branch.children + half, branch.children + CAPACITY, sibling.children);
+    sibling.count = CAPACITY - half;
+    branch.count = half;
+
+    Branch& target = (position <= half) ? branch : sibling;
+    if (&target == &sibling) position -= half;
+    std::copy_backward(target.lowest + position, target.lowest + target.count, target.lowest + target.count + 1);
+    std::copy_backward(target.children + position, target.children + target.count, target.children + target.count + 1);
+    target.lowest[position] = childLowest;
+    target.children[position] = childSplit;
+    ++target.count;
+
+    splitLowest = sibling.lowest[0];
+    splitNode = right;
+    return true;
+}
+
+bool OrderedIndex::eraseFrom(uint32_t node, int level, const Entry& entry, bool& found) {
+    if (level == 0) {
+        Leaf& leaf = leaves[node];
+        Entry* position = std::lower_bound(leaf.entries, leaf.entries + leaf.count, entry);
+        if (position == leaf.entries + leaf.count || !(*position == entry)) return false;
+        std::copy(position + 1, leaf.entries + leaf.count, position);
+        --leaf.count;
+        found = true;
+        return leaf.count < MINIMUM;
+    }
+
+    Branch& branch = branches[node];
+    int child = childIndex(branch, entry);
+    if (eraseFrom(branch.children[child], level - 1, entry, found)) rebalance(node, child, level - 1);
+    return found && branch.count < MINIMUM;
+}
+
+void OrderedIndex::rebalance(uint32_t parent, int child, int childLevel) {
+    Branch& branch = branches[parent];
+    if (branch.count < 2) return;
+    int left = (child > 0) ? child - 1 : child;
+    int right = left + 1;
+    uint32_t leftNode = branch.children[left], rightNode = branch.children[right];
+
+    if (childLevel == 0) {
+        Leaf& a = leaves[leftNode];
+        Leaf& b = leaves[rightNode];
+        if (a.count + b.count <= CAPACITY) {
+            std::copy(b.entries, b.entries + b.count, a.entries + a.count);
+            a.count += b.count;
+            a.next = b.next;
+            if (b.next != NONE) leaves[b.next].prev = leftNode;
+            freeLeaves.push_back(rightNode);
+            removeChild(branch, right);
+            return;
+        }
+        Entry combined[2 * CAPACITY];
+        std::copy(a.entries, a.entries + a.count, combined);
+        std::copy(b.entries, b.entries + b.count, combined + a.count);
+        int total = a.count + b.count;
+        a.count = total / 2;
+        b.count = total - a.count;
+        std::copy(combined, combined + a.count, a.entries);
+        std::copy(combined + a.count, combined + total, b.entries);
+        branch.lowest[right] = b.entries[0];
+        return;
+    }
+
+    Branch& a = branches[leftNode];
+    Branch& b = branches[rightNode];
+    if (a.count + b.count <= CAPACITY) {
+        std::copy(b.lowest, b.lowest + b.count, a.lowest + a.count);
+        std::copy(b.children, b.children + b.count, a.children + a.count);
+        a.count += b.count;
+        freeBranches.push_back(rightNode);
+        removeChild(branch, right);
+        return;
+    }
+    Entry combinedLowest[2 * CAPACITY];
+    uint32_t combinedChildren[2 * CAPACITY];
+    std::copy(a.lowest, a.lowest + a.count, combinedLowest);
+    std::copy(b.lowest, b.lowest + b.count, combinedLowest + a.count);
+    std::copy(a.children, a.children + a.count, combinedChildren);
+    std::copy(b.children, b.children + b.count, combinedChildren + a.count);
+    int total = a.count + b.count;
+    a.count = total / 2;
+    b.count = total - a.count;
+    std::copy(combinedLowest, combinedLowest + a.count, a.lowest);
+    std::copy(combinedLowest + a.count, combinedLowest + total, b.lowest);
+    std::copy(combinedChildren, combinedChildren + a.count, a.children);
+    std::copy(combinedChildren + a.count, combinedChildren + total, b.children);
+    branch.lowest[right] = b.lowest[0];
+}
+
+void OrderedIndex::removeChild(Branch& branch, int index) {
+    std::copy(branch.lowest + index + 1, branch.lowest + branch.count, branch.lowest + index);
+    std::copy(branch.children + index + 1, branch.children + branch.count, branch.children + index);
+    --branch.count;
+}
+
+void OrderedIndex::lowerBound(const Entry& entry, uint32_t& leaf, int& position) const {
+    uint32_t node = root;
+    for (int level = height; level > 0; --level) {
+        const Branch& branch = branches[node];
+        node = branch.children[childIndex(branch, entry)];
+    }
+    leaf = node;
+    const Leaf& found = leaves[node];
+    position = static_cast<int>(std::lower_bound(found.entries, found.entries + found.count, entry) - found.entries);
+}
+
+void OrderedIndex::clear() {
+    leaves.clear();
+    branches.clear();
+    freeLeaves.clear();
+    freeBranches.clear();
+    root = newLeaf();
+    height = 0;
+    entryCount = 0;
+}
+
+void OrderedIndex::insert(uint64_t key, uint32_t row) {
+    Entry entry{key, row};
+    Entry splitLowest;
+    uint32_t splitNode;
+    if (insertInto(root, height, entry, splitLowest, splitNode)) {
+        // The root split: grow the tree by one level
+        uint32_t oldRoot = root;
+        root = newBranch();
+        Branch& top = branches[root];
+        top.lowest[0] = lowestOf(oldRoot, height);
+        top.children[0] = oldRoot;
+        top.lowest[1] = splitLowest;
+        top.children[1] = splitNode;
+        top.count = 2;
+        ++height;
+    }
+    ++entryCount;
+}
+
+bool OrderedIndex::erase(uint64_t key, uint32_t row) {
+    bool found = false;
+    eraseFrom(root, height, Entry{key, row}, found);
+    if (!found) return false;
+    --entryCount;
+    // Shrink the tree while the root branch has a single child
+    while (height > 0 && branches[root].count == 1) {
+        freeBranches.push_back(root);
+        root = branches[root].children[0];
+        --height;
+    }
+    return true;
+}
+
+void OrderedIndex::assign(const std::vector<Entry>& sorted) {
+    clear();
+    if (sorted.empty()) return;
+    const int fill = CAPACITY * 3 / 4;
+
+    std::vector<uint32_t> level;
+    std::vector<Entry> levelLowest;
+    uint32_t previous = NONE;
+    for (size_t i = 0; i < sorted.size(); i += fill) {
+        uint32_t node = level.empty() ? root : newLeaf();
+        Leaf& leaf = leaves[node];
+        leaf.count = static_cast<int>(std::min(sorted.size() - i, size_t(fill)));
+        std::copy(sorted.begin() + i, sorted.begin() + i + leaf.count, leaf.entries);
+        leaf.prev = previous;
+        if (previous != NONE) leaves[previous].next = node;
+        previous = node;
+        level.push_back(node);
+        levelLowest.push_back(leaf.entries[0]);
+    }
+
+    height = 0;
+    while (level.size() > 1) {
+        std::vector<uint32_t> parents;
+        std::vector<Entry> parentLowest;
+        for (size_t i = 0; i < level.size(); i += fill) {
+            uint32_t node = newBranch();
+            Branch& branch = branches[node];
+            branch.count = static_cast<int>(std::min(level.size() - i, size_t(fill)));
+            std::copy(level.begin() + i, level.begin() + i + branch.count, branch.children);
+            std::copy(levelLowest.begin() + i, levelLowest.begin() + i + branch.count, branch.lowest);
+            parents.push_back(node);
+            parentLowest.push_back(branch.lowest[0]);
+        }
+        // A last node with too few children borrows from its neighbour
+        size_t last = parents.size() - 1;
+        if (last > 0 && branches[parents[last]].count < MINIMUM) {
+            Branch& a = branches[parents[last - 1]];
+            Branch& b = branches[parents[last]];
+            int move = (a.count - b.count) / 2;
+            std::copy_backward(b.lowest, b.lowest + b.count, b.lowest + b.count + move);
+            std::copy_backward(b.children, b.children + b.count, b.children + b.count + move);
+            std::copy(a.lowest + a.count - move, a.lowest + a.count, b.lowest);
+            std::copy(a.children + a.count - move, a.children + a.count, b.children);
+            a.count -= move;
+            b.count += move;
+            parentLowest[last] = b.lowest[0];
+        }
+        level.swap(parents);
+        levelLowest.swap(parentLowest);
+        ++height;
+    }
+    root = level[0];
+    entryCount = sorted.size();
+}
+
+void TrigramIndex::gramsOf(std::string_view text, bool padFront, bool padBack, std::vector<uint32_t>& grams) {
+    grams.clear();
+    uint32_t window = 0;
+    size_t filled = 0;
+    auto push = [&](unsigned char c) {
+        window = ((window << 8) | c) & 0xFFFFFF;
+        if (++filled >= 3) grams.push_back(window);
+    };
+    if (padFront) {
+        push(0);
+        push(0);
+    }
+    for (char c : text) push(static_cast<unsigned char>(tolower(static_cast<unsigned char>(c))));
+    if (padBack) push(0);
+    std::sort(grams.begin(), grams.end());
+    grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+}
+
+void TrigramIndex::insert(uint32_t row, std::string_view text) {
+    gramsOf(text, true, true, scratch);
+    for (uint32_t gram : scratch) {
+        std::vector<uint32_t>& rows = postings[gram];
+        if (rows.empty() || rows.back() != row) rows.push_back(row);
+    }
+}
+
+const std::vector<uint32_t>* TrigramIndex::rowsWith(uint32_t gram) const {
+    auto found = postings.find(gram);
+    return found == postings.end() ? nullptr : &found->second;
+}
+
+void TrigramIndex::clear() {
+    std::unordered_map<uint32_t, std::vector<uint32_t>>().swap(postings);
+}
+
+int ItemColumns::findCategoryCode(std::string_view category) const {
+    for (size_t code = 0; code < categoryNames.size(); ++code) {
+        if (equalsIgnoreCase(categoryNames[code], category)) return static_cast<int>(code);
+    }
+    return -1;
+}
+
+SelectionBitmap ItemColumns::categoryRows(uint8_t code) const {
+    SelectionBitmap selection(rows);
+    forEachInCategory(code, [&](uint32_t row) {
+        selection.set(row);
+        return true;
+    });
+    return selection;
+}
+
+size_t InventoryStore::hashId(std::string_view id) {
+    size_t hash = 1469598103934665603ULL;
+    for (char c : id) {
+        hash ^= static_cast<unsigned char>(toupper(static_cast<unsigned char>(c)));
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+size_t InventoryStore::probe(std::string_view id) const {
+    size_t slot = hashId(id) & slotMask;
+    while (slots[slot] != EMPTY_SLOT && !equalsIgnoreCase(idAt(slots[slot]), id)) {
+        slot = (slot + 1) & slotMask;
+    }
+    return slot;
+}
+
+void InventoryStore::rehash(size_t capacity) {
+    slots.assign(capacity, EMPTY_SLOT);
+    slotMask = capacity - 1;
+    forEachLiveRow([&](size_t row) { slots[probe(idAt(row))] = static_cast<int>(row); });
+}
+
+void InventoryStore::growIfNeeded() {
+    if ((liveCount + 1) * 2 <= slots.size()) return;
+    rehash(slots.size() * 2);
+}
+
+void InventoryStore::eraseSlot(size_t slot) {
+    size_t hole = slot;
+    size_t next = (hole + 1) & slotMask;
+    while (slots[next] != EMPTY_SLOT) {
+        size_t home = hashId(idAt(slots[next])) & slotMask;
+        // Move the entry back if the hole lies on its probe path (home..next, wrapping)
+        if (((next - home) & slotMask) >= ((next - hole) & slotMask)) {
+            slots[hole] = slots[next];
+            hole = next;
+        }
+        next = (next + 1) & slotMask;
+    }
+    slots[hole] = EMPTY_SLOT;
+}
+
+uint8_t InventoryStore::categoryCode(std::string_view category) {
+    int code = findCategoryCode(category);
+    if (code >= 0) return static_cast<uint8_t>(code);
+    categoryNames.push_back(strings.get(strings.intern(category)));
+    return static_cast<uint8_t>(categoryNames.size() - 1);
+}
+
+ItemChunk& InventoryStore::ownChunk(size_t row) {
+    if (chunks.use_count() > 1) chunks = std::make_shared<ChunkTable>(*chunks);
+    std::shared_ptr<ItemChunk>& chunk = (*chunks)[row / CHUNK_ROWS];
+    if (chunk.use_count() > 1) chunk = std::make_shared<ItemChunk>(*chunk);
+    return *chunk;
+}
+
+void InventoryStore::setLive(size_t row, bool live) {
+    uint64_t& word = ownChunk(row).live[(row % CHUNK_ROWS) / 64];
+    uint64_t bit = uint64_t(1) << (row % 64);
+    word = live ? (word | bit) : (word & ~bit);
+}
+
+uint32_t InventoryStore::allocateRow() {
+    if (!freeRows.empty()) {
+        uint32_t row = freeRows.back();
+        freeRows.pop_back();
+        return row;
+    }
+    uint32_t row = static_cast<uint32_t>(rows++);
+    if (row / CHUNK_ROWS == chunks->size()) {
+        if (chunks.use_count() > 1) chunks = std::make_shared<ChunkTable>(*chunks);
+        chunks->push_back(std::make_shared<ItemChunk>());
+    }
+    if (row / 64 == dirtyRows.size()) dirtyRows.push_back(0);
+    if (row / 4096 == dirtyWords.size()) dirtyWords.push_back(0);
+    return row;
+}
+
+void InventoryStore::linkPosting(uint32_t row) {
+    ItemChunk& chunk = ownChunk(row);
+    uint16_t offset = static_cast<uint16_t>(row % CHUNK_ROWS);
+    uint8_t code = chunk.categoryCodes[offset];
+    if (code >= chunk.categoryRows.size()) chunk.categoryRows.resize(code + 1);
+    std::vector<uint16_t>& postings = chunk.categoryRows[code];
+    postings.insert(std::lower_bound(postings.begin(), postings.end(), offset), offset);
+}
+
+void InventoryStore::unlinkPosting(uint32_t row) {
+    ItemChunk& chunk = ownChunk(row);
+    uint16_t offset = static_cast<uint16_t>(row % CHUNK_ROWS);
+    std::vector<uint16_t>& postings = chunk.categoryRows[chunk.categoryCodes[offset]];
+    postings.erase(std::lower_bound(postings.begin(), postings.end(), offset));
+}
+
+void InventoryStore::buildOrders() const {
+    for (auto& word : dirtyRows) __atomic_store_n(&word, 0, __ATOMIC_RELAXED);
+    for (auto& word : dirtyWords) __atomic_store_n(&word, 0, __ATOMIC_RELAXED);
+    ordersDirty.store(false, std::memory_order_relaxed);
+    // Writers check ordersBuilt before they store; the fence makes sure that a writer that
+    // still saw it unset has its value read below, and one that saw it set marks its row
+    ordersBuilt.store(true);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    std::vector<OrderedIndex::Entry> prices, quantities;
+    prices.reserve(liveCount);
+    quantities.reserve(liveCount);
+    filedPriceKeys.assign(rows, 0);
+    filedQuantityKeys.assign(rows, 0);
+    filedRows.assign(rows, 0);
+    forEachLiveRow([&](size_t row) {
+        filedPriceKeys[row] = OrderedIndex::priceKey(priceAt(row));
+        filedQuantityKeys[row] = OrderedIndex::quantityKey(quantityAt(row));
+        filedRows[row] = 1;
+        prices.push_back({filedPriceKeys[row], static_cast<uint32_t>(row)});
+        quantities.push_back({filedQuantityKeys[row], static_cast<uint32_t>(row)});
+    });
+    std::sort(prices.begin(), prices.end());
+    std::sort(quantities.begin(), quantities.end());
+    priceOrder.assign(prices);
+    quantityOrder.assign(quantities);
+}
+
+void InventoryStore::refileRow(uint32_t row) const {
+    if (filedRows.size() < rows) {
+        filedPriceKeys.resize(rows);
+        filedQuantityKeys.resize(rows);
+        filedRows.resize(rows);
+    }
+    bool live = isLive(row);
+    if (filedRows[row] && !live) {
+        priceOrder.erase(filedPriceKeys[row], row);
+        quantityOrder.erase(filedQuantityKeys[row], row);
+        filedRows[row] = 0;
+        return;
+    }
+    if (!live) return;
+    uint64_t price = OrderedIndex::priceKey(priceAt(row));
+    uint64_t quantity = OrderedIndex::quantityKey(quantityAt(row));
+    if (!filedRows[row]) {
+        priceOrder.insert(price, row);
+        quantityOrder.insert(quantity, row);
+    } else {
+        if (price != filedPriceKeys[row]) {
+            priceOrder.erase(filedPriceKeys[row], row);
+            priceOrder.insert(price, row);
+        }
+        if (quantity != filedQuantityKeys[row]) {
+            quantityOrder.erase(filedQuantityKeys[row], row);
+            quantityOrder.insert(quantity, row);
+        }
+    }
+    filedPriceKeys[row] = price;
+    filedQuantityKeys[row] = quantity;
+    filedRows[row] = 1;
+}
+
+void InventoryStore::refileDirtyRows() const {
+    if (!ordersDirty.exchange(false, std::memory_order_acquire)) return;
+    for (size_t block = 0; block < dirtyWords.size(); ++block) {
+        if (__atomic_load_n(&dirtyWords[block], __ATOMIC_RELAXED) == 0) continue;
+        uint64_t words = __atomic_exchange_n(&dirtyWords[block], 0, __ATOMIC_ACQUIRE);
+        for (; words != 0; words &= words - 1) {
+            size_t word = block * 64 + __builtin_ctzll(words);
+            uint64_t bits = __atomic_exchange_n(&dirtyRows[word], 0, __ATOMIC_ACQUIRE);
+            for (; bits != 0; bits &= bits - 1) refileRow(static_cast<uint32_t>(word * 64 + __builtin_ctzll(bits)));
+        }
+    }
+}
+
+void InventoryStore::ensureOrders() const {
+    if (ordersBuilt.load(std::memory_order_acquire) && !ordersDirty.load(std::memory_order_acquire)) return;
+    std::unique_lock<std::shared_mutex> lock(orderLock);
+    if (!ordersBuilt.load(std::memory_order_relaxed)) {
+        buildOrders();
+    }
+    refileDirtyRows();
+}
+
+void InventoryStore::markDirty(uint32_t row, bool filed) {
+    if (!filed) return;
+    uint64_t bit = uint64_t(1) << (row % 64);
+    uint64_t before = __atomic_fetch_or(&dirtyRows[row / 64], bit, __ATOMIC_RELEASE);
+    // Only the mark that makes the word non-zero flags the word
+    if (before == 0) __atomic_fetch_or(&dirtyWords[row / 4096], uint64_t(1) << (row / 64 % 64), __ATOMIC_RELEASE);
+    if (!ordersDirty.load(std::memory_order_relaxed)) ordersDirty.store(true, std::memory_order_release);
+}
+
+void InventoryStore::ensureTextIndex() const {
+    {
+        std::shared_lock<std::shared_mutex> lock(textLock);
+        if (textIndexBuilt) return;
+    }
+    std::unique_lock<std::shared_mutex> lock(textLock);
+    if (textIndexBuilt) return;
+    forEachLiveRow([&](size_t row) {
+        textIndex.insert(static_cast<uint32_t>(row), idAt(row));
+        textIndex.insert(static_cast<uint32_t>(row), nameAt(row));
+    });
+    staleTextRows = 0;
+    textIndexBuilt = true;
+}
+
+void InventoryStore::indexText(uint32_t row) {
+    std::unique_lock<std::shared_mutex> lock(textLock);
+    if (!textIndexBuilt) return;
+    textIndex.insert(row, idAt(row));
+    textIndex.insert(row, nameAt(row));
+}
+
+void InventoryStore::dropTextIndex() {
+    std::unique_lock<std::shared_mutex> lock(textLock);
+    textIndex.clear();
+    textIndexBuilt = false;
+}
+
+double InventoryStore::similarity(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b) {
+    size_t shared = 0;
+    for (size_t i = 0, j = 0; i < a.size() && j < b.size();) {
+        if (a[i] == b[j]) {
+            ++shared;
+            ++i;
+            ++j;
+        } else if (a[i] < b[j]) {
+            ++i;
+        } else {
+            ++j;
+        }
+    }
+    return double(shared) / double(a.size() + b.size() - shared);
+}
+
+InventoryStore::InventoryStore()
+    : slots(16, EMPTY_SLOT), slotMask(15) {
+    for (const char* name : CATEGORY_NAMES) categoryNames.push_back(strings.get(strings.intern(name)));
+}
+
+bool InventoryStore::isShared(size_t row) const {
+    return chunks.use_count() > 1 || (*chunks)[row / CHUNK_ROWS].use_count() > 1;
+}
+
+void InventoryStore::reserve(size_t count) {
+    chunks->reserve((count + CHUNK_ROWS - 1) / CHUNK_ROWS);
+    strings.reserve(count * 2);  // An ID and a name per item
+    size_t capacity = slots.size();
+    while (capacity < count * 2) capacity *= 2;
+    if (capacity != slots.size()) rehash(capacity);
+}
+
+bool InventoryStore::contains(std::string_view id) const {
+    STAT_SCOPE(STAT_FIND);
+    return rowOf(id) != EMPTY_SLOT;
+}
+
+ItemRef InventoryStore::find(std::string_view id) const {
+    STAT_SCOPE(STAT_FIND);
+    int row = rowOf(id);
+    return row == EMPTY_SLOT ? ItemRef() : at(static_cast<size_t>(row));
+}
+
+bool InventoryStore::add(std::string_view id, std::string_view name, int quantity, Money price,
+                         std::string_view category) {
+    STAT_SCOPE(STAT_ADD);
+    growIfNeeded();
+    size_t slot = probe(id);
+    if (slots[slot] != EMPTY_SLOT) return false;
+
+    uint32_t row = allocateRow();
+    uint8_t code = categoryCode(category);
+    ItemChunk& chunk = ownChunk(row);
+    size_t offset = row % CHUNK_ROWS;
+    chunk.ids[offset] = strings.get(strings.intern(id));
+    chunk.names[offset] = strings.get(strings.intern(name));
+    chunk.quantities[offset] = quantity;
+    chunk.prices[offset] = price.getCents();
+    chunk.categoryCodes[offset] = code;
+    linkPosting(row);
+    setLive(row, true);
+    ++liveCount;
+    slots[slot] = static_cast<int>(row);
+    markDirty(row, ordersBuilt.load(std::memory_order_acquire));
+    indexText(row);
+
+    for (auto* listener : listeners) listener->onAdd(at(row));
+    return true;
+}
+
+bool InventoryStore::add(const Item& item) {
+    return add(item.getId(), item.getName(), item.getQuantity(), item.getPrice(), item.getCategory());
+}
+
+bool InventoryStore::setQuantity(std::string_view id, int quantity) {
+    STAT_SCOPE(STAT_SET_QUANTITY);
+    int row = rowOf(id);
+    if (row == EMPTY_SLOT) return false;
+    bool filed = ordersBuilt.load(std::memory_order_acquire);
+    __atomic_store_n(&ownChunk(row).quantities[row % CHUNK_ROWS], quantity, __ATOMIC_RELAXED);
+    markDirty(row, filed);
+    for (auto* listener : listeners) listener->onQuantityChange(idAt(row), quantity);
+    return true;
+}
+
+bool InventoryStore::setPrice(std::string_view id, Money price) {
+    STAT_SCOPE(STAT_SET_PRICE);
+    int row = rowOf(id);
+    if (row == EMPTY_SLOT) return false;
+    bool filed = ordersBuilt.load(std::memory_order_acquire);
+    __atomic_store_n(&ownChunk(row).prices[row % CHUNK_ROWS], price.getCents(), __ATOMIC_RELAXED);
+    markDirty(row, filed);
+    for (auto* listener : listeners) listener->onPriceChange(idAt(row), price);
+    return true;
+}
+
+InventoryStore::AdjustResult InventoryStore::adjustQuantity(std::string_view id, int delta, AdjustMode mode,
+                                                            int* quantity) {
+    STAT_SCOPE(STAT_ADJUST_QUANTITY);
+    int row = rowOf(id);
+    if (row == EMPTY_SLOT) return NOT_FOUND;
+
+    bool filed = ordersBuilt.load(std::memory_order_acquire);
+    int* counter = &ownChunk(row).quantities[row % CHUNK_ROWS];
+    int current = __atomic_load_n(counter, __ATOMIC_RELAXED);
+    int updated;
+    do {
+        int64_t wanted = int64_t(current) + delta;
+        if (wanted < 0 && mode == FLOOR_AT_ZERO) wanted = 0;
+        if (wanted > INT_MAX || wanted < INT_MIN) return OUT_OF_RANGE;
+        if (wanted < 0 && mode == REJECT_IF_INSUFFICIENT) return REJECTED;
+        updated = static_cast<int>(wanted);
+    } while (!__atomic_compare_exchange_n(counter, &current, updated, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    markDirty(row, filed);
+
+    for (auto* listener : listeners) listener->onQuantityAdjust(idAt(row), updated - current, updated);
+    if (quantity != nullptr) *quantity = updated;
+    return ADJUSTED;
+}
+
+size_t InventoryStore::adjustQuantities(const std::vector<QuantityDelta>& deltas, AdjustMode mode,
+                                        std::vector<AdjustResult>* results) {
+    size_t applied = 0;
+    if (results != nullptr) results->assign(deltas.size(), ADJUSTED);
+    for (size_t i = 0; i < deltas.size(); ++i) {
+        AdjustResult result = adjustQuantity(deltas[i].id, deltas[i].delta, mode);
+        if (result == ADJUSTED) ++applied;
+        if (results != nullptr) (*results)[i] = result;
+    }
+    return applied;
+}
+
+bool InventoryStore::removeListener(InventoryListener* listener) {
+    auto found = std::find_if(listeners.begin(), listeners.end(), [&](InventoryListener* l) { return l == listener; });
+    if (found == listeners.end()) return false;
+    listeners.erase(found);
+    return true;
+}
+
+std::vector<uint32_t> InventoryStore::rowsInOrder(OrderedField field, bool ascending) const {
+    std::vector<uint32_t> order;
+    order.reserve(liveCount);
+    walkInOrder(field, ascending, [&](uint32_t row) {
+        order.push_back(row);
+        return true;
+    });
+    return order;
+}
+
+std::vector<uint32_t> InventoryStore::topRows(OrderedField field, size_t count, bool highest) const {
+    std::vector<uint32_t> top;
+    if (count == 0) return top;
+    walkInOrder(field, !highest, [&](uint32_t row) {
+        top.push_back(row);
+        return top.size() < count;
+    });
+    return top;
+}
+
+std::vector<uint32_t> InventoryStore::rowsWithPriceBetween(Money low, Money high) const {
+    std::vector<uint32_t> found;
+    walkInOrder(PRICE_ORDER, true, OrderedIndex::priceKey(low), [&](uint32_t row) {
+        if (priceAt(row) > high) return false;
+        found.push_back(row);
+        return true;
+    });
+    return found;
+}
+
+std::vector<uint32_t> InventoryStore::rowsWithQuantityBetween(int low, int high) const {
+    std::vector<uint32_t> found;
+    walkInOrder(QUANTITY_ORDER, true, OrderedIndex::quantityKey(low), [&](uint32_t row) {
+        if (quantityAt(row) > high) return false;
+        found.push_back(row);
+        return true;
+    });
+    return found;
+}
+
+std::vector<uint32_t> InventoryStore::searchText(std::string_view text, TextMatch match, size_t limit) const {
+    STAT_SCOPE(STAT_TEXT_SEARCH);
+    std::vector<uint32_t> found;
+    if (text.empty()) return found;
+    ensureTextIndex();
+    std::shared_lock<std::shared_mutex> lock(textLock);
+
+    // Prefixes are anchored by the front padding; a substring's trigrams are all inside it
+    std::vector<uint32_t> grams;
+    TrigramIndex::gramsOf(text, match != SUBSTRING_MATCH, match == FUZZY_MATCH, grams);
+
+    struct Ranked {
+        uint32_t row;
+        double score;  // Lower ranks first
+        size_t length;
+    };
+    std::vector<Ranked> ranked;
+    SelectionBitmap seen(rowCount());  // A reused row can be listed twice in a posting
+
+    // Posting lists of the query's trigrams, rarest first; a missing trigram has an empty list
+    static const std::vector<uint32_t> none;
+    std::vector<const std::vector<uint32_t>*> lists;
+    for (uint32_t gram : grams) {
+        const std::vector<uint32_t>* rows = textIndex.rowsWith(gram);
+        lists.push_back(rows == nullptr ? &none : rows);
+    }
+    std::sort(lists.begin(), lists.end(),
+              [](const std::vector<uint32_t>* a, const std::vector<uint32_t>* b) { return a->size() < b->size(); });
+
+    if (match == FUZZY_MATCH) {
+        // A match shares at least minShared trigrams with the text, so it is on at least one
+        // of the grams - minShared + 1 rarest lists (prefix filtering); the common ones are skipped
+        size_t minShared = static_cast<size_t>(ceil(FUZZY_THRESHOLD * grams.size()));
+        lists.resize(grams.size() - std::max<size_t>(minShared, 1) + 1);
+        std::vector<uint32_t> idGrams, nameGrams;
+        for (const std::vector<uint32_t>* rows : lists) {
+            for (uint32_t row : *rows) {
+                if (seen.test(row) || !isLive(row)) continue;
+                seen.set(row);
+                TrigramIndex::gramsOf(idAt(row), true, true, idGrams);
+                TrigramIndex::gramsOf(nameAt(row), true, true, nameGrams);
+                double best = std::max(similarity(grams, idGrams), similarity(grams, nameGrams));
+                if (best >= FUZZY_THRESHOLD) ranked.push_back({row, -best, nameAt(row).size()});
+            }
+        }
+    } else {
+        auto rank = [&](uint32_t row) {
+            if (seen.test(row) || !isLive(row)) return;
+            seen.set(row);
+            std::string_view id = idAt(row), name = nameAt(row);
+            size_t inId = findIgnoreCase(id, text), inName = findIgnoreCase(name, text);
+            if (match == PREFIX_MATCH) {
+                inId = (inId == 0) ? 0 : std::string_view::npos;
+                inName = (inName == 0) ? 0 : std::string_view::npos;
+            }
+            if (inId == std::string_view::npos && inName == std::string_view::npos) return;
+            bool exact = (inId == 0 && id.size() == text.size()) || (inName == 0 && name.size() == text.size());
+            double position = double(std::min(inId, inName));
+            ranked.push_back({row, exact ? -1.0 : position, name.size()});
+        };
+
+        if (grams.empty()) {
+            // Fewer than three characters to look for inside the text: check every row
+            forEachLiveRow([&](size_t row) { rank(static_cast<uint32_t>(row)); });
+        } else if (lists.size() > 1 && lists[1]->size() <= 4 * lists[0]->size()) {
+            // Every match holds all the trigrams: check only rows on both of the two rarest lists
+            SelectionBitmap rarest(rowCount());
+            for (uint32_t row : *lists[0]) rarest.set(row);
+            for (uint32_t row : *lists[1]) {
+                if (rarest.test(row)) rank(row);
+            }
+        } else {
+            for (uint32_t row : *lists[0]) rank(row);
+        }
+    }
+
+    auto better = [](const Ranked& a, const Ranked& b) {
+        if (a.score != b.score) return a.score < b.score;
+        if (a.length != b.length) return a.length < b.length;
+        return a.row < b.row;
+    };
+    size_t count = (limit == 0) ? ranked.size() : std::min(limit, ranked.size());
+    std::partial_sort(ranked.begin(), ranked.begin() + count, ranked.end(), better);
+    found.reserve(count);
+    for (size_t i = 0; i < count; ++i) found.push_back(ranked[i].row);
+    return found;
+}
+
+bool InventoryStore::remove(std::string_view id) {
+    STAT_SCOPE(STAT_REMOVE);
+    size_t slot = probe(id);
+    int found = slots[slot];
+    if (found == EMPTY_SLOT) return false;
+    uint32_t row = static_cast<uint32_t>(found);
+    std::string_view removedId = idAt(row);  // Interned, so the view outlives the tombstone
+    eraseSlot(slot);
+
+    // Tombstone the row: outstanding handles go stale and the row is reused by a later add
+    unlinkPosting(row);
+    if (textIndexBuilt && ++staleTextRows > liveCount) dropTextIndex();
+    setLive(row, false);
+    ++ownChunk(row).generations[row % CHUNK_ROWS];
+    freeRows.push_back(row);
+    --liveCount;
+    markDirty(row, ordersBuilt.load(std::memory_order_acquire));
+
+    for (auto* listener : listeners) listener->onRemove(removedId);
+    return true;
+}
+
+bool InventoryStore::needsCompaction() const {
+    return rows >= CHUNK_ROWS && deadCount() * 2 >= rows;
+}
+
+size_t InventoryStore::compact() {
+    STAT_SCOPE(STAT_COMPACT);
+    size_t moved = 0;
+    uint32_t write = 0;
+    for (uint32_t row = 0; row < rows; ++row) {
+        if (!isLive(row)) continue;
+        if (row != write) {
+            unlinkPosting(row);
+            ItemChunk& from = ownChunk(row);
+            ItemChunk& to = ownChunk(write);
+            size_t source = row % CHUNK_ROWS, target = write % CHUNK_ROWS;
+            to.ids[target] = from.ids[source];
+            to.names[target] = from.names[source];
+            to.quantities[target] = from.quantities[source];
+            to.prices[target] = from.prices[source];
+            to.categoryCodes[target] = from.categoryCodes[source];
+            ++to.generations[target];    // The row held a dead item until now
+            ++from.generations[source];  // Handles to the moved item must not follow it
+            setLive(write, true);
+            setLive(row, false);
+            linkPosting(write);
+            ++moved;
+        }
+        ++write;
+    }
+    rows = write;
+    freeRows.clear();
+    if (moved > 0) {
+        rehash(slots.size());
+        dropTextIndex();
+        std::unique_lock<std::shared_mutex> lock(orderLock);
+        ordersBuilt.store(false);  // Rows moved; the ordered indexes are rebuilt on next use
+    }
+    return moved;
+}
+
+size_t ConcurrentInventory::stripeOfThread() {
+    static std::atomic<size_t> nextStripe(0);
+    thread_local size_t stripe = nextStripe.fetch_add(1, std::memory_order_relaxed) % READ_STRIPES;
+    return stripe;
+}
+
+size_t ConcurrentInventory::size() const {
+    ReadGuard guard(*this);
+    return store.size();
+}
+
+bool ConcurrentInventory::contains(std::string_view id) const {
+    ReadGuard guard(*this);
+    return store.contains(id);
+}
+
+bool ConcurrentInventory::find(std::string_view id, Item& item) const {
+    ReadGuard guard(*this);
+    ItemRef found = store.find(id);
+    if (!found) return false;
+    item = Item(found.getId(), found.getName(), found.getQuantity(), found.getPrice(), found.getCategory());
+    return true;
+}
+
+bool ConcurrentInventory::add(const Item& item) {
+    WriteGuard guard(*this);
+    return store.add(item);
+}
+
+bool ConcurrentInventory::remove(std::string_view id) {
+    WriteGuard guard(*this);
+    return store.remove(id);
+}
+
+bool ConcurrentInventory::setQuantity(std::string_view id, int quantity) {
+    return updateItem(id, false, false, [&] { return store.setQuantity(id, quantity); });
+}
+
+bool ConcurrentInventory::setPrice(std::string_view id, Money price) {
+    return updateItem(id, false, false, [&] { return store.setPrice(id, price); });
+}
+
+InventoryStore::AdjustResult ConcurrentInventory::adjustQuantity(std::string_view id, int delta,
+                                                                 InventoryStore::AdjustMode mode, int* quantity) {
+    return updateItem(id, true, InventoryStore::NOT_FOUND,
+                      [&] { return store.adjustQuantity(id, delta, mode, quantity); });
+}
+
+size_t ConcurrentInventory::adjustQuantities(const std::vector<InventoryStore::QuantityDelta>& deltas,
+                                             InventoryStore::AdjustMode mode,
+                                             std::vector<InventoryStore::AdjustResult>* results) {
+    {
+        ReadGuard guard(*this);
+        bool shared = false;
+        for (const auto& delta : deltas) {
+            ItemRef item = store.find(delta.id);
+            if (item && store.isShared(item.getRow())) shared = true;
+        }
+        if (!shared) {
+            size_t applied = 0;
+            if (results != nullptr) results->assign(deltas.size(), InventoryStore::ADJUSTED);
+            for (size_t i = 0; i < deltas.size(); ++i) {
+                ItemRef item = store.find(deltas[i].id);
+                InventoryStore::AdjustResult result = InventoryStore::NOT_FOUND;
+                if (item) {
+                    std::shared_lock<std::shared_mutex> itemGuard(itemLockOf(item));
+                    result = store.adjustQuantity(deltas[i].id, deltas[i].delta, mode);
+                }
+                if (result == InventoryStore::ADJUSTED) ++applied;
+                if (results != nullptr) (*results)[i] = result;
+            }
+            return applied;
+        }
+    }
+    WriteGuard guard(*this);
+    return store.adjustQuantities(deltas, mode, results);
+}
+
+InventoryView ConcurrentInventory::snapshot() const {
+    WriteGuard guard(*this);
+    return store.snapshot();
+}
+
+void ConcurrentInventory::addListener(InventoryListener* listener) {
+    WriteGuard guard(*this);
+    store.addListener(listener);
+}
+
+void ConcurrentInventory::compactIfNeeded() {
+    WriteGuard guard(*this);
+    if (store.needsCompaction()) store.compact();
+}
+
+void ItemRef::display(std::ostream& out) const {
+    out << "Category: " << getCategory() << "\n"
+        << "ID: " << getId() << "\n"
+        << "Item Name: " << getName() << "\n"
+        << "Price: " << getPrice() << "\n"
+        << "Quantity: " << getQuantity() << "\n";
+}
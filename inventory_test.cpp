@@ -0,0 +1,1317 @@
+// Tests for the inventory core, run by ctest; prints every failed check and exits non-zero if any failed
+#include "inventory_core.h"
+#include <set>
+using namespace std;
+
+static int failures = 0;
+
+#define CHECK(condition)                                                                      \
+    do {                                                                                      \
+        if (!(condition)) {                                                                   \
+            cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed\n";        \
+            ++failures;                                                                       \
+        }                                                                                     \
+    } while (0)
+
+static string formatted(Money money) {
+    ostringstream out;
+    out << money;
+    return out.str();
+}
+
+void testNumberParsing() {
+    int count = 7;
+    CHECK(parseCount("42", count) == NUMBER_OK && count == 42);
+    CHECK(parseCount("12x", count) == NUMBER_MALFORMED && count == 42);  // Left alone on failure
+    CHECK(parseCount("", count) == NUMBER_EMPTY);
+    CHECK(parseCount("99999999999", count) == NUMBER_OUT_OF_RANGE);
+    CHECK(parseSignedCount("+5", count) == NUMBER_OK && count == 5);
+    CHECK(parseSignedCount("-3", count) == NUMBER_OK && count == -3);
+    CHECK(parseQuantity("0", count) == NUMBER_NOT_POSITIVE);
+
+    Money price;
+    CHECK(parseMoney("19.99", price) == NUMBER_OK && price.getCents() == 1999);
+    CHECK(parseMoney(".5", price) == NUMBER_OK && price.getCents() == 50);
+    CHECK(parseMoney("0.005", price) == NUMBER_OK && price.getCents() == 1);
+    CHECK(parseMoney("1.2.3", price) == NUMBER_MALFORMED);
+    CHECK(parsePrice("0", price) == NUMBER_NOT_POSITIVE);
+    CHECK(parsePrice("9999999999.99", price) == NUMBER_OK && price == MAX_PRICE);
+    CHECK(parsePrice("10000000000", price) == NUMBER_TOO_MANY_DIGITS);
+    CHECK(formatted(Money::fromCents(123405)) == "1234.05");
+    CHECK(formatted(Money::fromCents(7)) == "0.07");
+
+    Category category;
+    CHECK(parseCategory("Electronics", category) && category == ELECTRONICS);
+    CHECK(!parseCategory("food", category));
+}
+
+void testAddAndValidate() {
+    InventoryStore store;
+    InventoryCore core(store);
+
+    CHECK(core.addItem("abc1", "Denim jacket", 3, Money::fromCents(4999), "Clothing") == ITEM_OK);
+    ItemRef item = core.findItem("ABC1");
+    CHECK(item && item.getId() == "ABC1" && item.getCategory() == "clothing");
+    CHECK(core.isDuplicateId("abc1"));
+    CHECK(core.addItem("ABC1", "Another", 1, Money::fromCents(100), "clothing") == ITEM_DUPLICATE_ID);
+    CHECK(core.addItem("A-1", "Bad ID", 1, Money::fromCents(100), "clothing") == ITEM_INVALID_ID);
+    CHECK(core.addItem("", "No ID", 1, Money::fromCents(100), "clothing") == ITEM_INVALID_ID);
+    CHECK(core.addItem("B2", "Bread", 1, Money::fromCents(100), "food") == ITEM_INVALID_CATEGORY);
+    CHECK(core.addItem("B2", "Cable", 0, Money::fromCents(100), "electronics") == ITEM_INVALID_QUANTITY);
+    CHECK(core.addItem("B2", "Cable", 1, Money(), "electronics") == ITEM_INVALID_PRICE);
+    CHECK(core.addItem("longidentifier2024", "Scarf", 4, Money::fromCents(1500), "clothing") == ITEM_OK);
+    CHECK(core.findItem("LONGIDENTIFIER2024").getId() == "LONGIDENTIFIER2024");  // Past the small-string buffer
+    CHECK(store.size() == 2);
+}
+
+void testUpdates() {
+    InventoryStore store;
+    InventoryCore core(store);
+    core.addItem("C1", "Charger", 10, Money::fromCents(1500), "electronics");
+    ItemRef item = core.findItem("C1");
+
+    CHECK(core.setQuantity("c1", 4) == ITEM_OK && item.getQuantity() == 4);
+    CHECK(core.setQuantity("C1", -1) == ITEM_INVALID_QUANTITY && item.getQuantity() == 4);
+    CHECK(core.setPrice("C1", Money::fromCents(1250)) == ITEM_OK && item.getPrice().getCents() == 1250);
+    CHECK(core.setPrice("NOPE", Money::fromCents(1250)) == ITEM_NOT_FOUND);
+    CHECK(core.adjustQuantity("C1", +6) == ITEM_OK && item.getQuantity() == 10);
+    CHECK(core.adjustQuantity("C1", -11) == ITEM_INSUFFICIENT_STOCK && item.getQuantity() == 10);
+    CHECK(core.adjustQuantity("C1", -11, InventoryStore::FLOOR_AT_ZERO) == ITEM_OK && item.getQuantity() == 0);
+    CHECK(core.adjustQuantity("NOPE", 1) == ITEM_NOT_FOUND);
+    CHECK(core.setQuantity("C1", INT_MAX - 1) == ITEM_OK);
+    CHECK(core.adjustQuantity("C1", 2) == ITEM_QUANTITY_OUT_OF_RANGE && item.getQuantity() == INT_MAX - 1);
+    CHECK(store.adjustQuantity("C1", INT_MIN, InventoryStore::ALLOW_NEGATIVE) == InventoryStore::ADJUSTED);
+    CHECK(store.adjustQuantity("C1", INT_MIN, InventoryStore::ALLOW_NEGATIVE) == InventoryStore::OUT_OF_RANGE);
+    CHECK(item.getQuantity() == -2);
+
+    CHECK(core.removeItem("c1") == ITEM_OK);
+    CHECK(!item);  // The handle goes stale with its item
+    CHECK(core.removeItem("C1") == ITEM_NOT_FOUND);
+    CHECK(store.empty());
+}
+
+// Records whether the store still held the item when the removal was reported
+struct RemoveWatcher : InventoryListener {
+    const InventoryStore& store;
+    bool sawCommitted = false;
+    explicit RemoveWatcher(const InventoryStore& watched) : store(watched) {}
+    void onAdd(const ItemRef&) override {}
+    void onRemove(string_view id) override { sawCommitted = !store.contains(id) && id == "R1"; }
+    void onQuantityChange(string_view, int) override {}
+    void onPriceChange(string_view, Money) override {}
+};
+
+void testListenersSeeCommittedRemove() {
+    InventoryStore store;
+    InventoryCore core(store);
+    core.addItem("R1", "Radio", 1, Money::fromCents(2500), "electronics");
+    RemoveWatcher watcher(store);
+    store.addListener(&watcher);
+    CHECK(core.removeItem("R1") == ITEM_OK);
+    CHECK(watcher.sawCommitted);
+    store.removeListener(&watcher);
+}
+
+void testQueries() {
+    InventoryStore store;
+    InventoryCore core(store);
+    core.addItem("S1", "Wool socks", 2, Money::fromCents(899), "clothing");
+    core.addItem("M1", "Monitor", 7, Money::fromCents(19900), "electronics");
+    core.addItem("P1", "Jigsaw puzzle", 5, Money::fromCents(1450), "entertainment");
+    core.addItem("H1", "Hoodie", 30, Money::fromCents(3500), "clothing");
+
+    vector<ItemRef> clothing = core.itemsInCategory(CLOTHING);
+    CHECK(clothing.size() == 2);
+
+    vector<ItemRef> low = core.lowStockItems();
+    CHECK(low.size() == 2);  // Socks (2) and the puzzle (5), the threshold is inclusive
+    CHECK(core.lowStockItems(1).empty());
+
+    vector<ItemRef> byPrice = core.sortedItems({{SortEngine::BY_PRICE, true}});
+    CHECK(byPrice.size() == 4 && byPrice.front().getId() == "S1" && byPrice.back().getId() == "M1");
+    vector<ItemRef> grouped = core.sortedItems({{SortEngine::BY_CATEGORY, true}, {SortEngine::BY_QUANTITY, false}});
+    CHECK(grouped.size() == 4 && grouped[0].getId() == "H1" && grouped[1].getId() == "S1" && grouped[3].getId() == "P1");
+
+    vector<ItemRef> found = core.searchItems("puzz", InventoryStore::SUBSTRING_MATCH);
+    CHECK(found.size() == 1 && found[0].getId() == "P1");
+    found = core.searchItems("mon", InventoryStore::PREFIX_MATCH, 5);
+    CHECK(found.size() == 1 && found[0].getId() == "M1");
+
+    // 2 * 8.99 + 7 * 199.00 + 5 * 14.50 + 30 * 35.00
+    CHECK(core.totalValue() == 1798 + 139300 + 7250 + 105000);
+}
+
+// Walks the store in price order and checks the walk holds every live row exactly once, in order
+static bool walksInPriceOrder(const InventoryStore& store) {
+    vector<uint32_t> walked;
+    store.walkInOrder(InventoryStore::PRICE_ORDER, true, 0, [&](uint32_t row) {
+        walked.push_back(row);
+        return true;
+    });
+    for (size_t i = 1; i < walked.size(); ++i) {
+        if (store.priceAt(walked[i - 1]) > store.priceAt(walked[i])) return false;
+    }
+    sort(walked.begin(), walked.end());
+    return walked.size() == store.size() && adjacent_find(walked.begin(), walked.end()) == walked.end() &&
+           all_of(walked.begin(), walked.end(), [&](uint32_t row) { return store.isLive(row); });
+}
+
+void testOrdersFollowChanges() {
+    InventoryStore store;
+    for (int i = 0; i < 200; ++i) {
+        store.add("O" + to_string(i), "Item", i, Money::fromCents(100 + (i * 37) % 500), "other");
+    }
+    CHECK(walksInPriceOrder(store));  // Builds the indexes
+
+    // Changes after the build are only marked and refiled by the next walk
+    store.setPrice("O5", Money::fromCents(1));
+    store.adjustQuantity("O6", 1000);
+    store.remove("O7");
+    store.add("N1", "New", 1, Money::fromCents(99999), "other");  // Reuses O7's row
+    store.remove("O8");
+    CHECK(walksInPriceOrder(store));
+    uint32_t first = 0;
+    store.walkInOrder(InventoryStore::PRICE_ORDER, true, 0, [&](uint32_t row) {
+        first = row;
+        return false;
+    });
+    CHECK(store.idAt(first) == "O5");
+    uint32_t last = 0;
+    store.walkInOrder(InventoryStore::QUANTITY_ORDER, false, UINT64_MAX, [&](uint32_t row) {
+        last = row;
+        return false;
+    });
+    CHECK(store.idAt(last) == "O6");
+
+    store.compact();
+    CHECK(walksInPriceOrder(store));
+}
+
+// Small deterministic generator so failures reproduce
+static uint32_t nextRandom(uint64_t& state) {
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return static_cast<uint32_t>(state >> 33);
+}
+
+static string readFile(const string& path) {
+    ifstream in(path, ios::binary);
+    ostringstream text;
+    text << in.rdbuf();
+    return text.str();
+}
+
+static void writeFile(const string& path, const string& text) {
+    ofstream out(path, ios::binary);
+    out << text;
+}
+
+void testOrderedIndex() {
+    // Enough entries for several branch levels, few keys so equal keys span leaves
+    OrderedIndex index;
+    set<pair<uint64_t, uint32_t>> expected;
+    uint64_t state = 1;
+    for (int step = 0; step < 60000; ++step) {
+        uint64_t key = nextRandom(state) % 500;
+        uint32_t row = nextRandom(state) % 20000;
+        if (step % 3 == 2 && !expected.empty()) {
+            CHECK(index.erase(key, row) == (expected.erase({key, row}) == 1));
+        } else if (expected.insert({key, row}).second) {
+            index.insert(key, row);
+        }
+    }
+    // Erase most of it again so nodes underflow, borrow and merge
+    auto erased = expected.begin();
+    while (expected.size() > 300) {
+        CHECK(index.erase(erased->first, erased->second));
+        erased = expected.erase(erased);
+        if (erased == expected.end()) erased = expected.begin();
+        for (int skip = 0; skip < 3 && erased != expected.end(); ++skip) ++erased;
+        if (erased == expected.end()) erased = expected.begin();
+    }
+    CHECK(!index.erase(1000, 0));
+    CHECK(index.size() == expected.size());
+
+    for (uint64_t bound : {uint64_t(0), uint64_t(250), uint64_t(499), uint64_t(600)}) {
+        vector<pair<uint64_t, uint32_t>> walked;
+        index.forEachAscending(bound, [&](const OrderedIndex::Entry& entry) {
+            walked.push_back({entry.key, entry.row});
+            return true;
+        });
+        CHECK(equal(walked.begin(), walked.end(), expected.lower_bound({bound, 0}), expected.end()) &&
+              walked.size() == size_t(distance(expected.lower_bound({bound, 0}), expected.end())));
+
+        walked.clear();
+        index.forEachDescending(bound, [&](const OrderedIndex::Entry& entry) {
+            walked.push_back({entry.key, entry.row});
+            return true;
+        });
+        auto through = expected.upper_bound({bound, UINT32_MAX});
+        CHECK(walked.size() == size_t(distance(expected.begin(), through)) &&
+              equal(walked.begin(), walked.end(), make_reverse_iterator(through)));
+    }
+}
+
+void testFilterKernelsAgree() {
+    InventoryStore store;
+    for (int i = 0; i < 5000; ++i) {  // Not a multiple of any vector width
+        store.add("F" + to_string(i), "Filtered", i % 97, Money::fromCents(i % 1000 * 13), CATEGORY_NAMES[i % CATEGORY_COUNT]);
+    }
+    for (int i = 0; i < 5000; i += 11) store.remove("F" + to_string(i));
+
+    auto rowsOf = [](const SelectionBitmap& bits) {
+        vector<size_t> rows;
+        bits.forEach([&](size_t row) {
+            rows.push_back(row);
+            return true;
+        });
+        return rows;
+    };
+    FilterEngine filter;
+    filter.useKernel(FilterEngine::SCALAR);
+    vector<size_t> quantity = rowsOf(filter.quantityAtMost(store, 40));
+    vector<size_t> price = rowsOf(filter.priceBetween(store, Money::fromCents(1300), Money::fromCents(6500)));
+    vector<size_t> category = rowsOf(filter.categoryEquals(store, 2));
+    CHECK(!quantity.empty() && !price.empty() && !category.empty());
+    for (FilterEngine::Kernel kernel : {FilterEngine::SSE2, FilterEngine::AVX2}) {
+        filter.useKernel(kernel);
+        CHECK(rowsOf(filter.quantityAtMost(store, 40)) == quantity);
+        CHECK(rowsOf(filter.priceBetween(store, Money::fromCents(1300), Money::fromCents(6500))) == price);
+        CHECK(rowsOf(filter.categoryEquals(store, 2)) == category);
+    }
+}
+
+void testConcurrentUpdates() {
+    ConcurrentInventory inventory;
+    const int ITEMS = 64, THREADS = 4, ROUNDS = 2000;
+    for (int i = 0; i < ITEMS; ++i) {
+        inventory.add(Item("C" + to_string(i), "Shared", 1000, Money::fromCents(100), "entertainment"));
+    }
+    inventory.add(Item("LAST", "Last one", 100, Money::fromCents(100), "entertainment"));
+
+    atomic<int> taken(0);
+    vector<thread> threads;
+    for (int t = 0; t < THREADS; ++t) {
+        threads.emplace_back([&, t] {
+            for (int round = 0; round < ROUNDS; ++round) {
+                string id = "C" + to_string((round + t) % ITEMS);
+                inventory.adjustQuantity(id, (t % 2 == 0) ? +3 : -1);
+                inventory.setPrice(id, Money::fromCents(100 + round % 50));
+                // Only as much stock as there is can be taken out
+                if (inventory.adjustQuantity("LAST", -1, InventoryStore::REJECT_IF_INSUFFICIENT) == InventoryStore::ADJUSTED) ++taken;
+                // Items that come and go, each thread its own
+                string temporary = "T" + to_string(t) + "X" + to_string(round % 8);
+                if (!inventory.remove(temporary)) inventory.add(Item(temporary, "Temporary", 1, Money::fromCents(1), "entertainment"));
+            }
+        });
+    }
+    // Ordered walks refile the rows while the writers keep changing them
+    threads.emplace_back([&] {
+        for (int walk = 0; walk < 200; ++walk) {
+            size_t visited = 0;
+            inventory.read([&](const InventoryStore& store) {
+                store.walkInOrder(InventoryStore::PRICE_ORDER, true, 0, [&](uint32_t) { return ++visited > 0; });
+                return 0;
+            });
+            CHECK(visited >= size_t(ITEMS) + 1);
+        }
+    });
+    for (auto& worker : threads) worker.join();
+
+    // Each thread adjusts every item the same number of times: two add 3, two take 1
+    int64_t total = 0;
+    for (int i = 0; i < ITEMS; ++i) {
+        Item item("", "", 0, Money(), "");
+        CHECK(inventory.find("C" + to_string(i), item));
+        total += item.getQuantity();
+    }
+    CHECK(total == int64_t(ITEMS) * 1000 + int64_t(ROUNDS) * 2 * 3 - int64_t(ROUNDS) * 2);
+    Item last("", "", 0, Money(), "");
+    CHECK(taken == 100 && inventory.find("LAST", last) && last.getQuantity() == 0);
+    CHECK(inventory.size() == size_t(ITEMS) + 1);  // Every temporary item was removed again
+    inventory.read([&](const InventoryStore& store) {
+        CHECK(walksInPriceOrder(store));
+        return 0;
+    });
+}
+
+void testCsvImport() {
+    string path = "inventory_test_" + to_string(getpid()) + ".csv";
+    string log;
+    CsvImporter::Report report;
+
+    // Header in another column order, quoted fields with separators, quotes and outer spaces
+    writeFile(path, "Name,ID,Quantity,Price,Category\n"
+                    "\"Chair, \"\"deluxe\"\"\",ch1,4,59.90,entertainment\n"
+                    "  \" Padded \" , CH2 , 2 , 5 , clothing\n"
+                    "\n"
+                    "Lamp,L1,3,abc,entertainment\n"
+                    "\"Broken,L2,1,1,entertainment\n"
+                    "Copy,CH1,1,1,entertainment\n");
+    {
+        InventoryStore store;
+        CsvImporter importer(store);
+        ostringstream errors;
+        CHECK(importer.import(path, report, errors));
+        log = errors.str();
+        CHECK(report.rows == 5 && report.imported == 2 && report.rejected == 3);
+        CHECK(store.find("CH1").getName() == "Chair, \"deluxe\"" && store.find("CH1").getPrice().getCents() == 5990);
+        CHECK(store.find("ch2").getName() == " Padded " && store.find("CH2").getCategory() == "clothing");
+        CHECK(log.find(path + ":5: invalid price 'abc'") != string::npos);
+        CHECK(log.find(path + ":6: unbalanced quotes") != string::npos);
+        CHECK(log.find(path + ":7: an item with ID 'CH1' already exists") != string::npos);
+    }
+
+    // Tab-separated without a header takes the ADD order: category, id, price, quantity, name
+    writeFile(path, "electronics\tT1\t9.99\t5\tTab cable, long\n"
+                    "food\tT2\t1\t1\tBread\n");
+    {
+        InventoryStore store;
+        CsvImporter importer(store);
+        ostringstream errors;
+        CHECK(importer.import(path, report, errors) && report.imported == 1);
+        CHECK(store.find("T1").getName() == "Tab cable, long");
+        CHECK(errors.str() == path + ":2: invalid category 'food'\n");
+    }
+
+    // Big enough to be parsed in several chunks; line numbers run on across chunk boundaries
+    string text = "category,id,price,quantity,name\n";
+    const int LINES = 120000;
+    for (int i = 0; i < LINES; ++i) {
+        if (i % 25000 == 7) {
+            text += "entertainment,BAD" + to_string(i) + ",x,1,Broken\n";
+        } else {
+            text += "entertainment,P" + to_string(i) + ",1.25," + to_string(i % 50 + 1) + ",Part number " + to_string(i) + "\n";
+        }
+    }
+    writeFile(path, text);
+    {
+        InventoryStore store;
+        CsvImporter importer(store);
+        ostringstream errors;
+        CHECK(importer.import(path, report, errors));
+        CHECK(report.rows == size_t(LINES) && report.rejected == 5 && store.size() == size_t(LINES) - 5);
+        string expected;
+        for (int i = 7; i < LINES; i += 25000) expected += path + ":" + to_string(i + 2) + ": invalid price 'x' (not a number)\n";
+        CHECK(errors.str() == expected);
+        CHECK(store.find("P119999").getName() == "Part number 119999");
+    }
+    remove(path.c_str());
+}
+
+void testExportRoundTrips() {
+    string path = "inventory_test_" + to_string(getpid()) + ".export";
+    InventoryStore store;
+    store.add("E1", "Plain", 3, Money::fromCents(250), "electronics");
+    store.add("E2", "Comma, \"quoted\"", 1, Money::fromCents(99999), "clothing");
+    store.add("E3", " Spaced ", 70, Money::fromCents(1), "entertainment");
+    vector<uint32_t> rows = {2, 0, 1};
+
+    auto sameItems = [&](const InventoryStore& copy) {
+        if (copy.size() != store.size()) return false;
+        for (ItemRef item : store) {
+            ItemRef other = copy.find(item.getId());
+            if (!other || other.getName() != item.getName() || other.getCategory() != item.getCategory() ||
+                other.getQuantity() != item.getQuantity() || other.getPrice() != item.getPrice()) return false;
+        }
+        return true;
+    };
+
+    InventoryExporter exporter;
+    CHECK(exporter.write(path, InventoryExporter::CSV_FORMAT, store, rows));
+    InventoryStore fromCsv;
+    CsvImporter importer(fromCsv);
+    CsvImporter::Report report;
+    ostringstream errors;
+    CHECK(importer.import(path, report, errors) && report.rejected == 0 && sameItems(fromCsv));
+
+    CHECK(exporter.write(path, InventoryExporter::JSONL_FORMAT, store, {1}));
+    CHECK(readFile(path) == "{\"category\":\"clothing\",\"id\":\"E2\",\"name\":\"Comma, \\\"quoted\\\"\","
+                            "\"quantity\":1,\"price\":999.99}\n");
+
+    CHECK(exporter.write(path, InventoryExporter::BINARY_FORMAT, store, rows));
+    InventoryStore fromBinary;
+    InventorySnapshot snapshot(path);
+    CHECK(snapshot.load(fromBinary) && sameItems(fromBinary));
+    remove(path.c_str());
+}
+
+void testSearchAfterRowReuse() {
+    InventoryStore store;
+    InventoryCore core(store);
+    core.addItem("AW1", "Apple watch", 1, Money::fromCents(29900), "electronics");
+    core.addItem("BK1", "Bookshelf", 1, Money::fromCents(8900), "entertainment");
+    CHECK(core.searchItems("apple", InventoryStore::PREFIX_MATCH).size() == 1);  // Builds the index
+
+    core.removeItem("AW1");
+    core.addItem("BB1", "Banana bread", 1, Money::fromCents(450), "entertainment");  // Takes AW1's row
+    CHECK(core.searchItems("apple", InventoryStore::PREFIX_MATCH).empty());
+    CHECK(core.searchItems("aple watch", InventoryStore::FUZZY_MATCH).empty());
+    vector<ItemRef> found = core.searchItems("banana", InventoryStore::PREFIX_MATCH);
+    CHECK(found.size() == 1 && found[0].getId() == "BB1");
+    found = core.searchItems("banan bred", InventoryStore::FUZZY_MATCH);
+    CHECK(!found.empty() && found[0].getId() == "BB1");
+    found = core.searchItems("bb", InventoryStore::PREFIX_MATCH);
+    CHECK(found.size() == 1 && found[0].getId() == "BB1");
+}
+
+void testCompactionStalesMovedHandles() {
+    InventoryStore store;
+    store.add("K1", "Kept", 1, Money::fromCents(100), "entertainment");
+    store.add("G1", "Gone", 2, Money::fromCents(200), "entertainment");
+    store.add("M1", "Moved", 3, Money::fromCents(300), "entertainment");
+    ItemRef kept = store.find("K1"), gone = store.find("G1"), moved = store.find("M1");
+    store.remove("G1");
+    CHECK(!gone && moved);
+
+    CHECK(store.compact() == 1 && store.rowCount() == 2);
+    CHECK(kept && kept.getName() == "Kept");  // Stayed in its row
+    CHECK(!moved && !gone);
+    ItemRef found = store.find("M1");
+    CHECK(found && found.getRow() == 1 && found.getQuantity() == 3);
+    store.add("G2", "Again", 1, Money::fromCents(1), "entertainment");
+    CHECK(!gone && !moved);  // Reusing the rows doesn't revive old handles
+}
+
+void testViewIsolation() {
+    InventoryStore store;
+    for (int i = 0; i < 3000; ++i) store.add("V" + to_string(i), "Viewed", 10, Money::fromCents(500), "entertainment");
+    InventoryView view = store.snapshot();
+
+    store.setQuantity("V1", 99);
+    store.setPrice("V2000", Money::fromCents(1));
+    store.adjustQuantity("V2999", -10);
+    store.remove("V5");
+    store.add("NEW", "Added later", 1, Money::fromCents(1), "entertainment");
+    store.compact();
+
+    CHECK(view.size() == 3000 && store.size() == 3000);
+    size_t seen = 0;
+    int64_t value = 0;
+    for (ItemRef item : view) {
+        ++seen;
+        value += item.getQuantity() * item.getPrice().getCents();
+        CHECK(item.getId() != "NEW");
+    }
+    CHECK(seen == 3000 && value == 3000 * 10 * 500);
+    CHECK(view.at(1).getQuantity() == 10 && view.at(5).getId() == "V5" && view.at(5));
+    CHECK(store.find("V1").getQuantity() == 99 && store.find("V2000").getPrice().getCents() == 1);
+    CHECK(!store.find("V5") && store.find("NEW"));
+}
+
+// Collects the rows the category's posting lists hold
+static vector<uint32_t> postedRows(const ItemColumns& columns, uint8_t code) {
+    vector<uint32_t> rows;
+    columns.forEachInCategory(code, [&](uint32_t row) {
+        rows.push_back(row);
+        return true;
+    });
+    return rows;
+}
+
+void testCategoryPostings() {
+    InventoryStore store;
+    for (int i = 0; i < 3000; ++i) store.add("P" + to_string(i), "Posted", 1, Money::fromCents(100), CATEGORY_NAMES[i % 3]);
+    for (int i = 0; i < 3000; i += 4) store.remove("P" + to_string(i));
+    store.add("R1", "Reused", 1, Money::fromCents(100), "clothing");  // Takes the last freed row
+    InventoryView view = store.snapshot();
+
+    // The lists match a scan of the codes and stay in row order
+    FilterEngine filter;
+    for (uint8_t code = 0; code < CATEGORY_COUNT; ++code) {
+        vector<uint32_t> scanned;
+        filter.categoryEquals(store, code).forEach([&](size_t row) {
+            if (store.isLive(row)) scanned.push_back(static_cast<uint32_t>(row));
+            return true;
+        });
+        CHECK(postedRows(store, code) == scanned);
+        CHECK(store.categoryRows(code).count() == scanned.size());
+    }
+    CHECK(postedRows(store, 7).empty());  // No such code yet
+
+    // A view keeps the lists it was taken with through removes, adds and compaction
+    vector<uint32_t> clothing = postedRows(view, CLOTHING);
+    store.remove("P3");
+    store.add("N1", "New", 1, Money::fromCents(100), "clothing");
+    CHECK(store.compact() > 0);
+    CHECK(postedRows(view, CLOTHING) == clothing);
+    vector<uint32_t> compacted = postedRows(store, CLOTHING);
+    CHECK(compacted.size() == clothing.size());  // P3 went, N1 came
+    CHECK(all_of(compacted.begin(), compacted.end(), [&](uint32_t row) { return store.categoryAt(row) == "clothing"; }));
+    CHECK(is_sorted(compacted.begin(), compacted.end()));
+    InventoryCore core(store);
+    CHECK(core.itemsInCategory(ELECTRONICS).size() == postedRows(store, ELECTRONICS).size());
+}
+
+void testStockReport() {
+    InventoryStore store;
+    InventoryCore core(store);
+    core.addItem("S1", "Wool socks", 2, Money::fromCents(899), "clothing");
+    core.addItem("H1", "Hoodie", 30, Money::fromCents(3500), "clothing");
+    core.addItem("M1", "Monitor", 7, Money::fromCents(19900), "electronics");
+
+    ReportEngine::Report report = core.stockReport();
+    const ReportEngine::Totals& clothing = report.categories[CLOTHING];
+    CHECK(clothing.items == 2 && clothing.units == 32 && clothing.value == 2 * 899 + 30 * 3500);
+    CHECK(clothing.minPrice().getCents() == 899 && clothing.maxPrice().getCents() == 3500);
+    CHECK(clothing.averagePrice().getCents() == 2200);  // 21.995 rounds up
+    CHECK(report.categories[ENTERTAINMENT].items == 0);
+    CHECK(report.overall.items == 3 && report.overall.value == core.totalValue());
+    CHECK(report.quantityHistogram[ReportEngine::quantityBucket(2)] == 1);  // 2-3
+    CHECK(report.quantityHistogram[ReportEngine::quantityBucket(7)] == 1);  // 4-7
+    CHECK(ReportEngine::quantityBucket(0) == 0 && ReportEngine::quantityBucket(1) == 1);
+    CHECK(ReportEngine::quantityBucket(INT_MAX) == ReportEngine::QUANTITY_BUCKETS - 1);
+
+    // Split across threads, with removed rows in between, the totals come out the same
+    for (int i = 0; i < 100000; ++i) {
+        string id = "R" + to_string(i);
+        core.addItem(id, "Row", i % 300 + 1, Money::fromCents(i % 5000 + 1), CATEGORY_NAMES[i % CATEGORY_COUNT]);
+        if (i % 7 == 0) core.removeItem(id);
+    }
+    ReportEngine::Report single = core.stockReport(1), parallel = core.stockReport(4);
+    CHECK(parallel.threads == 4 && parallel.overall.items == store.size());
+    CHECK(parallel.overall.value == single.overall.value && parallel.overall.value == core.totalValue());
+    CHECK(parallel.overall.units == single.overall.units && parallel.overall.priceSum == single.overall.priceSum);
+    for (size_t code = 0; code < CATEGORY_COUNT; ++code) {
+        CHECK(parallel.categories[code].items == single.categories[code].items);
+        CHECK(parallel.categories[code].minCents == single.categories[code].minCents);
+        CHECK(parallel.categories[code].maxCents == single.categories[code].maxCents);
+    }
+    CHECK(equal(begin(parallel.quantityHistogram), end(parallel.quantityHistogram), begin(single.quantityHistogram)));
+}
+
+void testSnapshotRoundTrip() {
+    string path = "inventory_test_" + to_string(getpid()) + ".snap";
+    InventoryStore saved;
+    InventoryCore core(saved);
+    core.addItem("K1", "Keyboard", 12, Money::fromCents(4599), "electronics");
+    core.addItem("N1", "Novel", 3, Money::fromCents(1299), "entertainment");
+
+    InventorySnapshot snapshot(path);
+    CHECK(snapshot.save(saved));
+    InventoryStore loaded;
+    CHECK(snapshot.load(loaded));
+    CHECK(loaded.size() == 2);
+    ItemRef item = loaded.find("k1");
+    CHECK(item && item.getName() == "Keyboard" && item.getQuantity() == 12 && item.getPrice().getCents() == 4599);
+
+    // Strings past 64 KiB keep their full length and don't shift the strings saved after them
+    string longId(70000, 'L'), longName(70000, 'n');
+    saved.add(longId, longName, 1, Money::fromCents(100), "clothing");
+    saved.add("Z9", "After", 2, Money::fromCents(200), "clothing");
+    CHECK(snapshot.save(saved));
+    InventoryStore reloaded;
+    CHECK(snapshot.load(reloaded) && reloaded.size() == 4);
+    CHECK(reloaded.find(longId).getName() == longName);
+    CHECK(reloaded.find("Z9").getName() == "After");
+
+    // Crafted headers and records are rejected instead of wrapping the size check or loading
+    // values addItem would refuse. Header: magic[8], version, recordSize, itemCount at 16,
+    // heapSize at 24; the first record's price sits at 32 within it.
+    CHECK(snapshot.save(saved));
+    string good = readFile(path);
+    auto loadsPatched = [&](size_t offset, uint64_t value) {
+        string patched = good;
+        memcpy(&patched[offset], &value, sizeof(value));
+        writeFile(path, patched);
+        InventoryStore target;
+        return snapshot.load(target);
+    };
+    CHECK(!loadsPatched(24, UINT64_MAX));
+    CHECK(!loadsPatched(16, UINT64_MAX / 40 + 1));
+    CHECK(!loadsPatched(40 + 32, uint64_t(-5)));
+    CHECK(!loadsPatched(40 + 32, uint64_t(MAX_PRICE.getCents()) + 1));
+    CHECK(loadsPatched(40 + 32, 1));
+    string lowercase = good;
+    lowercase[40 + 4 * 40] = 'k';  // First character of the heap, K1's ID
+    writeFile(path, lowercase);
+    InventoryStore rejected;
+    CHECK(!snapshot.load(rejected));
+    remove(path.c_str());
+}
+
+void testJournalReplay() {
+    string path = "inventory_test_" + to_string(getpid()) + ".wal";
+    string error;
+    {
+        InventoryStore store;
+        InventoryCore core(store);
+        WriteAheadLog journal(path, chrono::microseconds(0));
+        CHECK(journal.open(error));
+        store.addListener(&journal);
+        core.addItem("W1", "Water bottle", 8, Money::fromCents(1250), "entertainment");
+        core.addItem("W2", "Wallet", 1, Money::fromCents(2999), "clothing");
+        core.setQuantity("W1", 6);
+        core.setPrice("W1", Money::fromCents(1100));
+        core.adjustQuantity("W1", -2);
+        core.removeItem("W2");
+        store.removeListener(&journal);
+    }
+
+    InventoryStore replayed;
+    WriteAheadLog journal(path);
+    size_t applied = 0;
+    CHECK(journal.replay(replayed, applied, error) && applied == 6);
+    ItemRef item = replayed.find("w1");
+    CHECK(replayed.size() == 1 && item && item.getName() == "Water bottle");
+    CHECK(item.getQuantity() == 4 && item.getPrice().getCents() == 1100);
+    remove(path.c_str());
+}
+
+// A crash after the snapshot is saved but before the log is emptied must not apply its changes twice
+void testReplayAfterMissedCheckpoint() {
+    string snapshotPath = "inventory_test_" + to_string(getpid()) + "_checkpoint.snap";
+    string logPath = "inventory_test_" + to_string(getpid()) + "_checkpoint.wal";
+    string error;
+    {
+        InventoryStore store;
+        InventoryCore core(store);
+        WriteAheadLog journal(logPath, chrono::microseconds(0));
+        CHECK(journal.open(error));
+        store.addListener(&journal);
+        core.addItem("A1", "Anvil", 10, Money::fromCents(9900), "entertainment");
+        core.adjustQuantity("A1", +5);
+        InventorySnapshot snapshot(snapshotPath);
+        snapshot.setCheckpointLsn(journal.getLastLsn());
+        CHECK(snapshot.save(store));  // No checkpoint() after it, the log keeps both records
+        core.adjustQuantity("A1", -3);
+        store.removeListener(&journal);
+    }
+
+    InventoryStore restored;
+    InventorySnapshot snapshot(snapshotPath);
+    CHECK(snapshot.load(restored) && snapshot.getCheckpointLsn() == 2);
+    WriteAheadLog journal(logPath);
+    size_t applied = 0;
+    CHECK(journal.replay(restored, applied, error, snapshot.getCheckpointLsn()) && applied == 1);
+    CHECK(restored.find("A1").getQuantity() == 12);
+    CHECK(journal.getLastLsn() == 3);  // New records are numbered after the replayed ones
+    remove(snapshotPath.c_str());
+    remove(logPath.c_str());
+}
+
+// A checkpoint keeps the records newer than the snapshot, including those appended while it runs
+void testCheckpointKeepsNewerRecords() {
+    string path = "inventory_test_" + to_string(getpid()) + "_tail.wal";
+    string error;
+    InventoryStore store;
+    InventoryCore core(store);
+    const int ADJUSTMENTS = 2000;
+    {
+        WriteAheadLog journal(path, chrono::microseconds(0));
+        CHECK(journal.open(error));
+        journal.setWaitForDurability(false);
+        store.addListener(&journal);
+        core.addItem("T1", "Tape", 1, Money::fromCents(300), "entertainment");
+        uint64_t snapshotLsn = journal.getLastLsn();  // A snapshot taken now holds T1
+
+        // Records keep arriving, and being written by the flusher, while the log is checkpointed
+        thread writer([&] {
+            for (int i = 0; i < ADJUSTMENTS; ++i) journal.onQuantityAdjust("T1", 1, 0);
+        });
+        for (int i = 0; i < 20; ++i) CHECK(journal.checkpoint(snapshotLsn));
+        writer.join();
+        CHECK(journal.sync());
+        store.removeListener(&journal);
+    }
+    InventoryStore restored;
+    restored.add("T1", "Tape", 1, Money::fromCents(300), "entertainment");
+    WriteAheadLog journal(path);
+    size_t applied = 0;
+    CHECK(journal.replay(restored, applied, error, 1) && applied == size_t(ADJUSTMENTS));
+    CHECK(restored.find("T1").getQuantity() == 1 + ADJUSTMENTS);
+
+    // Once the snapshot holds every record the log is emptied
+    CHECK(journal.open(error) && journal.checkpoint(journal.getLastLsn()));
+    journal.close();
+    CHECK(readFile(path).empty());
+    remove(path.c_str());
+}
+
+void testLatencyHistogram() {
+    // Every bucket starts right after the previous one ends, and values land in their own bucket
+    for (size_t b = 1; b < LatencyHistogram::BUCKET_COUNT; ++b) {
+        CHECK(LatencyHistogram::bucketStart(b) > LatencyHistogram::bucketStart(b - 1));
+        CHECK(LatencyHistogram::bucketOf(LatencyHistogram::bucketStart(b)) == b);
+        CHECK(LatencyHistogram::bucketOf(LatencyHistogram::bucketStart(b) - 1) == b - 1);
+    }
+    CHECK(LatencyHistogram::bucketOf(UINT64_MAX) == LatencyHistogram::BUCKET_COUNT - 1);
+
+    LatencyHistogram histogram;
+    for (uint64_t ticks = 1; ticks <= 1000; ++ticks) histogram.record(ticks);
+    CHECK(histogram.getCount() == 1000 && histogram.getMaxTicks() == 1000);
+    CHECK(histogram.getTotalTicks() == 500500);
+    uint64_t median = histogram.percentile(0.5);
+    CHECK(median >= 500 && median <= 500 + 500 / 16);  // Within one bucket
+    CHECK(histogram.percentile(1.0) == 1000);
+    histogram.reset();
+    CHECK(histogram.getCount() == 0 && histogram.percentile(0.5) == 0);
+}
+
+void testHashIndex() {
+    InventoryStore store;
+    // Well past the initial 16 slots so the table doubles several times
+    for (int i = 0; i < 3000; ++i) {
+        CHECK(store.add("K" + to_string(i), "Item", i + 1, Money::fromCents(100), "clothing"));
+    }
+    CHECK(store.size() == 3000);
+    CHECK(!store.add("K42", "Again", 1, Money::fromCents(100), "clothing"));
+    CHECK(store.contains("k2999") && !store.contains("K3000"));
+    CHECK(store.find("k17").getQuantity() == 18);
+
+    // Removing every third ID shifts entries back along their probe chains; the rest must stay reachable
+    for (int i = 0; i < 3000; i += 3) CHECK(store.remove("K" + to_string(i)));
+    CHECK(!store.remove("K0"));
+    bool allFound = true;
+    for (int i = 0; i < 3000; ++i) {
+        if (store.contains("K" + to_string(i)) != (i % 3 != 0)) allFound = false;
+    }
+    CHECK(allFound);
+    CHECK(store.add("K3", "Back", 5, Money::fromCents(100), "clothing") && store.find("k3").getName() == "Back");
+}
+
+void testSortMatchesStableSort() {
+    InventoryStore store;
+    const char* categories[] = {"electronics", "clothing", "entertainment"};
+    uint64_t state = 2;
+    for (int i = 0; i < 2500; ++i) {
+        // Few distinct values so the later keys and the tie order both matter
+        store.add("S" + to_string(i), "Item", static_cast<int>(nextRandom(state) % 20) - 5,
+                  Money::fromCents(1 + nextRandom(state) % 40), categories[nextRandom(state) % 3]);
+    }
+    vector<vector<SortEngine::SortKey>> keyLists = {
+        {{SortEngine::BY_PRICE, true}},
+        {{SortEngine::BY_QUANTITY, false}},
+        {{SortEngine::BY_CATEGORY, false}, {SortEngine::BY_PRICE, true}},
+        {{SortEngine::BY_CATEGORY, true}, {SortEngine::BY_QUANTITY, true}, {SortEngine::BY_PRICE, false}},
+    };
+    SortEngine engine;
+    for (const auto& keys : keyLists) {
+        vector<uint32_t> expected;
+        store.forEachLiveRow([&](size_t row) { expected.push_back(static_cast<uint32_t>(row)); });
+        stable_sort(expected.begin(), expected.end(), [&](uint32_t a, uint32_t b) {
+            for (const auto& key : keys) {
+                int order = 0;
+                switch (key.field) {
+                    case SortEngine::BY_CATEGORY: order = store.categoryAt(a).compare(store.categoryAt(b)); break;
+                    case SortEngine::BY_PRICE: order = (store.priceAt(a) > store.priceAt(b)) - (store.priceAt(a) < store.priceAt(b)); break;
+                    case SortEngine::BY_QUANTITY: order = (store.quantityAt(a) > store.quantityAt(b)) - (store.quantityAt(a) < store.quantityAt(b)); break;
+                }
+                if (order != 0) return key.ascending ? order < 0 : order > 0;
+            }
+            return false;
+        });
+        CHECK(engine.sortedOrder(store, keys) == expected);
+    }
+    CHECK(engine.sortedOrder(InventoryStore(), {{SortEngine::BY_PRICE, true}}).empty());
+}
+
+void testSnapshotEdgeCases() {
+    string path = "inventory_test_" + to_string(getpid()) + "_edges.snap";
+    InventorySnapshot snapshot(path);
+    InventoryStore empty;
+    CHECK(snapshot.load(empty) && empty.size() == 0 && snapshot.getCheckpointLsn() == 0);  // No file yet
+
+    // Saving a view with chosen rows writes only those rows, in the given order
+    ConcurrentInventory inventory;
+    inventory.add(Item("G1", "Glove", 4, Money::fromCents(1200), "clothing"));
+    inventory.add(Item("G2", "Game", 9, Money::fromCents(5999), "entertainment"));
+    inventory.add(Item("G3", "Gadget", 1, Money::fromCents(2500), "electronics"));
+    InventoryView view = inventory.snapshot();
+    vector<uint32_t> rows = {2, 0};
+    snapshot.setCheckpointLsn(7);
+    CHECK(snapshot.save(view, &rows));
+    InventoryStore loaded;
+    CHECK(snapshot.load(loaded) && loaded.size() == 2 && snapshot.getCheckpointLsn() == 7);
+    CHECK(loaded.idAt(0) == "G3" && loaded.idAt(1) == "G1" && !loaded.contains("G2"));
+
+    // Files that are not snapshots of this version are refused with a reason
+    string good = readFile(path);
+    string badMagic = good;
+    badMagic[0] = 'X';
+    writeFile(path, badMagic);
+    InventoryStore target;
+    CHECK(!snapshot.load(target) && !snapshot.getError().empty() && target.size() == 0);
+    string badVersion = good;
+    badVersion[8] = 3;
+    writeFile(path, badVersion);
+    CHECK(!snapshot.load(target));
+    writeFile(path, good.substr(0, good.size() - 1));
+    CHECK(!snapshot.load(target));
+    remove(path.c_str());
+}
+
+// A crash mid-append leaves a torn record at the end; replay stops there and the log carries on after it
+void testJournalTornTail() {
+    string path = "inventory_test_" + to_string(getpid()) + "_torn.wal";
+    string error;
+    {
+        InventoryStore store;
+        InventoryCore core(store);
+        WriteAheadLog journal(path, chrono::microseconds(0));
+        CHECK(journal.open(error));
+        store.addListener(&journal);
+        core.addItem("L1", "Lamp", 2, Money::fromCents(3999), "electronics");
+        core.setQuantity("L1", 5);
+        core.setQuantity("L1", 9);
+        store.removeListener(&journal);
+    }
+    string intact = readFile(path);
+    writeFile(path, intact.substr(0, intact.size() - 3));  // The last record loses its end
+
+    size_t applied = 0;
+    {
+        InventoryStore store;
+        WriteAheadLog journal(path, chrono::microseconds(0));
+        CHECK(journal.replay(store, applied, error) && applied == 2 && store.find("L1").getQuantity() == 5);
+        CHECK(journal.getLastLsn() == 2);
+        CHECK(journal.open(error));
+        store.addListener(&journal);
+        store.setQuantity("L1", 6);
+        store.removeListener(&journal);
+    }
+    InventoryStore store;
+    WriteAheadLog journal(path);
+    CHECK(journal.replay(store, applied, error) && applied == 3 && store.find("L1").getQuantity() == 6);
+
+    // A flipped bit fails the checksum, so nothing from that record on is applied
+    string corrupt = readFile(path);
+    corrupt[corrupt.size() - 1] ^= 0x10;
+    writeFile(path, corrupt);
+    InventoryStore partial;
+    CHECK(journal.replay(partial, applied, error) && applied == 2 && partial.find("L1").getQuantity() == 5);
+    remove(path.c_str());
+}
+
+// Rows spill over several chunks; every column must read back what was stored, across the seams too
+void testColumnsAcrossChunks() {
+    InventoryStore store;
+    const size_t COUNT = 3 * CHUNK_ROWS + 17;
+    for (size_t i = 0; i < COUNT; ++i) {
+        store.add("C" + to_string(i), "Name" + to_string(i), static_cast<int>(i), Money::fromCents(static_cast<int64_t>(i) * 3 + 1),
+                  i % 2 ? "electronics" : "clothing");
+    }
+    CHECK(store.chunkCount() == 4 && store.rowsInChunk(3) == 17 && store.rowsInChunk(0) == CHUNK_ROWS);
+    bool columnsMatch = true;
+    for (size_t row : {size_t(0), CHUNK_ROWS - 1, CHUNK_ROWS, 2 * CHUNK_ROWS + 5, COUNT - 1}) {
+        ItemRef item = store.at(row);
+        columnsMatch = columnsMatch && item.getId() == "C" + to_string(row) && item.getName() == "Name" + to_string(row)
+                       && item.getQuantity() == static_cast<int>(row) && item.getPrice().getCents() == static_cast<int64_t>(row) * 3 + 1
+                       && item.getCategory() == (row % 2 ? "electronics" : "clothing");
+    }
+    CHECK(columnsMatch);
+    // One dictionary code per category, shared by its rows in every chunk
+    CHECK(store.categoryCodeAt(0) == store.categoryCodeAt(3 * CHUNK_ROWS));
+    CHECK(store.categoryCodeAt(0) != store.categoryCodeAt(1));
+
+    // Summing a column chunk by chunk over the live bits matches the per-item total
+    int64_t quantities = 0;
+    for (size_t c = 0; c < store.chunkCount(); ++c) {
+        const ItemChunk& chunk = store.getChunk(c);
+        for (size_t offset = 0; offset < store.rowsInChunk(c); ++offset) {
+            if ((chunk.live[offset / 64] >> (offset % 64)) & 1) quantities += chunk.quantities[offset];
+        }
+    }
+    CHECK(quantities == static_cast<int64_t>(COUNT) * (COUNT - 1) / 2);
+    size_t visited = 0;
+    for (const auto& item : store) visited += item ? 1 : 0;
+    CHECK(visited == COUNT);
+}
+
+// Every kernel must match a plain loop at the extremes of the value range, on the bounds
+// themselves, and for row counts that leave a partial vector at the end
+void testFilterKernelEdges() {
+    const int quantities[] = {INT_MIN, -1, 0, 5, 6, INT_MAX - 1, INT_MAX};
+    const int64_t cents[] = {1, 99, 100, 101, 4999, 5000, 5001, MAX_PRICE.getCents()};
+    for (size_t count : {size_t(1), size_t(7), size_t(33), size_t(70)}) {
+        InventoryStore store;
+        for (size_t i = 0; i < count; ++i) {
+            store.add("E" + to_string(i), "Edge", quantities[i % 7], Money::fromCents(cents[i % 8]), CATEGORY_NAMES[i % CATEGORY_COUNT]);
+        }
+        FilterEngine filter;
+        for (FilterEngine::Kernel kernel : {FilterEngine::SCALAR, FilterEngine::SSE2, FilterEngine::AVX2}) {
+            filter.useKernel(kernel);
+            for (int maximum : {INT_MIN, 5, INT_MAX}) {
+                SelectionBitmap bits = filter.quantityAtMost(store, maximum);
+                size_t expected = 0;
+                for (size_t row = 0; row < count; ++row) expected += store.quantityAt(row) <= maximum;
+                CHECK(bits.count() == expected);
+            }
+            SelectionBitmap bits = filter.priceBetween(store, Money::fromCents(100), Money::fromCents(5000));
+            size_t expected = 0;
+            for (size_t row = 0; row < count; ++row) {
+                int64_t price = store.priceAt(row).getCents();
+                expected += price >= 100 && price <= 5000;
+            }
+            CHECK(bits.count() == expected);
+            CHECK(filter.priceBetween(store, MAX_PRICE, MAX_PRICE).count() == count / 8);  // Every eighth row
+        }
+    }
+}
+
+// Removal leaves a tombstone whose row the next add takes, most recently freed first
+void testTombstoneReuse() {
+    InventoryStore store;
+    for (int i = 0; i < 10; ++i) store.add("T" + to_string(i), "Item", i, Money::fromCents(100), "clothing");
+    ItemRef third = store.find("T3"), seventh = store.find("T7"), kept = store.find("T5");
+    CHECK(store.remove("T3") && store.remove("T7"));
+    CHECK(store.size() == 8 && store.rowCount() == 10 && store.deadCount() == 2);
+    CHECK(!third && !seventh && kept && !store.isLive(3));
+
+    store.add("N1", "New", 1, Money::fromCents(100), "clothing");
+    store.add("N2", "New", 2, Money::fromCents(100), "clothing");
+    CHECK(store.find("N1").getRow() == 7 && store.find("N2").getRow() == 3 && store.rowCount() == 10);
+    CHECK(!third && !seventh);  // The rows are live again but under a new generation
+    CHECK(kept && kept.getQuantity() == 5);
+
+    // Compaction is only asked for once half of at least a chunk of rows are dead
+    InventoryStore large;
+    for (size_t i = 0; i < CHUNK_ROWS; ++i) large.add("L" + to_string(i), "Item", 1, Money::fromCents(100), "clothing");
+    for (size_t i = 0; i < CHUNK_ROWS / 2 - 1; ++i) large.remove("L" + to_string(i));
+    CHECK(!large.needsCompaction());
+    large.remove("L" + to_string(CHUNK_ROWS / 2 - 1));
+    CHECK(large.needsCompaction());
+    large.compact();
+    CHECK(!large.needsCompaction() && large.rowCount() == CHUNK_ROWS / 2 && large.deadCount() == 0);
+    CHECK(!store.needsCompaction());  // Too few rows to be worth it
+}
+
+// Readers, under a read stripe or on a snapshot, never see half of a change made under write()
+void testConcurrentReadersSeeWholeChanges() {
+    ConcurrentInventory inventory;
+    const int ITEMS = 16, MOVES = 3000;
+    for (int i = 0; i < ITEMS; ++i) inventory.add(Item("R" + to_string(i), "Stock", 100, Money::fromCents(100), "clothing"));
+    auto totalOf = [](const ItemColumns& columns) {
+        int64_t total = 0;
+        for (const auto& item : columns) total += item.getQuantity();
+        return total;
+    };
+
+    atomic<bool> done(false);
+    thread mover([&] {
+        for (int move = 0; move < MOVES; ++move) {
+            string from = "R" + to_string(move % ITEMS), to = "R" + to_string((move * 7 + 3) % ITEMS);
+            inventory.write([&](InventoryStore& store) {  // Moves one unit, the total stays the same
+                store.adjustQuantity(from, -1);
+                store.adjustQuantity(to, +1);
+                return 0;
+            });
+            if (move % 500 == 0) inventory.compactIfNeeded();
+        }
+        done = true;
+    });
+    vector<thread> readers;
+    atomic<int> torn(0);
+    for (int r = 0; r < 3; ++r) {
+        readers.emplace_back([&, r] {
+            while (!done) {
+                int64_t total = (r == 0) ? totalOf(inventory.snapshot())
+                                         : inventory.read([&](const InventoryStore& store) { return totalOf(store); });
+                if (total != int64_t(ITEMS) * 100) ++torn;
+            }
+        });
+    }
+    mover.join();
+    for (auto& reader : readers) reader.join();
+    CHECK(torn == 0);
+    CHECK(totalOf(inventory.snapshot()) == int64_t(ITEMS) * 100);
+}
+
+// Records the deltas listeners are told about
+struct AdjustWatcher : InventoryListener {
+    vector<int> deltas;
+    void onAdd(const ItemRef&) override {}
+    void onRemove(string_view) override {}
+    void onQuantityChange(string_view, int) override {}
+    void onPriceChange(string_view, Money) override {}
+    void onQuantityAdjust(string_view, int delta, int) override { deltas.push_back(delta); }
+};
+
+void testBatchedAdjustments() {
+    using Result = InventoryStore::AdjustResult;
+    vector<InventoryStore::QuantityDelta> deltas = {{"A1", -3}, {"NOPE", 1}, {"A1", -5}, {"B1", INT_MAX}, {"B1", -2}};
+    // The same batch on the store and through ConcurrentInventory, with and without a snapshot sharing the chunk
+    for (int variant = 0; variant < 3; ++variant) {
+        ConcurrentInventory inventory;
+        inventory.add(Item("A1", "Apples", 4, Money::fromCents(50), "entertainment"));
+        inventory.add(Item("B1", "Boxes", 1, Money::fromCents(50), "entertainment"));
+        AdjustWatcher watcher;
+        inventory.addListener(&watcher);
+        InventoryView held;
+        if (variant == 2) held = inventory.snapshot();
+
+        vector<Result> results;
+        size_t applied = (variant == 0)
+            ? inventory.write([&](InventoryStore& store) { return store.adjustQuantities(deltas, InventoryStore::FLOOR_AT_ZERO, &results); })
+            : inventory.adjustQuantities(deltas, InventoryStore::FLOOR_AT_ZERO, &results);
+        CHECK(applied == 3);
+        CHECK(results == vector<Result>({InventoryStore::ADJUSTED, InventoryStore::NOT_FOUND, InventoryStore::ADJUSTED,
+                                         InventoryStore::OUT_OF_RANGE, InventoryStore::ADJUSTED}));
+        CHECK(watcher.deltas == vector<int>({-3, -1, -1}));  // The floor clamps -5 to what was left
+        Item item("", "", 0, Money(), "");
+        CHECK(inventory.find("A1", item) && item.getQuantity() == 0);
+        CHECK(inventory.find("B1", item) && item.getQuantity() == 0);
+        if (variant == 2) CHECK(held.at(0).getQuantity() == 4 && held.at(1).getQuantity() == 1);
+    }
+
+    InventoryStore store;
+    store.add("C1", "Cups", 2, Money::fromCents(50), "entertainment");
+    int quantity = -1;
+    CHECK(store.adjustQuantity("C1", -3, InventoryStore::REJECT_IF_INSUFFICIENT, &quantity) == InventoryStore::REJECTED);
+    CHECK(quantity == -1 && store.find("C1").getQuantity() == 2);
+    CHECK(store.adjustQuantity("C1", -3, InventoryStore::ALLOW_NEGATIVE, &quantity) == InventoryStore::ADJUSTED && quantity == -1);
+}
+
+// A write under a view copies only the chunk it touches; once the view is gone writes go in place again
+void testViewCopiesOnlyChangedChunks() {
+    InventoryStore store;
+    for (size_t i = 0; i < 3 * CHUNK_ROWS; ++i) store.add("W" + to_string(i), "Item", 1, Money::fromCents(100), "clothing");
+    CHECK(!store.isShared(0));
+    const ItemChunk* before[3] = {&store.getChunk(0), &store.getChunk(1), &store.getChunk(2)};
+    {
+        InventoryView view = store.snapshot();
+        CHECK(store.isShared(0) && store.isShared(CHUNK_ROWS));
+        CHECK(&view.getChunk(1) == before[1]);  // Taking the view copied nothing
+
+        store.setQuantity("W" + to_string(CHUNK_ROWS + 1), 7);
+        CHECK(&store.getChunk(1) != before[1] && &view.getChunk(1) == before[1]);
+        CHECK(&store.getChunk(0) == before[0] && &store.getChunk(2) == before[2]);
+        CHECK(!store.isShared(CHUNK_ROWS) && store.isShared(0));
+        CHECK(view.at(CHUNK_ROWS + 1).getQuantity() == 1 && store.at(CHUNK_ROWS + 1).getQuantity() == 7);
+    }
+    CHECK(!store.isShared(0));
+    const ItemChunk* owned = &store.getChunk(0);
+    store.setPrice("W0", Money::fromCents(5));
+    CHECK(&store.getChunk(0) == owned);
+}
+
+// The indexed orders match a full sort both ways, ties included, and the range queries stop at their bounds
+void testIndexedOrdersMatchSort() {
+    InventoryStore store;
+    uint64_t state = 15;
+    for (int i = 0; i < 3000; ++i) {
+        store.add("Q" + to_string(i), "Item", static_cast<int>(nextRandom(state) % 50) - 10,
+                  Money::fromCents(1 + nextRandom(state) % 300), CATEGORY_NAMES[i % CATEGORY_COUNT]);
+    }
+    store.rowsInOrder(InventoryStore::PRICE_ORDER, true);  // Builds the indexes
+    for (int i = 0; i < 3000; i += 7) store.setPrice("Q" + to_string(i), Money::fromCents(1 + i % 300));  // Refiled lazily
+    SortEngine engine;
+    for (bool ascending : {true, false}) {
+        CHECK(store.rowsInOrder(InventoryStore::PRICE_ORDER, ascending) == engine.sortedOrder(store, {{SortEngine::BY_PRICE, ascending}}));
+        CHECK(store.rowsInOrder(InventoryStore::QUANTITY_ORDER, ascending) == engine.sortedOrder(store, {{SortEngine::BY_QUANTITY, ascending}}));
+        vector<SortEngine::SortKey> grouped = {{SortEngine::BY_CATEGORY, true}, {SortEngine::BY_QUANTITY, ascending}};
+        CHECK(engine.indexedOrder(store, grouped) == engine.sortedOrder(store, grouped));
+    }
+
+    vector<uint32_t> top = store.topRows(InventoryStore::QUANTITY_ORDER, 5, true);
+    vector<uint32_t> descending = store.rowsInOrder(InventoryStore::QUANTITY_ORDER, false);
+    CHECK(top == vector<uint32_t>(descending.begin(), descending.begin() + 5));
+    CHECK(store.topRows(InventoryStore::PRICE_ORDER, 0, true).empty());
+
+    vector<uint32_t> priced = store.rowsWithPriceBetween(Money::fromCents(100), Money::fromCents(120));
+    size_t expected = 0;
+    store.forEachLiveRow([&](size_t row) { expected += store.priceAt(row).getCents() >= 100 && store.priceAt(row).getCents() <= 120; });
+    CHECK(!priced.empty() && priced.size() == expected);
+    CHECK(store.priceAt(priced.front()).getCents() >= 100 && store.priceAt(priced.back()).getCents() <= 120);
+    vector<uint32_t> negative = store.rowsWithQuantityBetween(INT_MIN, -1);
+    CHECK(!negative.empty() && all_of(negative.begin(), negative.end(), [&](uint32_t row) { return store.quantityAt(row) < 0; }));
+}
+
+// Substring hits rank exact matches first, then earlier and shorter ones, and agree with a plain scan
+void testTextSearchRanking() {
+    InventoryStore store;
+    store.add("LAMP", "Desk light", 1, Money::fromCents(100), "electronics");
+    store.add("DL2", "Big lamp shade", 1, Money::fromCents(100), "electronics");
+    store.add("DL3", "Lamp", 1, Money::fromCents(100), "electronics");
+    store.add("DL4", "Lamppost", 1, Money::fromCents(100), "electronics");
+    store.add("DL5", "Clamp", 1, Money::fromCents(100), "electronics");
+    vector<uint32_t> found = store.searchText("LaMp", InventoryStore::SUBSTRING_MATCH);
+    vector<string_view> ids;
+    for (uint32_t row : found) ids.push_back(store.idAt(row));
+    // DL3 is the shorter exact match, DL4 the shorter name starting with the text
+    CHECK(ids == vector<string_view>({"DL3", "LAMP", "DL4", "DL5", "DL2"}));
+    CHECK(store.searchText("lamp", InventoryStore::SUBSTRING_MATCH, 2) == vector<uint32_t>(found.begin(), found.begin() + 2));
+    CHECK(store.searchText("lamp", InventoryStore::PREFIX_MATCH).size() == 3);
+    CHECK(store.searchText("", InventoryStore::SUBSTRING_MATCH).empty());
+
+    // Random names: the index must find exactly the rows a scan finds, for short queries too
+    const char* syllables[] = {"ka", "lo", "mi", "nu", "pe", "ra", "so"};
+    uint64_t state = 16;
+    for (int i = 0; i < 1500; ++i) {
+        string name;
+        for (int s = 0; s < 4; ++s) name += syllables[nextRandom(state) % 7];
+        store.add("R" + to_string(i), name, 1, Money::fromCents(100), "clothing");
+    }
+    for (string_view text : {"kalo", "mi", "nupera", "sososo", "r14"}) {
+        set<uint32_t> expected;
+        store.forEachLiveRow([&](size_t row) {
+            if (findIgnoreCase(store.idAt(row), text) != string_view::npos || findIgnoreCase(store.nameAt(row), text) != string_view::npos) {
+                expected.insert(static_cast<uint32_t>(row));
+            }
+        });
+        vector<uint32_t> hits = store.searchText(text, InventoryStore::SUBSTRING_MATCH);
+        CHECK(set<uint32_t>(hits.begin(), hits.end()) == expected && hits.size() == expected.size());
+    }
+}
+
+// Windows line ends, a missing last line break, empty and missing files, and rows with too few fields
+void testCsvImportEdgeCases() {
+    string path = "inventory_test_" + to_string(getpid()) + "_edges.csv";
+    CsvImporter::Report report;
+    InventoryStore store;
+    CsvImporter importer(store);
+    ostringstream errors;
+
+    writeFile(path, "category,id,price,quantity,name\r\n"
+                    "clothing,W1,2.50,3,Warm hat\r\n"
+                    "clothing,W2,1\r\n"
+                    "entertainment,W3,4,1,Last line");
+    CHECK(importer.import(path, report, errors));
+    CHECK(report.rows == 3 && report.imported == 2 && report.rejected == 1);
+    CHECK(store.find("W1").getName() == "Warm hat" && store.find("W3").getName() == "Last line");
+    CHECK(errors.str().find(path + ":3:") != string::npos);
+
+    writeFile(path, "");
+    CHECK(importer.import(path, report, errors) && report.rows == 0 && report.imported == 0);
+    remove(path.c_str());
+    CHECK(!importer.import(path, report, errors) && importer.getError().find("Cannot open") == 0);
+    CHECK(store.size() == 2);
+}
+
+// Empty selections, control characters, exports larger than the output buffer, and unwritable paths
+void testExportEdgeCases() {
+    string path = "inventory_test_" + to_string(getpid()) + "_edges.export";
+    InventoryStore store;
+    store.add("J1", "Tab\there\\now\x01", 2, Money::fromCents(5), "electronics");
+    InventoryExporter exporter;
+
+    CHECK(exporter.write(path, InventoryExporter::CSV_FORMAT, store, {}));
+    CHECK(readFile(path) == "category,id,price,quantity,name\n");
+    CHECK(exporter.write(path, InventoryExporter::JSONL_FORMAT, store, {}) && readFile(path).empty());
+    CHECK(exporter.write(path, InventoryExporter::JSONL_FORMAT, store, {0}));
+    CHECK(readFile(path) == "{\"category\":\"electronics\",\"id\":\"J1\",\"name\":\"Tab\\u0009here\\\\now\\u0001\","
+                            "\"quantity\":2,\"price\":0.05}\n");
+
+    // Several megabytes, so the buffer is written out many times; nothing may be lost or repeated
+    string longName(200, 'x');
+    for (int i = 0; i < 30000; ++i) store.add("B" + to_string(i), longName, i, Money::fromCents(i + 1), "clothing");
+    vector<uint32_t> rows;
+    store.forEachLiveRow([&](size_t row) { rows.push_back(static_cast<uint32_t>(row)); });
+    CHECK(exporter.write(path, InventoryExporter::CSV_FORMAT, store, rows));
+    string text = readFile(path);
+    CHECK(text.size() > (1 << 20) * 5 && size_t(count(text.begin(), text.end(), '\n')) == rows.size() + 1);
+    string last = "clothing,B29999,300.00,29999," + longName + "\n";
+    CHECK(text.compare(text.size() - last.size(), last.size(), last) == 0);
+    remove(path.c_str());
+
+    for (InventoryExporter::Format format : {InventoryExporter::CSV_FORMAT, InventoryExporter::BINARY_FORMAT}) {
+        CHECK(!exporter.write("no_such_directory/out.export", format, store, rows) && !exporter.getError().empty());
+    }
+}
+
+// Limits, signs, stray characters and rounding of the allocation-free parsers and formatters
+void testNumberParsingEdgeCases() {
+    int count = 3;
+    CHECK(parseCount("2147483647", count) == NUMBER_OK && count == INT_MAX);
+    CHECK(parseCount("2147483648", count) == NUMBER_OUT_OF_RANGE && count == INT_MAX);
+    CHECK(parseCount("-1", count) == NUMBER_MALFORMED);
+    CHECK(parseCount(" 1", count) == NUMBER_MALFORMED && parseCount("1 ", count) == NUMBER_MALFORMED);
+    CHECK(parseCount("007", count) == NUMBER_OK && count == 7);
+    CHECK(parseSignedCount("-2147483648", count) == NUMBER_OK && count == INT_MIN);
+    CHECK(parseSignedCount("-2147483649", count) == NUMBER_OUT_OF_RANGE);
+    CHECK(parseSignedCount("+", count) == NUMBER_MALFORMED && parseSignedCount("+-1", count) == NUMBER_MALFORMED);
+    CHECK(parseSignedCount("--1", count) == NUMBER_MALFORMED && count == INT_MIN);
+
+    double decimal = 0;
+    CHECK(parseDecimal(".25", decimal) == NUMBER_OK && decimal == 0.25);
+    CHECK(parseDecimal("1e5", decimal) == NUMBER_MALFORMED && parseDecimal("-1", decimal) == NUMBER_MALFORMED);
+
+    Money price = Money::fromCents(42);
+    CHECK(parseMoney("0.995", price) == NUMBER_OK && price.getCents() == 100);  // Rounding carries into the units
+    CHECK(parseMoney("1.", price) == NUMBER_OK && price.getCents() == 100);
+    CHECK(parseMoney("0000000000000000000012.30", price) == NUMBER_OK && price.getCents() == 1230);
+    CHECK(parseMoney("12345678901234567", price) == NUMBER_OUT_OF_RANGE && price.getCents() == 1230);
+    CHECK(parseMoney(".", price) == NUMBER_MALFORMED && parseMoney("-1", price) == NUMBER_MALFORMED);
+    CHECK(parseMoney("1,5", price) == NUMBER_MALFORMED && parseMoney("1.5x", price) == NUMBER_MALFORMED);
+    CHECK(parsePrice("0.004", price) == NUMBER_NOT_POSITIVE && parsePrice("0.005", price) == NUMBER_OK);
+
+    char digits[48];
+    char* end = digits + sizeof(digits);
+    CHECK(string(formatInteger(INT64_MIN, end), end) == "-9223372036854775808");
+    CHECK(string(formatInteger(0, end), end) == "0");
+    CHECK(string(formatCents(int64_t(-5), end), end) == "-0.05");
+
+    ItemValidation validation;
+    int quantity = 0;
+    CHECK(validation.isValidNumericInput("12", quantity) && quantity == 12);
+    CHECK(!validation.isValidNumericInput("12.5", quantity) && quantity == 12);
+}
+
+// Stock value stays exact at the largest prices and quantities, for full and partly dead blocks alike
+void testExactValuation() {
+    InventoryStore store;
+    uint64_t state = 20;
+    for (size_t i = 0; i < 2 * CHUNK_ROWS + 40; ++i) {
+        int quantity = (i % 5 == 0) ? INT_MAX : (i % 7 == 0) ? -static_cast<int>(nextRandom(state) % 1000) : static_cast<int>(nextRandom(state));
+        Money price = (i % 3 == 0) ? MAX_PRICE : Money::fromCents(1 + nextRandom(state));
+        store.add("V" + to_string(i), "Valued", quantity, price, "electronics");
+    }
+    for (size_t i = CHUNK_ROWS + 3; i < CHUNK_ROWS + 200; i += 9) store.remove("V" + to_string(i));  // Partly dead blocks
+
+    MoneySum expected = 0;
+    store.forEachLiveRow([&](size_t row) { expected += MoneySum(store.quantityAt(row)) * store.priceAt(row).getCents(); });
+    CHECK(expected > MoneySum(INT64_MAX));  // The total only fits the wide type
+    ValuationEngine engine;
+    CHECK(engine.totalValue(store) == expected);
+
+    char digits[48];
+    char* end = digits + sizeof(digits);
+    CHECK(string(formatCents(MoneySum(INT64_MAX) * 1000, end), end) == "92233720368547758070.00");
+    CHECK(string(formatCents(-MoneySum(INT64_MAX) * 1000, end), end) == "-92233720368547758070.00");
+}
+
+int main() {
+    testNumberParsing();
+    testAddAndValidate();
+    testUpdates();
+    testListenersSeeCommittedRemove();
+    testQueries();
+    testCategoryPostings();
+    testOrdersFollowChanges();
+    testOrderedIndex();
+    testFilterKernelsAgree();
+    testConcurrentUpdates();
+    testCsvImport();
+    testExportRoundTrips();
+    testSearchAfterRowReuse();
+    testCompactionStalesMovedHandles();
+    testViewIsolation();
+    testStockReport();
+    testSnapshotRoundTrip();
+    testJournalReplay();
+    testReplayAfterMissedCheckpoint();
+    testCheckpointKeepsNewerRecords();
+    testHashIndex();
+    testSortMatchesStableSort();
+    testSnapshotEdgeCases();
+    testJournalTornTail();
+    testColumnsAcrossChunks();
+    testFilterKernelEdges();
+    testTombstoneReuse();
+    testConcurrentReadersSeeWholeChanges();
+    testBatchedAdjustments();
+    testViewCopiesOnlyChangedChunks();
+    testIndexedOrdersMatchSort();
+    testTextSearchRanking();
+    testCsvImportEdgeCases();
+    testExportEdgeCases();
+    testNumberParsingEdgeCases();
+    testExactValuation();
+    testLatencyHistogram();
+
+    if (failures > 0) {
+        cerr << failures << " check(s) failed\n";
+        return 1;
+    }
+    cout << "All checks passed\n";
+    return 0;
+}